@@ -0,0 +1,307 @@
+// Kenwood style ASCII CAT, the TS-480 subset logging and contest programs
+// use. Newer Yaesu rigs speak the same FA/FB/MD/IF/TX/RX; dialect.
+//
+// Every command is translated to the CI-V command doing the same thing and
+// run through civ_exec (), the CI-V reply is translated back. No radio
+// state is kept or changed here, the CI-V handlers are the only command
+// core. Set commands get no answer, a command that is unknown or fails
+// gets "?;".
+//
+//   FA FB		VFO A/B frequency, 11 digits Hz		VFO_FREQ 00/01
+//   FR FT		RX/TX VFO, 0 A 1 B					SEL_VFO_MODE
+//   MD			1 LSB 2 USB 3 CW					GET_OP_MODE, SET_MODE_DATA
+//   TX RX		transmit, receive					TX_ON_OFF
+//   SM			S-meter 0000 - 0030					READ_REC_DATA 02
+//   IF			status								the above
+//   ID AI PS	rig id, auto info off, power on
+//
+// SM0KBW
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "pbitx.h"
+#include "dispatch.h"
+#include "num_conv.h"
+#include "civ.h"
+#include "cat_kenwood.h"
+
+#define KW_SZ			40			// longest answer is IF, 38
+
+static char cmd[QUE_SIZE + 1];
+static uint8_t cmd_len;				// without the ';'
+static char ans[KW_SZ];
+static uint8_t bcd[10];				// int2bcd fills ten bytes
+
+
+// Run one CI-V command, false if the rig answered NG
+static bool exec (uint8_t c, const uint8_t *arg, uint8_t n)
+{
+	uint8_t i = 0;
+
+	memset (inque, 0, QUE_SIZE);
+	inque[i++] = 0xFE;
+	inque[i++] = 0xFE;
+	inque[i++] = CIV_RIG_ADDR;
+	inque[i++] = CIV_CTRL_ADDR;
+	inque[i++] = c;
+	while (n--)
+		inque[i++] = *arg++;
+	inque[i] = END_NUM;
+
+	civ_exec ();
+
+	return !(out_len >= 2  &&  outque[out_len - 2] == NG_NUM);
+}
+
+
+// CI-V reply data starts right after the command
+#define REPLY		(outque + CIV_CMD_POS + 1)
+
+
+static bool digits (uint8_t from, uint8_t n)
+{
+	uint8_t i;
+
+	if (cmd_len != from + n)
+		return false;
+
+	for (i = from; i < from + n; i++)
+		if (cmd[i] < '0'  ||  cmd[i] > '9')
+			return false;
+
+	return true;
+}
+
+
+static void answer (void)
+{
+	civ_send (civ_rx_port, (uint8_t *)ans, strlen (ans));
+}
+
+
+static bool get_freq (uint8_t vfo, uint32_t *f)
+{
+	uint8_t sub = vfo == active_vfo ? 0x00 : 0x01;
+
+	if (!exec (VFO_FREQ, &sub, 1))
+		return false;
+
+	*f = bcd2int (1, REPLY);
+	return true;
+}
+
+
+static bool get_mode (uint8_t *m)
+{
+	if (!exec (GET_OP_MODE, NULL, 0))
+		return false;
+
+	switch (REPLY[0])
+	{
+		case LSB:	*m = 1;	break;
+		case USB:	*m = 2;	break;
+		case CW:	*m = 3;	break;
+		default:	return false;
+	}
+	return true;
+}
+
+
+static bool get_tx (bool *on)
+{
+	uint8_t sub = 0x00;
+
+	if (!exec (TX_ON_OFF, &sub, 1))
+		return false;
+
+	*on = REPLY[1] == 0x01;
+	return true;
+}
+
+
+// FA and FB
+static bool kw_freq (uint8_t vfo)
+{
+	uint8_t arg[6];
+	unsigned long f;
+	uint32_t frq;
+
+	if (cmd_len == 2)
+	{
+		if (!get_freq (vfo, &frq))
+			return false;
+		snprintf (ans, KW_SZ, "%.2s%011lu;", cmd, (unsigned long)frq);
+		answer ();
+		return true;
+	}
+
+	if (!digits (2, KW_FREQ_DIGITS))
+		return false;
+
+	// five BCD bytes hold ten digits
+	f = strtoul (cmd + 2, NULL, 10);
+	if (f > KW_FREQ_MAX)
+		return false;
+
+	arg[0] = vfo == active_vfo ? 0x00 : 0x01;
+	int2bcd (f, bcd);
+	memcpy (arg + 1, bcd, 5);
+
+	return exec (VFO_FREQ, arg, 6);
+}
+
+
+// FR and FT, there is no split from CAT so TX follows the RX VFO
+static bool kw_vfo (void)
+{
+	uint8_t arg;
+
+	if (cmd_len == 2)
+	{
+		snprintf (ans, KW_SZ, "%.2s%c;", cmd, active_vfo == VFO_A ? '0' : '1');
+		answer ();
+		return true;
+	}
+
+	if (!digits (2, 1)  ||  cmd[2] > '1')
+		return false;
+
+	if (cmd[1] == 'T')
+		return (cmd[2] == '0') == (active_vfo == VFO_A);
+
+	arg = cmd[2] - '0';
+	return exec (SEL_VFO_MODE, &arg, 1);
+}
+
+
+static bool kw_mode (void)
+{
+	uint8_t m;
+	static const uint8_t civ_mode[] = { 0, LSB, USB, CW };
+
+	if (cmd_len == 2)
+	{
+		if (!get_mode (&m))
+			return false;
+		snprintf (ans, KW_SZ, "MD%d;", m);
+		answer ();
+		return true;
+	}
+
+	if (!digits (2, 1)  ||  cmd[2] < '1'  ||  cmd[2] > '3')
+		return false;
+
+	return exec (SET_MODE_DATA, &civ_mode[cmd[2] - '0'], 1);
+}
+
+
+// TX, TX0 - TX2 all key the rig, RX unkeys it
+static bool kw_tx (bool on)
+{
+	uint8_t arg[2] = { 0x00, on ? 0x01 : 0x00 };
+
+	if (cmd_len > 3  ||  (cmd_len == 3  &&  (!on  ||  cmd[2] < '0'  ||  cmd[2] > '2')))
+		return false;
+
+	return exec (TX_ON_OFF, arg, 2);
+}
+
+
+// Icom 0000 - 0241 with S9 at 0120, Kenwood 0 - 30 with S9 at 15
+static bool kw_smeter (void)
+{
+	uint8_t sub = REC_S_METER;
+	uint16_t s;
+
+	if (cmd_len > 3  ||  (cmd_len == 3  &&  cmd[2] != '0'))
+		return false;
+
+	if (!exec (READ_REC_DATA, &sub, 1))
+		return false;
+
+	s = (REPLY[1] & 0x0F) * 100 + (REPLY[2] >> 4) * 10 + (REPLY[2] & 0x0F);
+
+	if (s <= 120)
+		s = s * 15 / 120;
+	else
+		s = 15 + (s - 120) * 15 / 121;
+
+	snprintf (ans, KW_SZ, "SM0%04u;", s);
+	answer ();
+	return true;
+}
+
+
+// IF, frequency, step, RIT offset, RIT, XIT, bank, channel, TX, mode, VFO,
+// scan, split, tone, tone number and shift. RIT and XIT are not reported.
+static bool kw_status (void)
+{
+	uint32_t f;
+	uint8_t m;
+	bool tx;
+
+	if (cmd_len != 2)
+		return false;
+
+	if (!get_freq (active_vfo, &f)  ||  !get_mode (&m)  ||  !get_tx (&tx))
+		return false;
+
+	snprintf (ans, KW_SZ, "IF%011lu     +000000000%c%c%c0%c0000;", (unsigned long)f,
+			tx ? '1' : '0', '0' + m, active_vfo == VFO_A ? '0' : '1', split_on ? '1' : '0');
+	answer ();
+	return true;
+}
+
+
+// Fixed answers, the setting forms are accepted and ignored
+static bool kw_fixed (const char *a)
+{
+	if (cmd_len == 2)
+	{
+		snprintf (ans, KW_SZ, "%.2s%s;", cmd, a);
+		answer ();
+	}
+	return true;
+}
+
+
+void kenwood_dispatch (void)
+{
+	char *end;
+	bool ok;
+
+	// the frame is in inque, running CI-V commands will overwrite it
+	memcpy (cmd, inque, QUE_SIZE);
+	cmd[QUE_SIZE] = 0;
+	end = strchr (cmd, ';');
+	cmd_len = end ? end - cmd : 0;
+
+	if (cmd_len < 2)
+		ok = false;
+	else
+	switch (((uint8_t)cmd[0] << 8) | (uint8_t)cmd[1])
+	{
+		case ('F' << 8) | 'A':	ok = kw_freq (VFO_A);		break;
+		case ('F' << 8) | 'B':	ok = kw_freq (VFO_B);		break;
+		case ('F' << 8) | 'R':
+		case ('F' << 8) | 'T':	ok = kw_vfo ();				break;
+		case ('M' << 8) | 'D':	ok = kw_mode ();			break;
+		case ('T' << 8) | 'X':	ok = kw_tx (true);			break;
+		case ('R' << 8) | 'X':	ok = kw_tx (false);			break;
+		case ('S' << 8) | 'M':	ok = kw_smeter ();			break;
+		case ('I' << 8) | 'F':	ok = kw_status ();			break;
+		case ('I' << 8) | 'D':	ok = cmd_len == 2  &&  kw_fixed (KW_RIG_ID);	break;
+		case ('A' << 8) | 'I':	ok = kw_fixed ("0");		break;
+		case ('P' << 8) | 'S':	ok = kw_fixed ("1");		break;
+		default:				ok = false;					break;
+	}
+
+	if (!ok)
+	{
+		strcpy (ans, "?;");
+		answer ();
+	}
+}
@@ -0,0 +1,14 @@
+// Kenwood style ASCII CAT front end
+#ifndef _CAT_KENWOOD_
+#define _CAT_KENWOOD_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define KW_RIG_ID		"020"		// TS-480
+#define KW_FREQ_DIGITS	11
+#define KW_FREQ_MAX		99999999ul
+
+void kenwood_dispatch (void);
+
+#endif // _CAT_KENWOOD_
@@ -0,0 +1,323 @@
+// CI-V link layer.
+//
+// UART0 bytes are moved to a ring by the RX interrupt, the USB CAT port is
+// read out every tick (TinyUSB already buffers it). civ_poll() runs the
+// framer over both, complete frames wait in a queue until civ_get_frame()
+// copies them to inque for dispatch().
+//
+// The framer hunts for 0xFE 0xFE, a frame ends with 0xFD. A jammer code
+// 0xFC, a frame longer than inque or a preamble in the middle of a frame
+// drops what has been collected.
+//
+// An upper case letter while hunting starts an ASCII command instead, ended
+// by ';'. These are queued the same way and civ_rx_proto tells dispatch()
+// which front end to use. The last protocol seen on a port is kept in
+// civ_proto, transceive frames only go to ports that have sent CI-V.
+//
+// Replies go to a TX ring per port. The UART ring is drained by the TX
+// interrupt, but a frame is only started while the bus is quiet. CI-V on a
+// single wire reads back everything we send, frames from our own address
+// are that echo and are dropped. USB takes what fits in its FIFO per tick.
+//
+// SM0KBW
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/uart.h"
+#include "hardware/irq.h"
+#include "pbitx.h"
+#include "dispatch.h"
+#include "civ.h"
+#include "usb_ports.h"
+
+typedef struct
+{
+	uint8_t port;
+	uint8_t proto;
+	uint8_t len;
+	uint8_t data[QUE_SIZE];
+} civ_frame;
+
+typedef struct
+{
+	uint8_t state;
+	uint8_t len;
+	uint8_t data[QUE_SIZE];
+} civ_framer;
+
+enum { HUNT, PREAMBLE, BODY, ASCII };
+
+civ_counters civ_stats[CIV_PORTS];
+uint8_t civ_rx_port;
+uint8_t civ_rx_proto;
+uint8_t civ_proto[CIV_PORTS];
+
+// UART0 receive ring, written by the IRQ only
+static uint8_t uart_ring[CIV_RING_SZ];
+static volatile uint16_t uart_head = 0;
+static uint16_t uart_tail = 0;
+
+static civ_framer framer[CIV_PORTS];
+
+// TX rings, the UART one is read by the IRQ
+static uint8_t tx_ring[CIV_PORTS][CIV_RING_SZ];
+static volatile uint16_t tx_head[CIV_PORTS];
+static volatile uint16_t tx_tail[CIV_PORTS];
+
+static civ_frame frames[CIV_FRAMES];
+static uint8_t frame_head = 0, frame_tail = 0;
+
+
+static bool frames_full (void)
+{
+	return (uint8_t)(frame_head - frame_tail) >= CIV_FRAMES;
+}
+
+
+static void civ_uart_irq (void)
+{
+	uint8_t p = CIV_PORT_UART;
+
+	while (uart_is_readable (ACTIVE_UART))
+	{
+		uint8_t ch = uart_getc (ACTIVE_UART);
+
+		if ((uint16_t)(uart_head - uart_tail) < CIV_RING_SZ)
+			uart_ring[uart_head++ % CIV_RING_SZ] = ch;
+		else
+			civ_stats[CIV_PORT_UART].overruns++;
+	}
+
+	while (tx_tail[p] != tx_head[p]  &&  uart_is_writable (ACTIVE_UART))
+		uart_putc_raw (ACTIVE_UART, tx_ring[p][tx_tail[p]++ % CIV_RING_SZ]);
+
+	// TX interrupt only while there is something to send
+	uart_set_irq_enables (ACTIVE_UART, true, tx_tail[p] != tx_head[p]);
+}
+
+
+void civ_init (void)
+{
+	irq_set_exclusive_handler (UART0_IRQ, civ_uart_irq);
+	irq_set_enabled (UART0_IRQ, true);
+	uart_set_irq_enables (ACTIVE_UART, true, false);
+}
+
+
+static void civ_frame_done (uint8_t port, uint8_t proto, civ_framer *f)
+{
+	civ_frame *q;
+
+	if (frames_full ())
+	{
+		civ_stats[port].overruns++;
+		return;
+	}
+
+	q = &frames[frame_head++ % CIV_FRAMES];
+	q->port = port;
+	q->proto = proto;
+	q->len = f->len;
+	memcpy (q->data, f->data, f->len);
+	civ_stats[port].frames++;
+	civ_proto[port] = proto;
+}
+
+
+static void civ_framer_byte (uint8_t port, uint8_t ch)
+{
+	civ_framer *f = &framer[port];
+
+	civ_stats[port].rx_bytes++;
+
+	switch (f->state)
+	{
+		case HUNT:
+			if (ch == CIV_PREAMBLE)
+				f->state = PREAMBLE;
+			else
+			if (ch >= 'A'  &&  ch <= 'Z')
+			{
+				f->data[0] = ch;
+				f->len = 1;
+				f->state = ASCII;
+			}
+			break;
+
+		case PREAMBLE:
+			if (ch == CIV_PREAMBLE)
+			{
+				f->data[0] = f->data[1] = CIV_PREAMBLE;
+				f->len = 2;
+				f->state = BODY;
+			}
+			else
+				f->state = HUNT;
+			break;
+
+		case BODY:
+			if (ch == CIV_PREAMBLE)
+			{
+				// extra preamble bytes are allowed, one after data starts a new frame
+				if (f->len > 2)
+				{
+					civ_stats[port].resyncs++;
+					f->len = 2;
+				}
+			}
+			else
+			if (ch == CIV_JAM)
+			{
+				civ_stats[port].collisions++;
+				f->state = HUNT;
+			}
+			else
+			if (f->len >= QUE_SIZE)
+			{
+				civ_stats[port].too_long++;
+				f->state = HUNT;
+			}
+			else
+			{
+				f->data[f->len++] = ch;
+				if (ch == CIV_EOM)
+				{
+					civ_frame_done (port, CIV_PROTO_CIV, f);
+					f->state = HUNT;
+				}
+			}
+			break;
+
+		case ASCII:
+			if (ch == CIV_PREAMBLE)
+			{
+				civ_stats[port].resyncs++;
+				f->state = PREAMBLE;
+			}
+			else
+			if (ch < ' '  ||  ch > '~')
+			{
+				// CR and LF between commands, anything else is noise
+				if (ch != '\r'  &&  ch != '\n')
+					civ_stats[port].resyncs++;
+				f->state = HUNT;
+			}
+			else
+			if (f->len >= QUE_SIZE)
+			{
+				civ_stats[port].too_long++;
+				f->state = HUNT;
+			}
+			else
+			{
+				f->data[f->len++] = ch;
+				if (ch == ';')
+				{
+					civ_frame_done (port, CIV_PROTO_ASCII, f);
+					f->state = HUNT;
+				}
+			}
+			break;
+	}
+}
+
+
+// Feed what has arrived since the last tick to the framers. With the frame
+// queue full the rest stays in the USB buffer and the UART ring.
+void civ_poll (void)
+{
+	uint8_t ch;
+
+	while (!frames_full ()  &&  usb_read (USB_CAT, &ch, 1))
+		civ_framer_byte (CIV_PORT_USB, ch);
+
+	while (!frames_full ()  &&  uart_tail != uart_head)
+		civ_framer_byte (CIV_PORT_UART, uart_ring[uart_tail++ % CIV_RING_SZ]);
+
+	civ_flush ();
+}
+
+
+// Move the next complete frame to inque, false if there is none
+bool civ_get_frame (void)
+{
+	civ_frame *q;
+
+	for (;;)
+	{
+		if (frame_tail == frame_head)
+			return false;
+
+		q = &frames[frame_tail++ % CIV_FRAMES];
+
+		// our own reply read back from the bus
+		if (q->proto == CIV_PROTO_CIV  &&  q->len > 3  &&  q->data[3] == CIV_RIG_ADDR)
+		{
+			civ_stats[q->port].echoes++;
+			continue;
+		}
+
+		memset (inque, 0, QUE_SIZE);
+		memcpy (inque, q->data, q->len);
+		civ_rx_port = q->port;
+		civ_rx_proto = q->proto;
+
+		return true;
+	}
+}
+
+
+// Queue a frame, a frame that does not fit is dropped as a whole
+void civ_send (uint8_t port, const uint8_t *data, uint8_t len)
+{
+	uint8_t i;
+
+	if ((uint16_t)(tx_head[port] - tx_tail[port]) + len > CIV_RING_SZ)
+	{
+		civ_stats[port].tx_dropped += len;
+		return;
+	}
+
+	for (i = 0; i < len; i++)
+		tx_ring[port][tx_head[port]++ % CIV_RING_SZ] = data[i];
+
+	civ_stats[port].tx_bytes += len;
+}
+
+
+// Start what is queued. The main loop calls it after dispatch() so a reply
+// leaves in the tick that answered it, civ_poll() for what a full USB FIFO
+// held back.
+void civ_flush (void)
+{
+	uint8_t p = CIV_PORT_USB;
+
+	while (tx_tail[p] != tx_head[p]  &&  usb_write (USB_CAT, &tx_ring[p][tx_tail[p] % CIV_RING_SZ], 1))
+		tx_tail[p]++;
+
+	// don't talk over a frame coming in. The TX interrupt only fires when the
+	// FIFO drains, so fill it here and the IRQ takes it from there.
+	p = CIV_PORT_UART;
+	if (tx_tail[p] != tx_head[p]  &&  framer[p].state == HUNT  &&  uart_tail == uart_head)
+	{
+		irq_set_enabled (UART0_IRQ, false);
+		civ_uart_irq ();
+		irq_set_enabled (UART0_IRQ, true);
+	}
+}
+
+
+void civ_stats_print (void)
+{
+	uint8_t p;
+
+	for (p = 0; p < CIV_PORTS; p++)
+		printf ("civ%d: rx %lu bytes %lu frames, %lu overruns %lu too long %lu collisions %lu resyncs %lu echoes, tx %lu bytes %lu dropped\n", p,
+			civ_stats[p].rx_bytes, civ_stats[p].frames, civ_stats[p].overruns,
+			civ_stats[p].too_long, civ_stats[p].collisions, civ_stats[p].resyncs,
+			civ_stats[p].echoes, civ_stats[p].tx_bytes, civ_stats[p].tx_dropped);
+}
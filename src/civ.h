@@ -0,0 +1,50 @@
+// CI-V link layer, receive rings, framer and frame queue
+#ifndef _CIV_
+#define _CIV_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CIV_PREAMBLE	0xFE
+#define CIV_EOM			0xFD
+#define CIV_JAM			0xFC		// collision on the bus
+
+#define CIV_PORT_USB	0
+#define CIV_PORT_UART	1
+#define CIV_PORTS		2
+
+// what a port speaks, found from its traffic
+#define CIV_PROTO_NONE	0			// nothing heard yet
+#define CIV_PROTO_CIV	1
+#define CIV_PROTO_ASCII	2			// Kenwood style, ';' terminated
+
+#define CIV_RING_SZ		256			// power of two
+#define CIV_FRAMES		8
+
+// per port link statistics
+typedef struct
+{
+	uint32_t rx_bytes;
+	uint32_t frames;
+	uint32_t overruns;				// ring full, bytes lost
+	uint32_t too_long;
+	uint32_t collisions;
+	uint32_t resyncs;				// preamble inside a frame
+	uint32_t echoes;				// own frames read back from the bus
+	uint32_t tx_bytes;
+	uint32_t tx_dropped;			// TX ring full
+} civ_counters;
+
+extern civ_counters civ_stats[CIV_PORTS];
+extern uint8_t civ_rx_port;			// port of the frame in inque
+extern uint8_t civ_rx_proto;		// and its protocol
+extern uint8_t civ_proto[CIV_PORTS];	// last protocol seen per port
+
+void civ_init (void);
+void civ_poll (void);
+bool civ_get_frame (void);
+void civ_flush (void);
+void civ_send (uint8_t port, const uint8_t *data, uint8_t len);
+void civ_stats_print (void);
+
+#endif // _CIV_
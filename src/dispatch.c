@@ -26,6 +26,10 @@
 #include <string.h>
 #include "pbitx.h"
 #include "dispatch.h"
+#include "num_conv.h"
+#include "civ.h"
+#include "pan_stream.h"
+#include "cat_kenwood.h"
 
 
 
@@ -37,12 +41,6 @@
 #define CIV_ARG_POS			5
 #define CIV_SUB_POS			6
 
-#define CIV_RIG_ADDR		0xA1
-
-#define OK_NUM				0xFB
-#define NG_NUM				0xFA
-#define END_NUM				0xFD
-
 #define AF_TIME_CONST		223718
 
 
@@ -80,12 +78,20 @@ const call_ptr call_table [CALL_TAB_SIZE] =
 	unimplemented,		//						0x17
 	power_on,			//						0x18
 	read_rig_id,		// READ_RIG_ID			0x19
-	unimplemented,		//						0x1A	
+	ext_settings,		// EXT_SETTINGS			0x1A
 	unimplemented,		//						0x1B	
 	tx_on_off	,		// Transmit On/Off		0x1C
 	unimplemented,		//						0x1D	
 	unimplemented,		//						0x1E	
 	unimplemented,		//						0x1F	
+	unimplemented,		//						0x20
+	unimplemented,		//						0x21
+	unimplemented,		//						0x22
+	unimplemented,		//						0x23
+	unimplemented,		//						0x24
+	vfo_freq,			// VFO_FREQ				0x25
+	unimplemented,		//						0x26
+	scope,				// SCOPE				0x27
 
 };
 
@@ -113,10 +119,13 @@ void set_ng_str (uint8_t pos);
 // CIV_SUB_POS	5
 // CIV_ARG_POS	6
 
-void dispatch (void)
+// Run the CI-V command in inque, the reply is left in outque. This is the
+// command core for every front end, returns the reply length, 0 for none.
+uint8_t civ_exec (void)
 {
 	uint8_t i;
 	out_index = 0;
+	out_len = 0;
 
 //	printf ("0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X\n", inque[0], inque[1], inque[2], inque[3], inque[4], inque[5], inque[6], inque[7], 
 // inque[8], inque[9]);
@@ -139,11 +148,29 @@ void dispatch (void)
 		(call_table [inque[CIV_CMD_POS]])();
 	else
 		set_ng_str (CIV_CMD_POS);
+
+	if (out_len > QUE_SIZE)
+		out_len = 0;
 		
 //printf ("0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X 0x%.2X\n", 
 //			outque[0], outque[1], outque[2], outque[3], outque[4], outque[5], outque[6], outque[7], outque[8], outque[9],
 //			outque[10], outque[11], outque[12], outque[13], outque[14], outque[15], outque[16], outque[17], outque[18], outque[19]);
 
+	return out_len;
+}
+
+
+// A frame from the link layer, the reply goes back where it came from
+void dispatch (void)
+{
+	if (civ_rx_proto == CIV_PROTO_ASCII)
+	{
+		kenwood_dispatch ();
+		return;
+	}
+
+	if (civ_exec ())
+		civ_send (civ_rx_port, outque, out_len);
 }
 
 
@@ -211,7 +238,7 @@ void get_band_edge (void)
 //	set_ok_str (CIV_CMD_POS);
 		
 	outque[i] = END_NUM;
-	out_len =  CIV_SUB_POS + 17;
+	out_len =  i + 1;
 
 }
 
@@ -504,10 +531,27 @@ void set_misc_mode (void)
 
 
 // READ_REC_DATA		0x15
+// Only the S-meter, 0x02, as 0000 - 0241 in two BCD bytes, 0120 is S9
 
  void read_rec_data (void)
 {
-	set_ng_str (CIV_CMD_POS);
+	uint8_t s;
+
+	if (inque[CIV_ARG_POS] != REC_S_METER)
+	{
+		set_ng_str (CIV_CMD_POS);
+		return;
+	}
+
+	s = get_s_value (241);
+	if (s > 241)
+		s = 241;
+
+	outque[CIV_ARG_POS] = REC_S_METER;
+	outque[CIV_SUB_POS] = s / 100;
+	outque[CIV_SUB_POS + 1] = ((s / 10 % 10) << 4) | (s % 10);
+	outque[CIV_SUB_POS + 2] = END_NUM;
+	out_len = CIV_SUB_POS + 3;
 }
 //
 //
@@ -543,7 +587,39 @@ void read_rig_id (void)
 	set_ok_str (CIV_SUB_POS + 2);
 }
 
-//  linked to Unimplemented		0x1A
+// 0xFE 0xFE 0xA1 0xE0 0x1A 0x05 0x01 0x31 0x01 0xFD
+// EXT_SETTINGS			0x1A
+// Only 05 01 31, the IC-7300 menu item for CI-V transceive. 00 turns it
+// off and 01 on, without data the state is read.
+void ext_settings (void)
+{
+	uint8_t i;
+
+	if (inque[CIV_ARG_POS] != 0x05  ||  inque[CIV_SUB_POS] != EXT_TRANSCEIVE_HI  ||  inque[CIV_SUB_POS + 1] != EXT_TRANSCEIVE_LO)
+	{
+		set_ng_str (CIV_CMD_POS);
+		return;
+	}
+
+	if (inque[CIV_SUB_POS + 2] == END_NUM)
+	{
+		for (i = CIV_ARG_POS; i < CIV_SUB_POS + 2; i++)
+			outque[i] = inque[i];
+		outque[i++] = civ_transceive ? 0x01 : 0x00;
+		outque[i++] = END_NUM;
+		out_len = i;
+		return;
+	}
+
+	if (inque[CIV_SUB_POS + 2] > 0x01  ||  inque[CIV_SUB_POS + 3] != END_NUM)
+	{
+		set_ng_str (CIV_CMD_POS);
+		return;
+	}
+
+	civ_transceive = inque[CIV_SUB_POS + 2] == 0x01;
+	set_ok_str (CIV_CMD_POS);
+}
 
 
 
@@ -552,20 +628,215 @@ void read_rig_id (void)
 // 0==Tx Off and  1==Tx on
 
 
+// Icom form 0x1C 0x00 then 00/01, without data the state is read. The
+// short 0x1C 0x01 that starts TX is still accepted.
 void tx_on_off (void)
 {
-	set_ok_str (CIV_CMD_POS);
+	uint8_t on;
+
+	if (inque[CIV_ARG_POS] == 0x00  &&  inque[CIV_SUB_POS] == END_NUM)
+	{
+		outque[CIV_ARG_POS] = 0x00;
+		outque[CIV_SUB_POS] = inTx ? 0x01 : 0x00;
+		outque[CIV_SUB_POS + 1] = END_NUM;
+		out_len = CIV_SUB_POS + 2;
+		return;
+	}
 
 	if (inque[CIV_ARG_POS] == 0x00)
+		on = inque[CIV_SUB_POS];
+	else
+		on = inque[CIV_ARG_POS];
+
+	set_ok_str (CIV_CMD_POS);
+
+	if (on == 0x00)
 		stopTx (true);
 	else
-	if (inque[CIV_ARG_POS] == 0x01)
+	if (on == 0x01)
 		startTx (true);
 	else
 		set_ng_str (CIV_CMD_POS);
 }
 
 
+// VFO_FREQ				0x25
+// 00 is the selected and 01 the unselected VFO, five BCD bytes sets it and
+// without them it is read.
+void vfo_freq (void)
+{
+	uint8_t i;
+	uint32_t freq;
+	bool other;
+
+	if (inque[CIV_ARG_POS] > 0x01)
+	{
+		set_ng_str (CIV_CMD_POS);
+		return;
+	}
+
+	other = inque[CIV_ARG_POS] == 0x01;
+
+	if (inque[CIV_SUB_POS] == END_NUM)
+	{
+		if (!other)
+			freq = getfrequency ();
+		else
+		if (active_vfo == VFO_A)
+			freq = vfo_b_freq;
+		else
+			freq = vfo_a_freq;
+
+		int2bcd (freq, buff);
+
+		outque[CIV_ARG_POS] = inque[CIV_ARG_POS];
+		for (i = 0; i < 5; i++)
+			outque[CIV_SUB_POS + i] = buff[i];
+		outque[CIV_SUB_POS + i] = END_NUM;
+		out_len = CIV_SUB_POS + i + 1;
+		return;
+	}
+
+	if (inque[CIV_SUB_POS + 5] != END_NUM)
+	{
+		set_ng_str (CIV_CMD_POS);
+		return;
+	}
+
+	freq = bcd2int (CIV_SUB_POS, inque);
+
+	if (!other)
+		setfrequency (freq);
+	else
+	if (active_vfo == VFO_A)
+	{
+		vfo_b_freq = freq;
+		settings.vfo_b = freq;
+		settings_save ();
+	}
+	else
+	{
+		vfo_a_freq = freq;
+		settings.vfo_a = freq;
+		settings_save ();
+	}
+
+	set_ok_str (CIV_CMD_POS);
+}
+
+
+// Scope, only the stream switch 0x27 0x11. 00 stops and 01 starts the binary
+// panorama stream on the USB telemetry port, without data the state is read.
+void scope (void)
+{
+	if (inque[CIV_ARG_POS] != SCOPE_STREAM)
+	{
+		set_ng_str (CIV_CMD_POS);
+		return;
+	}
+
+	if (inque[CIV_SUB_POS] == END_NUM)
+	{
+		outque[CIV_ARG_POS] = SCOPE_STREAM;
+		outque[CIV_SUB_POS] = pan_stream_on ? 0x01 : 0x00;
+		outque[CIV_SUB_POS + 1] = END_NUM;
+		out_len = CIV_SUB_POS + 2;
+		return;
+	}
+
+	set_ok_str (CIV_CMD_POS);
+
+	if (inque[CIV_SUB_POS] == 0x00)
+		pan_stream_start (false);
+	else
+	if (inque[CIV_SUB_POS] == 0x01)
+		pan_stream_start (true);
+	else
+		set_ng_str (CIV_CMD_POS);
+}
+
+
+
+// Transceive, changes of frequency, mode, TX and split are pushed to the
+// ports that have spoken CI-V without being asked. Off after power up like
+// on an Icom rig, the host turns it on with 0x1A 0x05 0x01 0x31 0x01. The state is compared once per tick so fast
+// tuning only sends the latest frequency, and a port never gets updates
+// closer than CIV_TRX_MS.
+#define CIV_TRX_MS			100
+#define CIV_BROADCAST		0x00
+
+bool civ_transceive = false;
+
+static void trx_send (uint8_t cmd, const uint8_t *arg, uint8_t n)
+{
+	uint8_t f[QUE_SIZE];
+	uint8_t i = 0, p;
+
+	f[i++] = 0xFE;
+	f[i++] = 0xFE;
+	f[i++] = CIV_BROADCAST;
+	f[i++] = CIV_RIG_ADDR;
+	f[i++] = cmd;
+	memcpy (f + i, arg, n);
+	i += n;
+	f[i++] = END_NUM;
+
+	for (p = 0; p < CIV_PORTS; p++)
+		if (civ_proto[p] == CIV_PROTO_CIV)
+			civ_send (p, f, i);
+}
+
+
+void civ_transceive_poll (void)
+{
+	static uint32_t last_frq, last_t;
+	static uint8_t last_mode = 0xFF, last_tx = 0xFF, last_split = 0xFF;
+	uint32_t frq;
+	uint8_t arg[2];
+	bool sent = false;
+
+	if (!civ_transceive  ||  millis () - last_t < CIV_TRX_MS)
+		return;
+
+	frq = getfrequency ();
+	if (frq != last_frq)
+	{
+		int2bcd (frq, buff);
+		trx_send (SET_FREQ_DATA, buff, 5);
+		last_frq = frq;
+		sent = true;
+	}
+
+	if (getmode () != last_mode)
+	{
+		arg[0] = last_mode = getmode ();
+		arg[1] = 0x02;						// same filter as GET_OP_MODE
+		trx_send (SET_MODE_DATA, arg, 2);
+		sent = true;
+	}
+
+	if (inTx != last_tx)
+	{
+		last_tx = inTx;
+		arg[0] = 0x00;
+		arg[1] = inTx ? 0x01 : 0x00;
+		trx_send (TX_ON_OFF, arg, 2);
+		sent = true;
+	}
+
+	if (split_on != last_split)
+	{
+		last_split = split_on;
+		arg[0] = split_on ? 0x01 : 0x00;
+		trx_send (SPLIT_MODE, arg, 1);
+		sent = true;
+	}
+
+	if (sent)
+		last_t = millis ();
+}
+
+
 
 void set_ok_str (uint8_t pos)
 {
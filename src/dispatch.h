@@ -3,7 +3,7 @@
 #define DISPATCH
 
 #define QUE_SIZE		20
-#define CALL_TAB_SIZE 	0x20
+#define CALL_TAB_SIZE 	0x28
 
 #define CIV_CMD_POS	4
 #define CIV_SUB_POS	5
@@ -11,6 +11,12 @@
 
 
 #define CIV_SEPARATE	    0x2D
+#define CIV_RIG_ADDR		0xA1
+#define CIV_CTRL_ADDR		0xE0
+
+#define OK_NUM				0xFB
+#define NG_NUM				0xFA
+#define END_NUM				0xFD
 
 
 #define SET_FREQ_DATA		0x00
@@ -39,9 +45,18 @@
 #define UNIMPLEMENTED		0x17
 #define POWER_ON			0x18
 #define READ_RIG_ID		    0x19
+#define EXT_SETTINGS		0x1A
 #define CTCSS				0x1B
 #define TX_ON_OFF			0x1C
 #define DTMF				0x1F
+#define VFO_FREQ			0x25
+#define SCOPE				0x27
+
+#define REC_S_METER			0x02		// sub command of READ_REC_DATA
+
+#define SCOPE_STREAM		0x11		// sub command, panorama stream on USB telemetry
+#define EXT_TRANSCEIVE_HI	0x01		// EXT_SETTINGS 0x05 item, CI-V transceive
+#define EXT_TRANSCEIVE_LO	0x31
 
 #define VFO_MODE			0
 
@@ -49,6 +64,7 @@ typedef  void (*call_ptr)(void);
 
 extern const call_ptr call_table [CALL_TAB_SIZE];
 extern uint8_t outque[QUE_SIZE];
+extern uint8_t out_len;
 extern uint8_t inque[QUE_SIZE];
 
 void set_freq_data (void);
@@ -75,16 +91,23 @@ void read_rec_data (void);
 void set_rec_mode (void);
 void power_on (void);
 void read_rig_id (void);
+void ext_settings (void);
 void ctcss (void);
 void tx_on_off (void);
 void dtmf (void);
 void antenna_switch (void);
+void vfo_freq (void);
+void scope (void);
 
 void unimplemented (void);
 
 
 
+uint8_t civ_exec (void);
 void dispatch (void);
+void civ_transceive_poll (void);
+
+extern bool civ_transceive;
 
 #endif
 // headerfile end
@@ -1,117 +1,514 @@
 // Just a simple replacement for the 256 byte eeprom storage
-// 
-// BA 2021-Mar-10 
+//
+// BA 2021-Mar-10
+//
+// The 256 byte image now lives in RAM and is kept in flash as a log of
+// key/value records over a ring of STORE_SECTORS sectors. e_get() never
+// touches flash, e_put() only marks the key dirty and e_idle() appends the
+// dirty keys once the settings have been left alone for STORE_IDLE_MS.
+//
+// A sector starts with a header record carrying its sequence number, the
+// sector with the highest valid sequence holds the current state. When it
+// is full the next sector in the ring gets a snapshot of the image, the
+// header goes in last so a power cut during compaction leaves the old
+// sector in charge. A torn record fails its CRC and is skipped.
+//
+// Flash can not be read while it is erased or programmed, so interrupts are
+// off for the duration and core1, if running, is parked. To keep those
+// windows short and rare the loop calls e_idle() only at safe points (not in
+// TX, no CW element keyed, encoder at rest). Each call does one flash
+// operation, an erase or a page program, and the work is spread over the
+// calls: a flush appends a page of records at a time, a compaction takes a
+// call per snapshot page and one for the header. The next sector is erased
+// ahead of time when the current one is three quarters full, so usually no
+// erase stands between the settings and the flash. e_flush() does all the
+// steps at once.
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "pico/stdlib.h"
 #include "hardware/flash.h"
 #include "hardware/sync.h"
+#include "pico/multicore.h"
 #include "pico.h"
 #include "e_storage.h"
 
-#define USE_PAGE 2
+#define STORE_SECTORS	4
+#define STORE_IDLE_MS	2000
 
-uint8_t buffer[FLASH_PAGE_SIZE];
+// the ring sits just below the last sector, which holds the old single page
+#define LEGACY_OFFSET	(PICO_FLASH_SIZE_BYTES - FLASH_PAGE_SIZE)
+#define STORE_OFFSET	(PICO_FLASH_SIZE_BYTES - (STORE_SECTORS + 1) * FLASH_SECTOR_SIZE)
 
+#define REC_TAG		0xA5
+#define HDR_TAG		0x5A
+#define ERASED		0xFF
 
-void erase (void)
+typedef struct
 {
-  uint32_t ints;
+	uint8_t key;			// e_put() address
+	uint8_t tag;
+	uint16_t crc;
+	uint32_t value;			// sequence number in a header
+} kv_rec;
 
-  // Erase the last sector of the flash
-  ints = save_and_disable_interrupts ();
-  flash_range_erase ((PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE), FLASH_SECTOR_SIZE);
-  restore_interrupts (ints);
+#define REC_PER_PAGE	(FLASH_PAGE_SIZE / sizeof(kv_rec))
+#define REC_PER_SECTOR	(FLASH_SECTOR_SIZE / sizeof(kv_rec))
+
+static uint8_t image[E_SIZE];
+static uint32_t dirty[E_SIZE / 32];
+static uint32_t dirty_since;
+static bool loaded = false;
+
+static uint8_t sector;				// current sector of the ring
+static uint16_t slot;				// next free record in it
+static uint32_t seq;
+
+static uint8_t page[FLASH_PAGE_SIZE];
+static bool next_erased = false;	// the next sector is ready for compaction
+
+e_counters e_stats;
+
+
+uint16_t crc16 (const uint8_t *p, uint16_t n)
+{
+	uint16_t crc = 0xFFFF;
+	uint8_t i;
+
+	while (n--)
+	{
+		crc ^= (uint16_t)*p++ << 8;
+		for (i = 0; i < 8; i++)
+			crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+
+	return crc;
 }
 
 
-void write (void)
+static uint16_t rec_crc (kv_rec *r)
 {
-  uint32_t ints;
+	uint8_t b[6];
+
+	b[0] = r->key;
+	b[1] = r->tag;
+	memcpy (&b[2], &r->value, 4);
+
+	return crc16 (b, 6);
+}
+
+
+static const kv_rec *rec_at (uint8_t sect, uint16_t n)
+{
+	return (const kv_rec *)(XIP_BASE + STORE_OFFSET + sect * FLASH_SECTOR_SIZE) + n;
+}
+
+
+static bool rec_valid (const kv_rec *r, uint8_t tag)
+{
+	kv_rec c = *r;
+
+	return c.tag == tag  &&  c.crc == rec_crc (&c);
+}
+
+
+static bool rec_erased (const kv_rec *r)
+{
+	const uint8_t *p = (const uint8_t *)r;
+	uint8_t i;
+
+	for (i = 0; i < sizeof(kv_rec); i++)
+		if (p[i] != ERASED)
+			return false;
+
+	return true;
+}
+
+
+static void image_put (uint8_t key, uint32_t value)
+{
+	uint8_t i;
+
+	// the address wraps inside the image like the old page buffer did
+	for (i = 0; i < 4; i++, value >>= 8)
+		image[(uint8_t)(key + i)] = value & 0xFF;
+}
+
+
+// Park core1 if it runs, it executes from flash too
+static bool lockout_begin (void)
+{
+	if (get_core_num () == 0  &&  multicore_lockout_victim_is_initialized (1))
+	{
+		multicore_lockout_start_blocking ();
+		return true;
+	}
+
+	return false;
+}
+
+
+static void irq_off_account (uint32_t us)
+{
+	if (us > e_stats.irq_off_max_us)
+		e_stats.irq_off_max_us = us;
+	e_stats.irq_off_us += us;
+}
 
-	// Program buf[] into the first page of this sector
+
+// Runs from RAM, XIP is gone until flash_range_erase() returns
+static void __not_in_flash_func(erase) (uint8_t sect)
+{
+	uint32_t ints, t;
+	bool locked;
+
+	locked = lockout_begin ();
 	ints = save_and_disable_interrupts ();
-	flash_range_program ((PICO_FLASH_SIZE_BYTES - FLASH_PAGE_SIZE), (const uint8_t *)buffer, FLASH_PAGE_SIZE);
+	t = time_us_32 ();
+	flash_range_erase (STORE_OFFSET + sect * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
+	t = time_us_32 () - t;
 	restore_interrupts (ints);
+	if (locked)
+		multicore_lockout_end_blocking ();
+
+	irq_off_account (t);
+	e_stats.erases++;
 }
 
- 
-void print_buf(const uint8_t *buf, size_t len)
+
+// Program the records in page[], everything else in it is left erased.
+// Programming 0xFF over a record already in flash does not change it.
+static void __not_in_flash_func(write) (uint8_t sect, uint16_t first)
 {
-	uint16_t i;
+	uint32_t ints, t;
+	bool locked;
 
+	locked = lockout_begin ();
+	ints = save_and_disable_interrupts ();
+	t = time_us_32 ();
+	flash_range_program (STORE_OFFSET + sect * FLASH_SECTOR_SIZE + (first / REC_PER_PAGE) * FLASH_PAGE_SIZE,
+		page, FLASH_PAGE_SIZE);
+	t = time_us_32 () - t;
+	restore_interrupts (ints);
+	if (locked)
+		multicore_lockout_end_blocking ();
 
-    for (i = 0; i < len; i++) {
-        printf("%02x", buf[i]);
-        if (i % 16 == 15)
-            printf("\n");
-        else
-            printf(" ");
-    }
+	irq_off_account (t);
+	e_stats.pages++;
 }
 
-void read (void)
+
+void e_stats_print (void)
+{
+	printf ("e: %lu records %lu pages %lu erases, interrupts off %lu us, longest %lu us\n",
+		e_stats.records, e_stats.pages, e_stats.erases, e_stats.irq_off_us, e_stats.irq_off_max_us);
+	e_stats.records = e_stats.pages = e_stats.erases = e_stats.irq_off_us = 0;
+}
+
+
+// Queue one record at slot n of sect, the page goes out when the next
+// record lands in another page or on put_done()
+static int16_t put_page = -1;
+
+static void put_done (uint8_t sect)
 {
-  uint8_t *p, *b;
-  int i;
+	if (put_page >= 0)
+		write (sect, put_page * REC_PER_PAGE);
+	put_page = -1;
+}
+
 
-	p = (uint8_t *) (XIP_BASE + PICO_FLASH_SIZE_BYTES - FLASH_PAGE_SIZE);
-	b = buffer;
+static void put_rec (uint8_t sect, uint16_t n, uint8_t key, uint8_t tag, uint32_t value)
+{
+	kv_rec r;
 
-	for (i = 0; i < 256; i++)
+	if (put_page != (int16_t)(n / REC_PER_PAGE))
 	{
-		*b++ = *p++;
+		put_done (sect);
+		memset (page, ERASED, sizeof(page));
+		put_page = n / REC_PER_PAGE;
 	}
+
+	r.key = key;
+	r.tag = tag;
+	r.value = value;
+	r.crc = rec_crc (&r);
+	memcpy (&page[(n % REC_PER_PAGE) * sizeof(kv_rec)], &r, sizeof(kv_rec));
+	e_stats.records++;
 }
 
 
-void e_put(uint16_t addr, uint32_t value)
+// Compaction moves the image to the next sector of the ring one flash
+// operation per step: the erase if it was not done ahead, a page of the
+// snapshot at a time, the header last. The dirty keys are cleared when it
+// starts, anything e_put() in the meantime is appended after it.
+#define SNAP_RECS	(E_SIZE / 4)
+#define SNAP_PAGES	((SNAP_RECS + REC_PER_PAGE) / REC_PER_PAGE)
+
+static int8_t snap_page = -1;		// next snapshot page to write, -1 not compacting
+
+static void compact_begin (void)
+{
+	snap_page = 0;
+	memset (dirty, 0, sizeof(dirty));
+}
+
+
+static void compact_step (void)
+{
+	uint8_t next = (sector + 1) % STORE_SECTORS;
+	uint16_t n;
+	uint32_t v;
+
+	if (!next_erased)
+	{
+		erase (next);
+		next_erased = true;
+		return;
+	}
+
+	if (snap_page < (int8_t)SNAP_PAGES)
+	{
+		// record n holds key (n - 1) * 4, slot 0 is for the header
+		for (n = snap_page ? snap_page * REC_PER_PAGE : 1; n <= SNAP_RECS  &&  n < (snap_page + 1) * REC_PER_PAGE; n++)
+		{
+			memcpy (&v, &image[(n - 1) * 4], 4);
+			put_rec (next, n, (n - 1) * 4, REC_TAG, v);
+		}
+		put_done (next);
+		snap_page++;
+		return;
+	}
+
+	// the header makes the sector valid, it goes in last
+	put_rec (next, 0, 0, HDR_TAG, seq + 1);
+	put_done (next);
+
+	sector = next;
+	slot = SNAP_RECS + 1;
+	seq++;
+	next_erased = false;
+	snap_page = -1;
+}
+
+
+// Load the image from the newest sector of the ring, or from the old page
+void e_init (void)
 {
-//	uint32_t itrps;
-   
-	read ();
-	uint8_t p = addr;
-		
-	if (addr < (USE_PAGE * FLASH_PAGE_SIZE))
+	const kv_rec *r;
+	uint8_t s;
+	bool found = false;
+	uint16_t n;
+
+	if (loaded)
+		return;
+	loaded = true;
+
+	for (s = 0; s < STORE_SECTORS; s++)
+	{
+		r = rec_at (s, 0);
+		if (rec_valid (r, HDR_TAG)  &&  (!found  ||  (int32_t)(r->value - seq) > 0))
+		{
+			found = true;
+			sector = s;
+			seq = r->value;
+		}
+	}
+
+	if (!found)
 	{
-//		printf ("saving 0x%X at 0x%X\n", value, addr);
-
-		buffer [p++] = value & 0xFF;
-		buffer [p++] = (value >> 8)  & 0xFF;
-		buffer [p++] = (value >> 16) & 0xFF;
-		buffer [p] = (value >> 24) & 0xFF;
-
-//		printf ("buffer : 0x%.2X 0x%.2X 0x%.2X 0x%.2X\n", buffer[addr], buffer[addr + 1], buffer[addr + 2], buffer[addr + 3]);
-
-		erase ();
-		sleep_ms (100);
-		write ();
-		read();
-//		print_buf(buffer, FLASH_PAGE_SIZE);
-		
-		e_get (addr);
-		
+		// first boot with the log, take over the old eeprom page
+		memcpy (image, (const uint8_t *)(XIP_BASE + LEGACY_OFFSET), E_SIZE);
+		sector = STORE_SECTORS - 1;
+		seq = 0;
+		compact_begin ();
+		while (snap_page >= 0)
+			compact_step ();
+		return;
 	}
+
+	for (n = 1; n < REC_PER_SECTOR; n++)
+	{
+		r = rec_at (sector, n);
+		if (rec_erased (r))
+			break;
+		if (rec_valid (r, REC_TAG))
+			image_put (r->key, r->value);
+	}
+
+	slot = n;
+
+	// an erase done ahead of time before the last reset is still good
+	next_erased = true;
+	for (n = 0; n < REC_PER_SECTOR  &&  next_erased; n++)
+		next_erased = rec_erased (rec_at ((sector + 1) % STORE_SECTORS, n));
+}
+
+
+static uint16_t dirty_count (void)
+{
+	uint16_t k, count = 0;
+
+	for (k = 0; k < E_SIZE; k++)
+		if (dirty[k / 32] & (1u << (k % 32)))
+			count++;
+
+	return count;
+}
+
+
+// Append the dirty keys that fit in the page of the next free slot
+static void append_page (void)
+{
+	uint16_t k, end = (slot / REC_PER_PAGE + 1) * REC_PER_PAGE;
+
+	for (k = 0; k < E_SIZE  &&  slot < end; k++)
+	{
+		if (dirty[k / 32] & (1u << (k % 32)))
+		{
+			dirty[k / 32] &= ~(1u << (k % 32));
+			put_rec (sector, slot++, k, REC_TAG, e_get (k));
+		}
+	}
+	put_done (sector);
+}
+
+
+// One flash operation towards getting the dirty keys into the log, false
+// when there was nothing left to do
+static bool flush_step (void)
+{
+	uint16_t count;
+
+	if (snap_page < 0)
+	{
+		count = dirty_count ();
+		if (count == 0)
+			return false;
+
+		if (slot + count <= REC_PER_SECTOR)
+		{
+			append_page ();
+			return true;
+		}
+
+		compact_begin ();
+	}
+
+	compact_step ();
+	return true;
+}
+
+
+// Write everything out now, for leaving the setup menu
+void e_flush (void)
+{
+	if (!loaded)
+		e_init ();
+
+	while (flush_step ())
+		;
+}
+
+
+// Called from the main loop at safe points, does one flash operation: a
+// step of a compaction under way, the erase ahead of the next sector or a
+// page of settings that have been quiet for a while
+void e_idle (void)
+{
+	if (!loaded)
+		return;
+
+	if (snap_page < 0  &&  !next_erased  &&  slot > REC_PER_SECTOR * 3 / 4)
+	{
+		erase ((sector + 1) % STORE_SECTORS);
+		next_erased = true;
+		return;
+	}
+
+	if (snap_page >= 0  ||  to_ms_since_boot (get_absolute_time ()) - dirty_since >= STORE_IDLE_MS)
+		flush_step ();
+}
+
+
+void e_put(uint16_t addr, uint32_t value)
+{
+	uint8_t key = addr;
+
+	if (!loaded)
+		e_init ();
+
+	if (e_get (key) == value)
+		return;
+
+	image_put (key, value);
+	dirty[key / 32] |= 1u << (key % 32);
+	dirty_since = to_ms_since_boot (get_absolute_time ());
 }
 
 
 uint32_t e_get(uint16_t addr)
 {
 	uint32_t val;
-	
-	read ();
-//	printf ("e_get 0x%.2X : 0x%.2X 0x%.2X 0x%.2X 0x%.2X\n", addr, buffer[addr], buffer[addr + 1], buffer[addr + 2], buffer[addr + 3]);
-
-	val  = buffer[addr++];
-	val |= buffer[addr++] << 8;
-	val |= buffer[addr++] << 16;
-	val |= buffer[addr] << 24;
-	
+	uint8_t key = addr;
+
+	if (!loaded)
+		e_init ();
+
+	val  = image[key];
+	val |= image[(uint8_t)(key + 1)] << 8;
+	val |= image[(uint8_t)(key + 2)] << 16;
+	val |= (uint32_t)image[(uint8_t)(key + 3)] << 24;
+
 	return val;
 }
 
 
+// Blocks are kept as their 4 byte words, len a multiple of 4
+void e_get_block(uint16_t addr, void *data, uint16_t len)
+{
+	uint8_t *p = data;
+	uint32_t v;
+	uint16_t i;
+
+	for (i = 0; i < len; i += 4)
+	{
+		v = e_get (addr + i);
+		memcpy (p + i, &v, 4);
+	}
+}
+
+
+void e_put_block(uint16_t addr, const void *data, uint16_t len)
+{
+	const uint8_t *p = data;
+	uint32_t v;
+	uint16_t i;
+
+	for (i = 0; i < len; i += 4)
+	{
+		memcpy (&v, p + i, 4);
+		e_put (addr + i, v);
+	}
+}
+
+
+void print_buf(const uint8_t *buf, size_t len)
+{
+	uint16_t i;
+
+
+    for (i = 0; i < len; i++) {
+        printf("%02x", buf[i]);
+        if (i % 16 == 15)
+            printf("\n");
+        else
+            printf(" ");
+    }
+}
+
+
 
 //              printf("FLASH_PAGE_SIZE = %d\n", FLASH_PAGE_SIZE);             //       FLASH_PAGE_SIZE = 256
 //              printf("FLASH_SECTOR_SIZE = %d\n", FLASH_SECTOR_SIZE);           //     FLASH_SECTOR_SIZE = 4096
@@ -1,16 +1,34 @@
 #ifndef _E_STORAGE_
 #define _E_STORAGE_
 
+#include <stdint.h>
 
-void erase (void);
+#define E_SIZE	256			// bytes of the old eeprom image
 
-void read(void);
-void write(void);
+// flash traffic of the settings log
+typedef struct
+{
+	uint32_t records;
+	uint32_t pages;
+	uint32_t erases;
+	uint32_t irq_off_us;		// time with interrupts off for flash
+	uint32_t irq_off_max_us;	// longest single window, kept across prints
+} e_counters;
+
+extern e_counters e_stats;
+
+void e_init(void);
+void e_flush(void);
+void e_idle(void);
+void e_stats_print(void);
+uint16_t crc16(const uint8_t *p, uint16_t n);
 
 uint32_t e_get(uint16_t addr);
 void e_put(uint16_t addr, uint32_t val);
+void e_get_block(uint16_t addr, void *data, uint16_t len);
+void e_put_block(uint16_t addr, const void *data, uint16_t len);
 //    EEPROM[]
 
 
 
-#endif // _E_STORAGE_
\ No newline at end of file
+#endif // _E_STORAGE_
@@ -16,6 +16,7 @@ bool repeating_timer_callback(struct repeating_timer *t);
 static int8_t enc_count = 0;
 bool accel_vfo;  
 uint32_t time_tick;
+uint32_t enc_last = 0;			// time_tick of the last encoder edge
 static uint16_t speed_cnt = 0;
 static int16_t speed = 0;
 static int8_t prev_enc;
@@ -47,6 +48,8 @@ void gpio_callback(uint gpio, uint32_t events)
 
 	if ((gpio == ENC_A || gpio == ENC_B)  &&  (events & 0x4) == 0x4)
 	{
+		enc_last = time_tick;
+
 		//these transitions point to the enccoder being rotated anti-clockwise
 		if ((prev_enc == 0 && cur_enc == 2) || 
 			(prev_enc == 2 && cur_enc == 3) || 
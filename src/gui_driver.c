@@ -5,17 +5,53 @@
 #include <string.h>
 #include <pico/stdlib.h>
 #include <hardware/spi.h>
+#include <hardware/dma.h>
 #include "pbitx.h"
 #include "e_storage.h"
 #include "ili9341.h"
 #include "gui_driver.h"
 
-#define MAX_VBUFF 16
+#define LINE_BUFF_SZ	(2 * D_WIDTH)	// one full display line in RGB565
 
 struct Point ts_point;
 
-void utftCmd(uint8_t cmd);
-void utftData(uint8_t d);
+// DMA transfer engine feeding SPI_PORT, a transfer in flight keeps TFT_CS low
+// until lcd_wait() is called. Pixel rows are rendered into two line buffers
+// so the next row can be built while the previous one is still on the wire.
+static int lcd_dma;
+static volatile bool lcd_busy = false;
+static bool lcd_selected = false;
+static uint16_t dma_color;
+static uint8_t line_buff[2][LINE_BUFF_SZ];
+static uint8_t line_sel = 0;
+
+// Command list, entries are stored as cmd, count, data[count]
+#define LCD_LIST_SZ		64
+#define LCD_MAX_ARGS	16
+
+lcd_counters lcd_stats;
+
+static uint8_t lcd_list[LCD_LIST_SZ];
+static uint8_t lcd_list_len = 0;
+static uint8_t lcd_arg_pos;
+
+// Glyph cache, fixed slots big enough for the 24x32 ubuntu fonts. Bigger
+// glyphs are expanded from flash every time.
+#define GLYPH_SLOT_SZ	(24 * 32 * 2)
+#define GLYPH_SLOTS		(GLYPH_CACHE_BYTES / GLYPH_SLOT_SZ)
+
+typedef struct {
+	uint32_t used;		// LRU stamp, 0 is a free slot
+	uint16_t color, bg;
+	uint8_t font, c;
+} glyph_entry;
+
+static glyph_entry glyph_tab[GLYPH_SLOTS];
+static uint8_t glyph_pool[GLYPH_SLOTS][GLYPH_SLOT_SZ];
+static uint32_t glyph_clock = 0;
+uint32_t glyph_hits = 0;
+uint32_t glyph_misses = 0;
+
 void test_font (void);
 const uint8_t *get_font (uint8_t select);
 void setrotation(uint8_t *m);
@@ -23,29 +59,229 @@ void setrotation(uint8_t *m);
 
 
 
+// Number of data bits per SPI frame, 8 for commands and glyphs, 16 for colour fills
+static void lcd_set_bits (uint8_t bits)
+{
+	hw_write_masked(&spi_get_hw(SPI_PORT)->cr0, (bits - 1) << SPI_SSPCR0_DSS_LSB, SPI_SSPCR0_DSS_BITS);
+}
+
+
+// Wait for the running transfer but keep TFT_CS asserted, used between the
+// rows of one address window
+static void lcd_sync (void)
+{
+	uint32_t t;
+
+	if (!lcd_busy)
+		return;
+
+	t = time_us_32 ();
+	dma_channel_wait_for_finish_blocking (lcd_dma);
+	while (spi_is_busy (SPI_PORT))
+		tight_loop_contents ();
+	lcd_stats.wait_us += time_us_32 () - t;
+
+	// DMA only feeds TX, throw away what has been clocked in and clear the overrun
+	while (spi_is_readable (SPI_PORT))
+		(void)spi_get_hw(SPI_PORT)->dr;
+	spi_get_hw(SPI_PORT)->icr = SPI_SSPICR_RORIC_BITS;
+
+	lcd_set_bits (8);
+	lcd_busy = false;
+}
+
+
+// Assert TFT_CS unless the bus is already ours
+static void lcd_select (void)
+{
+	if (!lcd_selected)
+	{
+		gpio_put(TOUCH_CS, HIGH);
+		gpio_put(TFT_CS, LOW);
+		lcd_selected = true;
+		lcd_stats.cs_toggles++;
+	}
+}
+
+
+// Fixed delay the controller asks for, counted in the statistics
+static void lcd_delay_ms (uint32_t ms)
+{
+	lcd_wait ();
+	sleep_ms (ms);
+	lcd_stats.sleep_us += ms * 1000;
+}
+
+
+// Print and clear the transfer counters
+void lcd_stats_print (void)
+{
+	printf ("lcd: %lu bytes %lu transactions %lu cs %lu us waiting %lu us sleeping %lu us sweep\n",
+		lcd_stats.bytes, lcd_stats.transactions, lcd_stats.cs_toggles, lcd_stats.wait_us, lcd_stats.sleep_us, lcd_stats.sweep_us);
+	memset (&lcd_stats, 0, sizeof(lcd_stats));
+}
+
+
+// Completion fence, blocks until the running transfer is done and releases the bus
+void lcd_wait (void)
+{
+	lcd_sync ();
+
+	if (lcd_selected)
+	{
+		gpio_put(TFT_CS, HIGH);
+		lcd_selected = false;
+	}
+}
+
+
+// Send count pixels of one colour, the DMA reads the same word over and over.
+// Continues the RAMWR opened by utftAddress() without releasing TFT_CS.
+static void lcd_dma_fill (uint16_t color, uint32_t count)
+{
+	dma_channel_config c;
+
+	lcd_sync ();
+	dma_color = color;
+
+	c = dma_channel_get_default_config (lcd_dma);
+	channel_config_set_transfer_data_size (&c, DMA_SIZE_16);
+	channel_config_set_dreq (&c, spi_get_dreq (SPI_PORT, true));
+	channel_config_set_read_increment (&c, false);
+	channel_config_set_write_increment (&c, false);
+
+	lcd_set_bits (16);
+	gpio_put(TFT_RS, HIGH);
+	lcd_select ();
+	lcd_busy = true;
+	lcd_stats.bytes += count * 2;
+	lcd_stats.transactions++;
+	dma_channel_configure (lcd_dma, &c, &spi_get_hw(SPI_PORT)->dr, &dma_color, count, true);
+}
+
+
+// Send len bytes from buf, buf must not be touched until lcd_wait() has returned.
+// Consecutive calls continue the same RAMWR burst without toggling TFT_CS.
+static void lcd_dma_write (const uint8_t *buf, uint32_t len)
+{
+	dma_channel_config c;
+
+	lcd_sync ();
+
+	c = dma_channel_get_default_config (lcd_dma);
+	channel_config_set_transfer_data_size (&c, DMA_SIZE_8);
+	channel_config_set_dreq (&c, spi_get_dreq (SPI_PORT, true));
+	channel_config_set_read_increment (&c, true);
+	channel_config_set_write_increment (&c, false);
+
+	gpio_put(TFT_RS, HIGH);
+	lcd_select ();
+	lcd_busy = true;
+	lcd_stats.bytes += len;
+	lcd_stats.transactions++;
+	dma_channel_configure (lcd_dma, &c, &spi_get_hw(SPI_PORT)->dr, buf, len, true);
+}
+
+
+// Next free line buffer, the one handed to the DMA before it may still be in use
+static uint8_t *lcd_line_buff (void)
+{
+	line_sel ^= 1;
+	return line_buff[line_sel];
+}
+
+
+// Start a new command list
+void lcd_begin (void)
+{
+	lcd_list_len = 0;
+}
+
+
+// Add a command to the list, a list that can't take one more full command is sent first
+void lcd_cmd (uint8_t cmd)
+{
+	if (lcd_list_len > LCD_LIST_SZ - (LCD_MAX_ARGS + 2))
+	{
+		lcd_submit ();
+		lcd_begin ();
+	}
+
+	lcd_list[lcd_list_len++] = cmd;
+	lcd_arg_pos = lcd_list_len;
+	lcd_list[lcd_list_len++] = 0;
+}
+
+
+// Add n parameter bytes to the last command, at most LCD_MAX_ARGS per command
+void lcd_data_n (const uint8_t *d, uint8_t n)
+{
+	if (lcd_list[lcd_arg_pos] + n > LCD_MAX_ARGS)
+		n = LCD_MAX_ARGS - lcd_list[lcd_arg_pos];
+
+	memcpy (lcd_list + lcd_list_len, d, n);
+	lcd_list[lcd_arg_pos] += n;
+	lcd_list_len += n;
+}
+
+
+// Send the list with TFT_CS held low, only TFT_RS changes between command and
+// parameters. The bus is left selected so pixel data can follow a RAMWR.
+void lcd_submit (void)
+{
+	uint8_t i, n;
+
+	lcd_wait ();
+	lcd_select ();
+	lcd_stats.transactions++;
+
+	for (i = 0; i < lcd_list_len; i += n + 2)
+	{
+		n = lcd_list[i + 1];
+
+		gpio_put(TFT_RS, LOW);
+		spi_write_blocking (SPI_PORT, lcd_list + i, (size_t)1);
+		gpio_put(TFT_RS, HIGH);
+
+		if (n)
+			spi_write_blocking (SPI_PORT, lcd_list + i + 2, (size_t)n);
+		lcd_stats.bytes += n + 1;
+	}
+	lcd_list_len = 0;
+}
+
+
+// Add column/page address and RAMWR to the list
+static void lcd_window (uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+	uint8_t col[4] = {x1 >> 8, x1, x2 >> 8, x2};
+	uint8_t page[4] = {y1 >> 8, y1, y2 >> 8, y2};
+
+	lcd_cmd (ILI9341_CASET); // 0x2A Column Address Set
+	lcd_data_n (col, 4);
+	lcd_cmd (ILI9341_PASET); // 0x2B Page Address Set
+	lcd_data_n (page, 4);
+	lcd_cmd (ILI9341_RAMWR); // 0x2C Memory Write
+}
+
+
 void utftAddress(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
 {
-	utftCmd(ILI9341_CASET); // 0x2A Column Address Set
-	utftData(x1 >> 8);
-	utftData(x1);
-	utftData(x2 >> 8);
-	utftData(x2);
-	utftCmd(ILI9341_PASET); // 0x2B Page Address Set
-	utftData(y1 >> 8);
-	utftData(y1);
-	utftData(y2 >> 8);
-	utftData(y2);
-	utftCmd(ILI9341_RAMWR); // 0x2C Memory Write               
+	lcd_begin ();
+	lcd_window (x1, y1, x2, y2);
+	lcd_submit ();
 }
 
 
 
 void displayPixel(uint16_t x, uint16_t y, uint16_t c)
 {  
-	utftCmd(ILI9341_RAMWR); // 0x2C Memory Write
-	utftAddress(x,y,x,y);
-	utftData(c>>8);
-	utftData(c);
+	uint8_t px[2] = {c >> 8, c};
+
+	lcd_begin ();
+	lcd_window (x, y, x, y);
+	lcd_data_n (px, 2);
+	lcd_submit ();
 }
 
 
@@ -53,42 +289,13 @@ void displayPixel(uint16_t x, uint16_t y, uint16_t c)
 void quickFill(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t color)
 {
 	uint32_t  ncount;
-	int k;
-
-
-	uint8_t vbuff[MAX_VBUFF];
-
 
 	ncount = (uint32_t)(x2 - x1+1) * (y2-y1+1);
 	//set the window
-
-	utftCmd(0x02c); //write_memory_start  
 	utftAddress(x1,y1,x2,y2);
-	gpio_put(TFT_CS, 0);
-	gpio_put(TFT_RS, 1);
-  
-	while(ncount)
-	{
-		k = 0;
-		for (int i = 0; i < MAX_VBUFF/2; i++)
-		{
-			vbuff[k++] = color >> 8;
-			vbuff[k++] = color & 0xff;
-		}
 
-		if (ncount > MAX_VBUFF/2)
-		{
-			spi_write_blocking (SPI_PORT, vbuff, MAX_VBUFF);
-			ncount -= MAX_VBUFF/2;
-		}  
-		else
-		{
-			spi_write_blocking (SPI_PORT, vbuff, (int)ncount * 2);
-			ncount = 0;      
-		}
-//		checkCAT();
-	}
-	gpio_put(TFT_CS, 1);
+	// returns as soon as the DMA is started, next access to the display waits for it
+	lcd_dma_fill (color, ncount);
 }
 
 
@@ -124,8 +331,30 @@ void displayFillrect(uint16_t x, uint16_t y,uint16_t  w,uint16_t  h,uint16_t  c)
 
 
 
+// ILI9341 setup, stored as cmd, count, parameters
+static const uint8_t init_cmds[] =
+{
+	0xCB, 5, 0x39, 0x2C, 0x00, 0x34, 0x02,	// Power control A
+	0xCF, 3, 0x00, 0xC1, 0x30,				// Power control B
+	0xE8, 3, 0x85, 0x00, 0x78,				// Driver timing control A
+	0xEA, 2, 0x00, 0x00,					// Driver timing control B
+	0xED, 4, 0x64, 0x03, 0x12, 0x81,		// Power on sequence control
+	0xF7, 1, 0x20,							// Pump ratio control
+	ILI9341_PWCTR1, 1, 0x23,				// Power control, VRH[5:0]
+	ILI9341_PWCTR2, 1, 0x10,				// Power control, SAP[2:0];BT[3:0]
+	ILI9341_VMCTR1, 2, 0x3e, 0x28,			// VCM control, contrast
+	ILI9341_VMCTR2, 1, 0x86,				// VCM control2
+	ILI9341_MADCTL, 1, 0x28,				// Memory Access Control, make this horizontal display
+	ILI9341_PIXFMT, 1, 0x55,				// 16 bits per pixel
+	ILI9341_FRMCTR1, 2, 0x00, 0x18,
+	ILI9341_DFUNCTR, 3, 0x08, 0x82, 0x27,	// Display Function Control
+};
+
+
 void displayInit(void)
 {
+	uint8_t i;
+
 	spi_init(SPI_PORT, TFT_BAUD);
 	spi_set_format (SPI_PORT, 8, SPI_POL, SPI_PHA, SPI_MSB_FIRST);
 //	hw_write_masked(&spi_get_hw(spi_default)->cr0, (1 - 1) << SPI_SSPCR0_SCR_LSB, SPI_SSPCR0_SCR_uint8_tS);	
@@ -134,6 +363,8 @@ void displayInit(void)
 	gpio_set_function(SPI_SCK, GPIO_FUNC_SPI);
 	gpio_set_function(SPI_TX, GPIO_FUNC_SPI);
 	gpio_set_function(SPI_RX, GPIO_FUNC_SPI);
+
+	lcd_dma = dma_claim_unused_channel (true);
 	gpio_set_function(TFT_CS,   GPIO_FUNC_SIO); 
 	gpio_init(TFT_CS);
 	gpio_put(TFT_CS, 1);
@@ -143,76 +374,35 @@ void displayInit(void)
 	gpio_put(TFT_RS, 1);
 	gpio_set_dir(TFT_RS, GPIO_OUT);
 	
-	gpio_put(TFT_CS, 0);
-	utftCmd(0x01);
-	sleep_ms (200);
-
-	utftCmd(0xCB);  
-	utftData(0x39); 
-	utftData(0x2C); 
-	utftData(0x00); 
-	utftData(0x34); 
-	utftData(0x02); 
-	
-	utftCmd(0xCF);  
-	utftData(0x00); 
-	utftData(0XC1); 
-	utftData(0X30); 
-	
-	utftCmd(0xE8);  
-	utftData(0x85); 
-	utftData(0x00); 
-	utftData(0x78); 
-	
-	utftCmd(0xEA);  
-	utftData(0x00); 
-	utftData(0x00); 
-	
-	utftCmd(0xED);  
-	utftData(0x64); 
-	utftData(0x03); 
-	utftData(0X12); 
-	utftData(0X81); 
-	
-	utftCmd(0xF7);  
-	utftData(0x20); 
-	
-	utftCmd(0xC0);    //Power control 
-	utftData(0x23);   //VRH[5:0] 
-	
-	utftCmd(0xC1);    //Power control 
-	utftData(0x10);   //SAP[2:0];BT[3:0] 
-	
-	utftCmd(0xC5);    //VCM control 
-	utftData(0x3e);   //Contrast
-	utftData(0x28); 
-	
-	utftCmd(0xC7);    //VCM control2 
-	utftData(0x86);   //--
-	
-	sleep_ms(100);	// need to be stable before rotate command
-	utftCmd(0x36);    // Memory Access Control 
-	utftData(0x28);   // Make this horizontal display   
-	
-	utftCmd(0x3A);    
-	utftData(0x55); 
-	
-	utftCmd(0xB1);    
-	utftData(0x00);  
-	utftData(0x18); 
-	
-	utftCmd(0xB6);    // Display Function Control 
-	utftData(0x08); 
-	utftData(0x82);
-	utftData(0x27);  
-	
-	utftCmd(0x11);    //Exit Sleep 
-	sleep_ms(120); 
+	// reset, the controller takes commands again after 5 ms but SLPOUT has
+	// to wait 120 ms
+	lcd_begin ();
+	lcd_cmd (ILI9341_SWRESET);
+	lcd_submit ();
+	lcd_delay_ms (120);
+
+	lcd_begin ();
+	for (i = 0; i < sizeof(init_cmds); i += init_cmds[i + 1] + 2)
+	{
+		// the power settings need to be stable before the rotate command
+		if (init_cmds[i] == ILI9341_MADCTL)
+		{
+			lcd_submit ();
+			lcd_delay_ms (100);
+			lcd_begin ();
+		}
+
+		lcd_cmd (init_cmds[i]);
+		lcd_data_n (init_cmds + i + 2, init_cmds[i + 1]);
+	}
+	lcd_cmd (ILI9341_SLPOUT);    //Exit Sleep 
+	lcd_submit ();
+	lcd_delay_ms (120);		// sleep out needs 120 ms before the display is switched on
 		
-	utftCmd(0x29);    //Display on 
-	utftCmd(0x2c); 
-	
-	gpio_put(TFT_CS, HIGH);
+	lcd_begin ();
+	lcd_cmd (ILI9341_DISPON);    //Display on 
+	lcd_submit ();
+	lcd_wait ();
   
 	xpt2046_Init();
   
@@ -220,27 +410,6 @@ void displayInit(void)
 }
 
 
-void utftCmd(uint8_t cmd)
-{   
-	gpio_put(TOUCH_CS, HIGH);
-	gpio_put (TFT_CS, LOW);
-	gpio_put (TFT_RS, LOW);
-	spi_write_blocking (SPI_PORT, &cmd, (size_t)1);
-	gpio_put (TFT_RS, HIGH);
-	gpio_put (TFT_CS, HIGH);
-	sleep_us (5);
-}
-
-void utftData(uint8_t d)
-{
-	gpio_put (TFT_RS, HIGH);
-	gpio_put(TFT_CS, LOW);
-	spi_write_blocking (SPI_PORT, &d, (size_t)1);
-	gpio_put (TFT_CS, HIGH);
-	sleep_us (5);
-}
-
-
 uint16_t rgb2num(uint8_t r, uint8_t g, uint8_t b)
 {
     return (((r >> 3) & 0x1f) << 11) | (((g >> 2) & 0x3f) << 5) | ((b >> 3) & 0x1f);
@@ -299,22 +468,23 @@ const uint8_t *get_font (uint8_t select)
 }
 
 
-void displayChar(int16_t x, int16_t y, uint8_t c, uint16_t color, uint16_t bg, uint8_t use_font)
+// Copy a w x h block of big endian RGB565 pixels to x, y. The pixels are sent
+// by DMA, call lcd_wait() before touching them again.
+void displayBitmap(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint8_t *pixels)
 {
- 
+	utftAddress(x, y, x + w - 1, y + h - 1);
+	lcd_dma_write (pixels, (uint32_t)w * h * 2);
+}
+
+
+// Offset of the first bitmap byte of glyph c in font
+static uint16_t glyph_base (const uint8_t *font, uint8_t c, uint8_t use_font)
+{
+	uint8_t w, h;
 	uint16_t base;
-	uint16_t k;
-	uint8_t uint8_ts, uint8_t_cnt;
-	uint8_t vbuff[64];
-	uint8_t dx, dy;
-	int8_t w, h;
-	const uint8_t *font;
-		
-	font = get_font (use_font);
 
 	w = *font;
 	h = *(font + 1);
-	uint8_t_cnt = 0;
 
 	base = 4 + (c * (uint8_t)((w * h)/8));
 
@@ -324,47 +494,105 @@ void displayChar(int16_t x, int16_t y, uint8_t c, uint16_t color, uint16_t bg, u
 			base = 4 + (c - 0x20) * (uint8_t)((w * h)/8);
 	}
 
-	
-	for(dy=0; dy < h; dy++) 
+	return base;
+}
+
+
+// Expand the first cols pixels of glyph row dy into RGB565 at buf, returns the byte count
+static uint16_t glyph_row (const uint8_t *font, uint16_t base, uint8_t dy, uint8_t cols, uint16_t color, uint16_t bg, uint8_t *buf)
+{
+	uint8_t w;
+	uint8_t bits = 0;
+	uint8_t dx;
+	uint16_t k;
+	const uint8_t *p;
+
+	w = *font;
+	p = font + base + dy * (w / 8);
+	k = 0;
+
+	for (dx = 0; dx < cols; dx++)
 	{
-		k = 0;
-		for(dx = 0; dx < w; dx++) 
+		if (!(dx & 7))
+			bits = *p++;
+
+		if (bits & 0x80)
 		{
-			if(!(uint8_t_cnt++ & 7))  // if (uint8_ts++ == 8)
-			{
-				uint8_ts = *(font + base++);
-			}
-			if(uint8_ts & 0x80) 
-			{
-				vbuff[k++] = color >> 8;
-				vbuff[k++] = color & 0xff;
-			}
-			else 
-			{
-				vbuff[k++] = bg >> 8;
-				vbuff[k++] = bg & 0xff;
-			}
-			uint8_ts <<= 1;
+			buf[k++] = color >> 8;
+			buf[k++] = color & 0xff;
 		}
-		
-		utftAddress(x, y, x + w, y + 1);
+		else
+		{
+			buf[k++] = bg >> 8;
+			buf[k++] = bg & 0xff;
+		}
+		bits <<= 1;
+	}
 
-		gpio_put(TFT_RS, HIGH);
-		gpio_put(TFT_CS, LOW);
+	return k;
+}
 
-		spi_write_blocking (SPI_PORT, vbuff, k);
-		
-		y++;
+
+// RGB565 bitmap of glyph c from the cache, rendered on a miss. Entries used
+// after keep are not evicted, so a text run can hold all of its glyphs.
+// Returns NULL when the glyph is too big or every slot is taken.
+static const uint8_t *glyph_cached (const uint8_t *font, uint8_t c, uint16_t color, uint16_t bg, uint8_t use_font, uint32_t keep)
+{
+	uint8_t w, h, dy;
+	uint16_t i, victim, base;
+	uint8_t *img;
+
+	w = *font;
+	h = *(font + 1);
+
+	if (GLYPH_SLOTS == 0  ||  w * h * 2 > GLYPH_SLOT_SZ)
+		return NULL;
+
+	victim = 0;
+	for (i = 0; i < GLYPH_SLOTS; i++)
+	{
+		if (glyph_tab[i].used  &&  glyph_tab[i].c == c  &&  glyph_tab[i].font == use_font  &&
+			glyph_tab[i].color == color  &&  glyph_tab[i].bg == bg)
+		{
+			glyph_tab[i].used = ++glyph_clock;
+			glyph_hits++;
+			return glyph_pool[i];
+		}
+
+		if (glyph_tab[i].used < glyph_tab[victim].used)
+			victim = i;
 	}
-		
-	gpio_put(TFT_CS, HIGH);
-//	checkCAT();
+
+	glyph_misses++;
+
+	if (glyph_tab[victim].used > keep)
+		return NULL;
+
+	// the slot may still be feeding the DMA
+	lcd_sync ();
+
+	img = glyph_pool[victim];
+	base = glyph_base (font, c, use_font);
+	for (dy = 0; dy < h; dy++)
+		glyph_row (font, base, dy, w, color, bg, img + dy * w * 2);
+
+	glyph_tab[victim].used = ++glyph_clock;
+	glyph_tab[victim].c = c;
+	glyph_tab[victim].font = use_font;
+	glyph_tab[victim].color = color;
+	glyph_tab[victim].bg = bg;
+
+	return img;
 }
 
 
-void displayRawText(char *text, uint16_t x1, uint16_t y1, uint16_t color, uint16_t background, uint8_t use_font)
+void displayChar(int16_t x, int16_t y, uint8_t c, uint16_t color, uint16_t bg, uint8_t use_font)
 {
-	uint16_t w, h;
+	uint16_t base, k;
+	uint8_t *vbuff;
+	const uint8_t *img;
+	uint8_t dy;
+	uint8_t w, h;
 	const uint8_t *font;
 		
 	font = get_font (use_font);
@@ -372,74 +600,119 @@ void displayRawText(char *text, uint16_t x1, uint16_t y1, uint16_t color, uint16
 	w = *font;
 	h = *(font + 1);
 
-	
-	while(*text)
+	// one window for the whole glyph, rows are streamed in a single burst
+	img = glyph_cached (font, c, color, bg, use_font, glyph_clock);
+	utftAddress(x, y, x + w - 1, y + h - 1);
+
+	if (img)
 	{
+		lcd_dma_write (img, w * h * 2);
+		return;
+	}
 
-    uint8_t c = *text++;
-    
-    	if ((c >= 0x20  &&  c < 0x7F)  ||  (use_font == S_METER)) 
-		{
-  
-			if((w > 0) && (h > 0))
-			{ // Is there an associated uint8_tmap?
-				displayChar(x1, y1+TEXT_LINE_HEIGHT, c, color, background, use_font);
-//				checkCAT();
-			}
-			x1 += w; 
-		}
-   }
+	base = glyph_base (font, c, use_font);
+	for (dy = 0; dy < h; dy++) 
+	{
+		// build this row while the previous one is still being sent
+		vbuff = lcd_line_buff ();
+		k = glyph_row (font, base, dy, w, color, bg, vbuff);
+		lcd_dma_write (vbuff, k);
+	}
+//	checkCAT();
 }
 
-// The generic routine to display one line on the LCD 
-// void displayText(uint8_t *text, int x, int y, int color, int background, int border, uint8_t font) 
-//void displayText(uint8_t *text, uint16_t x, uint16_t y, uint16_t color, uint16_t background, uint16_t border, uint8_t font) 
-void displayText(uint8_t *text, uint16_t x, uint16_t y, uint16_t color, uint16_t background, uint8_t font) 
+
+// Render a run of characters with one address window. Each pixel row of the
+// whole string is built in a line buffer and sent as one transfer. With
+// narrow set '.' and ':' only advance 7 pixels (12 in LU_NORMAL), the way
+// displayText has always placed them.
+static void displayRun(uint8_t *text, uint16_t x, uint16_t y, uint16_t color, uint16_t bg, uint8_t use_font, bool narrow)
 {
-	const uint8_t *f;
-	uint16_t w, h;
-	uint8_t c; //, len;
-//	uint16_t x0, y0, x1, y1, dx, dy;
+	const uint8_t *font;
+	uint16_t base[D_WIDTH / 8];
+	const uint8_t *img[D_WIDTH / 8];
+	uint8_t cols[D_WIDTH / 8];
+	uint32_t keep;
+	uint8_t w, h, n, i, dy;
+	uint16_t width, k;
+	uint8_t *vbuff;
 
-	f = get_font (font);
+	font = get_font (use_font);
+	w = *font;
+	h = *(font + 1);
 
-	w = *f;
-	h = *(f + 1);
-//	len = strlen (text) * w;
-	
-// 	dx = w / 8;
-//	dy = h / 8;
-//	x0 = (x > dx) ? x - dx : x;
-//	y0 = (y > dy) ? y - dy : y;
-	
-//	x1 = ((x + len + dx) < D_WIDTH) ? x + len + dx : x;
-//	y1 = ((y + dy) < D_HEIGHT) ? h + dy : 0;
-	
-//	x1 += w / 4;
-//	y1 += h / 4;
+	if (w == 0  ||  h == 0  ||  x >= D_WIDTH)
+		return;
 
-	while(*text != '\0')
+	// work out the pixel columns every glyph contributes, clipped at the right edge
+	width = 0;
+	keep = glyph_clock;
+	for (n = 0; text[n] != '\0'  &&  n < D_WIDTH / 8  &&  x + width < D_WIDTH; n++)
 	{
-		c = *text++;
-    
-        if((w > 0) && (h > 0)) 
-		{ 
-            displayChar(x, y, c, color, background, font);
- //           checkCAT();
-        }
-        if (c == '.'  ||  c == ':')
+		base[n] = glyph_base (font, text[n], use_font);
+		img[n] = glyph_cached (font, text[n], color, bg, use_font, keep);
+
+		if (narrow  &&  (text[n] == '.'  ||  text[n] == ':')  &&  text[n + 1] != '\0')
+			cols[n] = (use_font == LU_NORMAL) ? 12 : 7;
+		else
+			cols[n] = w;
+
+		if (x + width + cols[n] > D_WIDTH)
+			cols[n] = D_WIDTH - x - width;
+
+		width += cols[n];
+	}
+
+	if (n == 0)
+		return;
+
+	utftAddress(x, y, x + width - 1, y + h - 1);
+
+	for (dy = 0; dy < h; dy++)
+	{
+		vbuff = lcd_line_buff ();
+		k = 0;
+		for (i = 0; i < n; i++)
 		{
-			if (font == LU_NORMAL)
-				x += 12;
+			if (img[i])
+			{
+				memcpy (vbuff + k, img[i] + dy * w * 2, cols[i] * 2);
+				k += cols[i] * 2;
+			}
 			else
-				x += 7;
+				k += glyph_row (font, base[i], dy, cols[i], color, bg, vbuff + k);
 		}
-		else
-			x += w;    
+
+		lcd_dma_write (vbuff, k);
 	}
 }
 
 
+void displayRawText(char *text, uint16_t x1, uint16_t y1, uint16_t color, uint16_t background, uint8_t use_font)
+{
+	uint8_t run[D_WIDTH / 8 + 1];
+	uint8_t n = 0;
+
+	// characters without a glyph are skipped, they take no room either
+	while (*text  &&  n < D_WIDTH / 8)
+	{
+		uint8_t c = *text++;
+    
+		if ((c >= 0x20  &&  c < 0x7F)  ||  (use_font == S_METER)) 
+			run[n++] = c;
+	}
+	run[n] = '\0';
+
+	displayRun(run, x1, y1 + TEXT_LINE_HEIGHT, color, background, use_font, false);
+}
+
+// The generic routine to display one line on the LCD 
+void displayText(uint8_t *text, uint16_t x, uint16_t y, uint16_t color, uint16_t background, uint8_t font) 
+{
+	displayRun(text, x, y, color, background, font, true);
+}
+
+
 
 // Borrowed from Adafruits ILI9341 lib
 
@@ -467,6 +740,8 @@ void setrotation(uint8_t *m)
 			*m = (MADCTL_MX | MADCTL_MY | MADCTL_MV | MADCTL_BGR);
 		break;
 	}
-	utftCmd(ILI9341_MADCTL);  
-	utftData(rot);   
+	lcd_begin ();
+	lcd_cmd (ILI9341_MADCTL);
+	lcd_data_n (&rot, 1);
+	lcd_submit ();
 }
\ No newline at end of file
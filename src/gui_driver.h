@@ -7,6 +7,11 @@
 #define D_WIDTH    320
 #define D_HEIGHT   240
 
+// RAM set aside for pre-rendered RGB565 glyphs
+#ifndef GLYPH_CACHE_BYTES
+#define GLYPH_CACHE_BYTES	(24 * 1536)
+#endif
+
 
 // Fonts: 
 // Arial fonst
@@ -52,7 +57,27 @@ extern const uint8_t SixteenSegmentBig[];
 extern const uint8_t s_meter[];
 
 
+// Display traffic since the last lcd_stats_print()
+typedef struct {
+	uint32_t bytes;			// bytes clocked out to the TFT
+	uint32_t transactions;	// command lists and DMA transfers
+	uint32_t cs_toggles;	// TFT_CS assertions
+	uint32_t wait_us;		// time blocked waiting for the DMA
+	uint32_t sleep_us;		// fixed controller delays
+	uint32_t sweep_us;		// time spent on the last panorama frame
+} lcd_counters;
+
+extern lcd_counters lcd_stats;
+extern uint32_t glyph_hits;
+extern uint32_t glyph_misses;
+
 void displayInit();
+void lcd_wait(void);
+void lcd_begin(void);
+void lcd_cmd(uint8_t cmd);
+void lcd_data_n(const uint8_t *d, uint8_t n);
+void lcd_submit(void);
+void lcd_stats_print(void);
 void displayClear(uint16_t color);
 void displayPixel(uint16_t x, uint16_t y, uint16_t c);
 void displayHline(uint16_t  x, uint16_t y, uint16_t len, uint16_t  c);
@@ -63,6 +88,7 @@ void displayuint8_t(int16_t x, int16_t y, uint8_t c, uint16_t color, uint16_t bg
 int displayTextExtent(uint8_t *text);
 void displayRawText(char *text, uint16_t x1, uint16_t y1, uint16_t color, uint16_t background, uint8_t use_font);
 void displayText(uint8_t *text, uint16_t x, uint16_t y, uint16_t color, uint16_t background, uint8_t font); 
+void displayBitmap(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint8_t *pixels);
 void displayChar(int16_t x, int16_t y, uint8_t c, uint16_t color, uint16_t bg, uint8_t use_font);
 
 bool readTouch();
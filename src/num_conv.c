@@ -15,7 +15,10 @@
 
 
 // This function will return the frequency in Hz if the BCD string
-// is  terminated with the proper 0xFD
+// is  terminated with the proper 0xFD. Ten digits at most, a frame that
+// ends before offset does not run the loop off the buffer.
+
+#define BCD_BYTES	5
 
 uint32_t bcd2int (uint8_t offset, uint8_t *inque)
 {
@@ -30,7 +33,7 @@ uint32_t bcd2int (uint8_t offset, uint8_t *inque)
 	i = 0;
 
 
-	while (inque[i + offset] != 0xFD)
+	while (i < BCD_BYTES  &&  inque[i + offset] != 0xFD)
 	{
 		d = inque[i + offset];
 //		printf ("%d | ", d);
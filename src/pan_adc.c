@@ -0,0 +1,99 @@
+// Free running ADC capture for the panorama. The ADC runs at full speed into
+// its FIFO and a DMA channel moves PAN_SETTLE + PAN_SAMPLES results to RAM,
+// the CPU is free until pan_adc_result() is called.
+//
+// SM0KBW
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "pan_adc.h"
+
+#define CAPTURE_SZ	(PAN_SETTLE + PAN_SAMPLES)
+#define CAPTURE_US	(CAPTURE_SZ * PAN_SAMPLE_US)
+
+bool pan_max_hold = false;		// bin value is the highest sample instead of the average
+
+static int adc_dma;
+static uint16_t capture[CAPTURE_SZ];
+static bool running = false;
+static uint32_t started;		// no earlier than the first conversion
+
+
+void pan_adc_init (void)
+{
+	adc_dma = dma_claim_unused_channel (true);
+}
+
+
+// Start a capture on input, returns right away
+void pan_adc_start (uint8_t input)
+{
+	dma_channel_config c;
+
+	adc_select_input (input);
+
+	// FIFO with DREQ, no error bit and no byte shift, results stay 12 bits
+	adc_fifo_setup (true, true, 1, false, false);
+	adc_set_clkdiv (0);
+	adc_fifo_drain ();
+
+	c = dma_channel_get_default_config (adc_dma);
+	channel_config_set_transfer_data_size (&c, DMA_SIZE_16);
+	channel_config_set_read_increment (&c, false);
+	channel_config_set_write_increment (&c, true);
+	channel_config_set_dreq (&c, DREQ_ADC);
+	dma_channel_configure (adc_dma, &c, capture, &adc_hw->fifo, CAPTURE_SZ, true);
+
+	adc_run (true);
+	started = time_us_32 ();
+	running = true;
+}
+
+
+// Wait until the capture has no more than us to go, the next retune is timed
+// against its end
+void pan_adc_wait_left (uint16_t us)
+{
+	if (!running  ||  us >= CAPTURE_US)
+		return;
+
+	while (time_us_32 () - started < (uint32_t)(CAPTURE_US - us))
+		tight_loop_contents ();
+}
+
+
+// Wait for the capture and reduce it to one value, the rounded average of the
+// samples after the settle time or their maximum with pan_max_hold set
+uint16_t pan_adc_result (void)
+{
+	uint32_t sum = 0;
+	uint16_t max = 0;
+	uint16_t i;
+
+	if (!running)
+		return 0;
+
+	dma_channel_wait_for_finish_blocking (adc_dma);
+	adc_run (false);
+	adc_fifo_drain ();
+	// give the FIFO back, adc_read() is used by the S-meter and the keyer
+	adc_fifo_setup (false, false, 0, false, false);
+	running = false;
+
+	for (i = PAN_SETTLE; i < CAPTURE_SZ; i++)
+	{
+		sum += capture[i];
+		if (capture[i] > max)
+			max = capture[i];
+	}
+
+	if (pan_max_hold)
+		return max;
+
+	return (sum + PAN_SAMPLES / 2) / PAN_SAMPLES;
+}
@@ -0,0 +1,25 @@
+#ifndef _PAN_ADC_
+#define _PAN_ADC_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// One conversion at the full 500 ksps
+#define PAN_SAMPLE_US	2
+// Samples thrown away after a retune while the detector settles
+#ifndef PAN_SETTLE
+#define PAN_SETTLE		16
+#endif
+// Samples averaged for one bin
+#ifndef PAN_SAMPLES
+#define PAN_SAMPLES		32
+#endif
+
+extern bool pan_max_hold;
+
+void pan_adc_init (void);
+void pan_adc_start (uint8_t input);
+void pan_adc_wait_left (uint16_t us);
+uint16_t pan_adc_result (void);
+
+#endif // _PAN_ADC_
@@ -0,0 +1,173 @@
+// Panorama stream. Every sweep becomes one frame on the USB telemetry port,
+// little endian:
+//
+//   0  'P' 'X'
+//   2  version
+//   3  flags, PAN_F_DELTA
+//   4  sequence number, u16
+//   6  time of the sweep in ms, u32
+//  10  center, span and step in Hz, u32 each
+//  22  number of bins, u16
+//  24  payload length, u16
+//  26  payload
+//   .  CRC16 CCITT of byte 2 up to the end of the payload
+//
+// A key frame packs the 12 bit bins two in three bytes. A delta frame holds
+// each bin minus the same bin of the previous frame, zigzag coded in 7 bit
+// groups, most deltas fit a byte. A key frame is sent every PAN_KEY_EVERY
+// frames and after a frame had to be skipped. A frame that does not fit in
+// the USB FIFO is skipped, the radio never waits for the host.
+//
+// SM0KBW
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pbitx.h"
+#include "e_storage.h"
+#include "usb_ports.h"
+#include "pan_stream.h"
+
+#define PAN_FRAME_SZ	(PAN_HDR_SZ + 2 * PAN_SZ + 2)
+
+bool pan_stream_on = false;
+pan_stream_counters pan_stream_stats;
+
+static uint8_t frame[PAN_FRAME_SZ];
+static uint16_t prev[PAN_SZ];
+static uint16_t seq = 0;
+static uint8_t since_key = PAN_KEY_EVERY;
+
+
+static uint8_t *put16 (uint8_t *p, uint16_t v)
+{
+	*p++ = v;
+	*p++ = v >> 8;
+	return p;
+}
+
+
+static uint8_t *put32 (uint8_t *p, uint32_t v)
+{
+	p = put16 (p, v);
+	return put16 (p, v >> 16);
+}
+
+
+static uint16_t pack_key (uint8_t *p, const uint16_t *bins, uint16_t n)
+{
+	uint8_t *s = p;
+	uint16_t i;
+
+	for (i = 0; i + 1 < n; i += 2)
+	{
+		*p++ = bins[i];
+		*p++ = ((bins[i] >> 8) & 0x0F) | (bins[i + 1] << 4);
+		*p++ = bins[i + 1] >> 4;
+	}
+
+	if (i < n)
+		p = put16 (p, bins[i] & 0x0FFF);
+
+	return p - s;
+}
+
+
+// Returns the payload length, 0 if it is no smaller than a key frame
+static uint16_t pack_delta (uint8_t *p, const uint16_t *bins, uint16_t n, uint16_t limit)
+{
+	uint8_t *s = p;
+	uint16_t i, z;
+	int16_t d;
+
+	for (i = 0; i < n; i++)
+	{
+		d = (int16_t)(bins[i] & 0x0FFF) - (int16_t)prev[i];
+		z = ((uint16_t)d << 1) ^ (d >> 15);
+
+		while (z >= 0x80)
+		{
+			*p++ = (z & 0x7F) | 0x80;
+			z >>= 7;
+		}
+		*p++ = z;
+
+		if (p - s >= limit)
+			return 0;
+	}
+
+	return p - s;
+}
+
+
+void pan_stream_start (bool on)
+{
+	pan_stream_on = on;
+	since_key = PAN_KEY_EVERY;
+}
+
+
+void pan_stream_sweep (const uint16_t *bins, uint16_t n, uint32_t center, uint32_t span)
+{
+	uint8_t *p;
+	uint16_t len, key_len, i;
+	uint8_t flags = 0;
+
+	if (!pan_stream_on  ||  !usb_connected (USB_TELEMETRY)  ||  n == 0)
+		return;
+
+	if (n > PAN_SZ)
+		n = PAN_SZ;
+
+	key_len = (n / 2) * 3 + (n & 1) * 2;
+	len = 0;
+
+	if (since_key < PAN_KEY_EVERY)
+		len = pack_delta (frame + PAN_HDR_SZ, bins, n, key_len);
+
+	if (len)
+		flags |= PAN_F_DELTA;
+	else
+		len = pack_key (frame + PAN_HDR_SZ, bins, n);
+
+	if (usb_write_space (USB_TELEMETRY) < (uint32_t)PAN_HDR_SZ + len + 2)
+	{
+		pan_stream_stats.skipped++;
+		since_key = PAN_KEY_EVERY;		// the host lost the reference
+		return;
+	}
+
+	p = frame;
+	*p++ = PAN_SYNC0;
+	*p++ = PAN_SYNC1;
+	*p++ = PAN_VERSION;
+	*p++ = flags;
+	p = put16 (p, seq++);
+	p = put32 (p, to_ms_since_boot (get_absolute_time ()));
+	p = put32 (p, center);
+	p = put32 (p, span);
+	p = put32 (p, span / n);
+	p = put16 (p, n);
+	p = put16 (p, len);
+	p += len;
+	p = put16 (p, crc16 (frame + 2, p - frame - 2));
+
+	usb_write (USB_TELEMETRY, frame, p - frame);
+
+	for (i = 0; i < n; i++)
+		prev[i] = bins[i] & 0x0FFF;
+
+	if (flags & PAN_F_DELTA)
+		since_key++;
+	else
+	{
+		since_key = 1;
+		pan_stream_stats.key_frames++;
+	}
+
+	pan_stream_stats.frames++;
+	pan_stream_stats.bytes += p - frame;
+}
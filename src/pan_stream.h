@@ -0,0 +1,32 @@
+// Panorama sweeps as binary frames on the USB telemetry port
+#ifndef _PAN_STREAM_
+#define _PAN_STREAM_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PAN_SYNC0		'P'
+#define PAN_SYNC1		'X'
+#define PAN_VERSION		1
+
+#define PAN_F_DELTA		0x01		// bins are deltas to the previous frame
+#define PAN_KEY_EVERY	16			// a full frame at least this often
+
+#define PAN_HDR_SZ		26
+
+extern bool pan_stream_on;
+
+typedef struct
+{
+	uint32_t frames;
+	uint32_t key_frames;
+	uint32_t bytes;
+	uint32_t skipped;				// no room in the USB FIFO
+} pan_stream_counters;
+
+extern pan_stream_counters pan_stream_stats;
+
+void pan_stream_start (bool on);
+void pan_stream_sweep (const uint16_t *bins, uint16_t n, uint32_t center, uint32_t span);
+
+#endif // _PAN_STREAM_
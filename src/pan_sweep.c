@@ -0,0 +1,122 @@
+// Panorama sweep. CLK2 steps over PAN_SPAN around the dial frequency with the
+// receive chain parked on MID_FILTER, the detector is read for every bin.
+//
+// The sweep runs in slices, a loop tick measures bins until PAN_BUDGET_US is
+// used up or PAN_SLICE bins are done and then gives the receiver its LO back.
+// Bins are collected in the back buffer, pan_data points to the last complete
+// sweep. A sweep that was started on another dial frequency is thrown away
+// and begins again, it would be published with the wrong center.
+//
+// The receiver is off frequency for the whole slice, the budget plus the bin
+// started inside it and the retunes to park the receive chain and back, about
+// 1.2 ms on the 400 kHz I2C bus. With the 10 ms loop tick that mutes up to 29%
+// of the audio while the panorama runs. The loop leaves the sweep out while
+// transmitting and while CW is keyed or in its break-in hang.
+//
+// SM0KBW
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/stdlib.h"
+#include "pbitx.h"
+#include "pan_adc.h"
+
+#define MID_FILTER 11057500l
+//#define MID_FILTER usbCarrier
+
+#define PAN_BUDGET_US	2000
+#define PAN_SLICE		32
+
+// A retune changes the first msynth register after START, the address, the
+// register pointer and one data byte, 28 bit times or 70 us at 400 kHz. The
+// next bin's retune is put on the bus when the capture has the lead to go,
+// a tenth short of that so the bus is not fast enough to move the LO under
+// it. The settle time can not be overlapped, it starts when the STOP has
+// gone out.
+#define PAN_RETUNE_US		(28 * 1000 / SI5351_I2C_KHZ)
+#ifndef PAN_RETUNE_LEAD_US
+#define PAN_RETUNE_LEAD_US	(PAN_RETUNE_US * 9 / 10)
+#endif
+static_assert (PAN_RETUNE_LEAD_US < PAN_RETUNE_US, "PAN_RETUNE_LEAD_US retunes the LO under the capture");
+
+static uint16_t pan_buff[2][PAN_SZ];
+uint16_t *pan_data = pan_buff[0];
+static uint16_t *pan_back = pan_buff[1];
+static uint16_t pan_bin = 0;
+static Sweep_plan pan_plan;
+static uint32_t pan_data_center;	// dial frequency of the published sweep
+uint32_t pan_center;				// dial frequency of the sweep being collected
+
+uint32_t pan_sweeps = 0;		// completed sweeps
+uint32_t pan_restarts = 0;		// sweeps dropped for a new dial frequency
+
+
+// Measure the next slice of the sweep, returns true when a new sweep is published
+bool get_pan_data (void)
+{ 
+	uint16_t n, val;
+	uint16_t *p;
+	uint32_t start;
+	bool more;
+
+	start = time_us_32 ();
+
+	if (pan_bin != 0  &&  frequency != pan_center)
+	{
+		pan_bin = 0;
+		pan_restarts++;
+	}
+
+	if (pan_bin == 0)
+	{
+		pan_center = frequency;
+		si5351bx_plan(&pan_plan, firstIF + frequency - (PAN_SZ/2) * (PAN_SPAN / PAN_SZ), PAN_SPAN / PAN_SZ, PAN_SZ);
+	}
+
+	si5351bx_setfreq(1, firstIF + MID_FILTER);
+	si5351bx_setfreq(0, MID_FILTER);
+
+	// a retune that fails ends the slice, its bin is measured on the next tick
+	si5351bx_play(&pan_plan, 2, pan_bin);
+	for (n = 1; si5351bx_sync(); n++)
+	{
+		pan_adc_start (PAN_SPEC);
+
+		// the retune for the next bin goes out while this one is captured
+		more = n < PAN_SLICE  &&  pan_bin + 1 < PAN_SZ  &&  time_us_32 () - start < PAN_BUDGET_US;
+		if (more)
+		{
+			pan_adc_wait_left (PAN_RETUNE_LEAD_US);
+			si5351bx_play(&pan_plan, 2, pan_bin + 1);
+		}
+
+		// averaged with the last sweep, unless that was somewhere else
+		val = pan_adc_result ();
+		if (pan_data_center == pan_center)
+			val = (val + pan_data[pan_bin]) / 2;
+		pan_back[pan_bin] = val;
+		pan_bin++;
+
+		if (!more)
+			break;
+	}
+	
+	// back to receive until the next slice
+	si5351bx_setfreq(0, usbCarrier);
+	setfrequency(frequency);
+
+	if (pan_bin < PAN_SZ)
+		return false;
+
+	p = pan_data;
+	pan_data = pan_back;
+	pan_back = p;
+	pan_data_center = pan_center;
+	pan_bin = 0;
+	pan_sweeps++;
+
+	return true;
+}
@@ -41,6 +41,10 @@
 #include "e_storage.h"
 #include "gui_driver.h"
 #include "dispatch.h"
+#include "pan_adc.h"
+#include "civ.h"
+#include "usb_ports.h"
+#include "pan_stream.h"
 
 
 /**
@@ -117,12 +121,12 @@ void eq_vfo_ab (uint8_t v)
 	if (v == VFO_A)
 	{
 		vfo_a_freq = vfo_b_freq;
-		mode = VFO_B_MODE;
+		mode = mode_vfob;
 	}
 	else
 	{
 		vfo_b_freq = vfo_a_freq;
-		mode = VFO_A_MODE;
+		mode = mode_vfoa;
 	}
 	
 	setfrequency (vfo_a_freq);
@@ -136,12 +140,12 @@ void sel_active_vfo (uint8_t v)
 		if (v == VFO_A)
 		{
 			frequency = vfo_a_freq;
-			mode = VFO_A_MODE;
+			mode = mode_vfoa;
 		}
 		else
 		{
 			frequency = vfo_b_freq;
-			mode = VFO_B_MODE;
+			mode = mode_vfob;
 				
 		}
 	}
@@ -149,24 +153,26 @@ void sel_active_vfo (uint8_t v)
 void saveVFOs(void)
 {
 	if (active_vfo == VFO_A)
-		e_put(VFO_A, frequency);
+		settings.vfo_a = frequency;
 	else
-		e_put(VFO_A, vfo_a_freq);
+		settings.vfo_a = vfo_a_freq;
 	
 	if (mode_vfoa == USB)
-		e_put(VFO_A_MODE, VFO_MODE_USB);
+		settings.vfo_a_mode = VFO_MODE_USB;
 	else
-		e_put(VFO_A_MODE, VFO_MODE_LSB);
+		settings.vfo_a_mode = VFO_MODE_LSB;
 	
 	if (active_vfo == VFO_B)
-		e_put(VFO_B, frequency);
+		settings.vfo_b = frequency;
 	else
-		e_put(VFO_B, vfo_b_freq);
+		settings.vfo_b = vfo_b_freq;
 	
 	if (mode_vfob == USB)
-		e_put(VFO_B_MODE, VFO_MODE_USB);
+		settings.vfo_b_mode = VFO_MODE_USB;
 	else 
-		e_put(VFO_B_MODE, VFO_MODE_LSB);
+		settings.vfo_b_mode = VFO_MODE_LSB;
+
+	settings_save();
 }
 
 /**
@@ -217,44 +223,6 @@ void setTXFilters(unsigned long freq)
 	}
 }
 
-#define MID_FILTER 11057500l
-//#define MID_FILTER usbCarrier
-#define PAN_SPAN	200000l
-//#define STEP	400
-
-void get_pan_data (void)
-{ 
-	unsigned long ff;
-	uint16_t i, val, s1, s2, s3;
-	uint32_t step;
-//	printf ("%ld | %ld\n", lsbCarrier, usbCarrier);
-	step = PAN_SPAN / PAN_SZ;
-	ff = frequency - (PAN_SZ/2) * step;
-
-	adc_select_input(PAN_SPEC);
-
-	si5351bx_setfreq(1, firstIF + MID_FILTER);
-	si5351bx_setfreq(0, MID_FILTER);
-
-	for (i = 0; i < PAN_SZ; i++)
-	{
-		si5351bx_setfreq(2, firstIF + ff);
-		ff += step;
-
-		s1 = adc_read ();
-		s2 = adc_read ();
-		s3 = adc_read ();
-
-		val = (s1 + s2 + s3) / 3;
-		pan_data[i] = (val + pan_data[i]) / 2;
-			
-	}
-	
-	si5351bx_setfreq(0, usbCarrier);
-	si5351bx_setfreq(2, firstIF + frequency);
-}
-
-
 /**
  * This is the most frequently called function that configures the 
  * radio to a particular frequeny, sideband and sets up the transmit filters
@@ -279,7 +247,7 @@ void setfrequency(uint32_t f)
 {
 //	uint64_t osc_f, firstOscillator, secondOscillator;
 
-	si5351bx_setfreq(2, firstIF + f);
+	si5351bx_finetune(2, firstIF + f);
 	
 	setTXFilters(f);
 
@@ -303,7 +271,7 @@ void setfrequency(uint32_t f)
 		else
 		{			
 			// reset to normal receive settings
-			si5351bx_setfreq(2, firstIF + f);
+			si5351bx_finetune(2, firstIF + f);
 			si5351bx_setfreq(1, firstIF + usbCarrier);
 		}
 			
@@ -380,6 +348,8 @@ void startTx(bool use_soft)
 	}
 
 	setfrequency(frequency);
+	if (!si5351bx_sync())		// oscillators on the TX frequency before keying
+		printf ("startTx: Si5351 not updated\n");
 	
 	gpio_put(TX_RX, 1);     
 	drawTx();
@@ -556,11 +526,12 @@ void switchVFO(int vfoselect)
 		{
 			vfo_b_freq = frequency;
 			mode_vfob = mode;
-			e_put(VFO_B, frequency);
+			settings.vfo_b = frequency;
 			if (mode_vfob)
-				e_put(VFO_B_MODE, VFO_MODE_USB);
+				settings.vfo_b_mode = VFO_MODE_USB;
 			else
-				e_put(VFO_B_MODE, VFO_MODE_LSB);
+				settings.vfo_b_mode = VFO_MODE_LSB;
+			settings_save();
 		}
 		active_vfo = VFO_A;
       frequency = vfo_a_freq;
@@ -572,11 +543,12 @@ void switchVFO(int vfoselect)
 		{
 			vfo_a_freq = frequency;
 			mode_vfoa = mode;
-			e_put(VFO_A, frequency);
+			settings.vfo_a = frequency;
 			if (mode_vfoa)
-				e_put(VFO_A_MODE, VFO_MODE_USB);
+				settings.vfo_a_mode = VFO_MODE_USB;
 			else
-				e_put(VFO_A_MODE, VFO_MODE_LSB);
+				settings.vfo_a_mode = VFO_MODE_LSB;
+			settings_save();
 		}
 		active_vfo = VFO_B;
 //      printLine2("Selected VFO B  ");      
@@ -601,16 +573,11 @@ void doTuning(void)
 {
 	int s;
 	static uint32_t prev_freq;
-	static uint32_t nextFrequencyUpdate = 0;
-	
-	uint32_t now;
-	
-	now = millis();
 
-	if (now >= nextFrequencyUpdate && prev_freq != frequency)
+	// the readout only redraws the digits that changed, cheap enough for every tick
+	if (prev_freq != frequency)
 	{
 		updateDisplay(KEEP_VFO);
-		nextFrequencyUpdate = now + 500;
 		prev_freq = frequency;
 	}
 	
@@ -699,13 +666,13 @@ void initSettings(void)
 	//if the readings are off, then set defaults
 
 	load_calibration ();
-	usbCarrier = e_get(USB_CAL);
-	vfo_a_freq = e_get(VFO_A);
-	vfo_b_freq = e_get(VFO_B);
-	sideTone = e_get(CW_SIDETONE);
-	cwSpeed = e_get(CW_SPEED);
-	cwDelayTime = e_get(CW_DELAYTIME);
-	x = e_get (CW_KEY_TYPE);
+	usbCarrier = settings.usb_cal;
+	vfo_a_freq = settings.vfo_a;
+	vfo_b_freq = settings.vfo_b;
+	sideTone = settings.cw_sidetone;
+	cwSpeed = settings.cw_speed;
+	cwDelayTime = settings.cw_delay;
+	x = settings.cw_key_type;
 	cw_mode = (x < 2) ? x : 0;
 //	printf ("saved settings:\n calib %d usbCar %d\nvfoA %d vfo_b_freq %d\nsidetone %d CWspd %d cwDly %d\n" ,calibration, usbCarrier, vfo_a_freq, vfo_b_freq, sideTone, cwSpeed, cwDelayTime);
 	
@@ -734,7 +701,7 @@ void initSettings(void)
 	* is taken as 'uninitialized
 	*/
 	
-	x= e_get(VFO_A_MODE);
+	x = settings.vfo_a_mode;
 	
 	switch(x)
 	{
@@ -754,7 +721,7 @@ void initSettings(void)
 		break;
 	}
 	
-	x = e_get(VFO_B_MODE);
+	x = settings.vfo_b_mode;
 	
 	switch(x)
 	{
@@ -780,7 +747,7 @@ void initSettings(void)
 	/*
 	* The keyer type splits into two variables
 	*/
-	cw_mode = e_get(CW_KEY_TYPE);
+	cw_mode = settings.cw_key_type;
 	
 	
 //	if (x == 0)
@@ -862,6 +829,32 @@ void initPorts(void)
 
 
 
+// Boot trace, when each startup step finished, printed before the loop starts
+#define BOOT_STEPS	12
+
+static struct { const char *what; uint32_t us; } boot_log[BOOT_STEPS];
+static uint8_t boot_n = 0;
+
+static void boot_mark (const char *what)
+{
+	if (boot_n < BOOT_STEPS)
+	{
+		boot_log[boot_n].what = what;
+		boot_log[boot_n++].us = time_us_32 ();
+	}
+}
+
+
+static void boot_trace_print (void)
+{
+	uint8_t i;
+
+	for (i = 0; i < boot_n; i++)
+		printf ("boot: %8lu us  +%7lu us  %s\n", boot_log[i].us,
+			boot_log[i].us - (i ? boot_log[i - 1].us : 0), boot_log[i].what);
+}
+
+
 int main (void)
 {
 	uart_init(ACTIVE_UART, UART_SPEED);
@@ -875,6 +868,7 @@ int main (void)
     uart_set_fifo_enabled(ACTIVE_UART, true);
 
 	stdio_init_all();   
+	usb_init();
 
 //  multicore_launch_core1(core1_main);
 //    printf("hello wow\n");
@@ -894,6 +888,8 @@ int main (void)
     adc_gpio_init(ADC_KEY);
     adc_gpio_init(PAN_SPEC);
     adc_select_input(SMETER_IN);
+	pan_adc_init ();
+	boot_mark ("uart, adc");
 	
 	
 	// use GPIO16 as TX and GPIO17 as RX
@@ -901,26 +897,39 @@ int main (void)
 	gpio_set_function(UART_RX, GPIO_FUNC_UART);
 	
 	gpio_pull_down(17);
+	civ_init ();
 	
 	sleep_ms (100);
 	printf ("---------------------\n Uuint8_tx starts\n---------------------\n\n");  
 	
 	
+	printf ("\n%s\n", "Loading settings");  
+	e_init();
+	settings_load();
+	boot_mark ("settings");
+
 	printf ("%s\n", "Calling displayInit");  
 	sleep_ms (100);
+	boot_mark ("sleep");
 	displayInit();
+	boot_mark ("displayInit");
 	
 	
 	sleep_ms (100);
+	boot_mark ("sleep");
 	printf ("\n%s\n", "Calling initSettings");  
 	initSettings();
+	boot_mark ("initSettings");
 	
 	printf ("\n%s\n", "Calling initPorts");  
 	initPorts();
+	boot_mark ("initPorts");
 	
 	printf ("\n%s\n", "Calling initOscillators");
 	sleep_ms (100);
+	boot_mark ("sleep");
 	initOscillators();
+	boot_mark ("initOscillators");
 	printf ("\n%s\n", "Setting frequency");  
 	frequency = vfo_a_freq;
 	// setfrequency(vfo_a_freq);
@@ -933,17 +942,19 @@ int main (void)
 
 	cw_keyer_init (800);  
 
-	
+	ui_init();
 	guiUpdate(CLEAR_VFO);
 	
 	inTx = false;
 	
 	draw_s_meter (true);
+	boot_mark ("first screen");
 	
 	sleep_ms (100);
 //	add_repeating_timer_us (250000, repeating_timer_callback_pan, NULL, &panorama_timer);
 
 
+	boot_trace_print ();
 	printf ("\nCalling main loop:\n\n");  
 	
 //	UG GUI gui ; // Global GUI s t r u c t u r e
@@ -957,37 +968,6 @@ int main (void)
 }
 
 
-bool check_uart (void)
-{
-	uint32_t ints;
-	int16_t ch;
-	static uint8_t i = 0, j = 0;
-	bool r = false;
-
-
-
-
-	stdio_flush ();
-	// check for key press
-	ch = getchar_timeout_us (0);
-
-	if (ch >= 0)
-	{
-		ch &= 0xFF;
-		
-		inque[i++] = ch;
-		
-		if (ch == 0xFD) 
-		{
-//			printf ("%.2X %.2X %.2X %.2X %.2X %.2X %.2X %.2X %.2X %.2X\n", inque[0], inque[1], inque[2], inque[3], inque[4], inque[5], inque[6], inque[7], inque[8], inque[9]);
-			i = 0;
-			r = true;
-		}
-	}
-	
-	return r;
-}
-
 /**
  * The main loop controlling the Uuint8_tx radio.
  */
@@ -1001,18 +981,29 @@ bool check_uart (void)
 void loop(void)
 { 
 //	uint16_t i;
-	static uint32_t t, t1, t2;
+	static uint32_t t, t1;
+	uint32_t t_start;
+#ifdef PAN_STATS
+	uint32_t t_worst = 0, t_report = 0, sweeps = 0;
+#endif
 
 	 t = time_tick + DELTA_T;
-	 t2 = time_tick + LDELTA_T;
 	inque[0] = inque[1] = inque[2] = inque[3] = inque[4] = 0xAA;
 	for (EVER)
 	{
+		usb_task ();
+
 		if (time_tick >= t)
 		{
 			t = time_tick + DELTA_T;
-			if (check_uart ())
+			t_start = time_us_32 ();
+
+			// every CI-V frame that came in since the last tick
+			civ_poll ();
+			while (civ_get_frame ())
 				dispatch ();
+			civ_transceive_poll ();
+			civ_flush ();
 		
 //			get_paddle_state ();
 
@@ -1045,22 +1036,59 @@ void loop(void)
 				
 				draw_s_meter (false);
 				t1 = time_tick + LDELTA_T;
+				// flash stops everything for a moment, only when nothing is going on
+				if (!inTx  &&  !keyDown  &&  cwTimeout == 0  &&  time_tick - enc_last > 500)
+					e_idle ();
+#ifdef E_STATS
+				e_stats_print ();
+#endif
+#ifdef CIV_STATS
+				civ_stats_print ();
+				usb_stats_print ();
+#endif
+#ifdef LCD_STATS
+				lcd_stats_print ();
+#endif
+#ifdef SI5351_STATS
+				si5351_stats_print ();
+#endif
 			}
-			
-			if (time_tick >= t2)
-			{
-				if (sweep_on)
-				{	
-					get_pan_data ();
-					clearSweep ();
-					displaySweep ();
-				}
-				else // there is to long delay for get_pan_data
+
+			// one slice of the panorama per tick, the receiver is off frequency for
+			// it, so not while transmitting or keying CW
+			if ((sweep_on  ||  pan_stream_on)  &&  !inTx  &&  !keyDown  &&  cwTimeout == 0)
+			{	
+				if (get_pan_data ())
 				{
-					clearSweep ();
-					t2 = time_tick + DELTA_T;
+					if (sweep_on)
+					{
+						displaySweep ();
+						displayWaterfall ();
+					}
+					pan_stream_sweep (pan_data, PAN_SZ, pan_center, PAN_SPAN);
 				}
 			}
+
+			// paint whatever the work above has changed
+			ui_compose();
+
+#ifdef PAN_STATS
+			// sweep rate and the longest tick while sweeping, once a second
+			if ((sweep_on  ||  pan_stream_on)  &&  time_us_32 () - t_start > t_worst)
+				t_worst = time_us_32 () - t_start;
+
+			if (time_tick >= t_report)
+			{
+				printf ("pan: %lu sweeps/s worst tick %lu us %lu restarts\n", pan_sweeps - sweeps, t_worst, pan_restarts);
+				printf ("pan stream: %lu frames %lu key %lu bytes %lu skipped\n", pan_stream_stats.frames,
+						pan_stream_stats.key_frames, pan_stream_stats.bytes, pan_stream_stats.skipped);
+				sweeps = pan_sweeps;
+				t_worst = 0;
+				t_report = time_tick + 1000;
+			}
+#else
+			(void)t_start;
+#endif
 		}
 //		guiUpdate();	
 	}
@@ -46,29 +46,55 @@
 
 #define PAN_SZ	255
 
-// addresses for values in e_storage, that is fake EEPROM in flash
-#define VFO_MODE_LSB 2
-#define VFO_MODE_USB 3
-#define LSB_CAL 4
-#define USB_CAL 8
+// Si5351 bus speed, 100 and 400 kHz are safe, 1000 (fast mode plus) wants
+// stiffer pull-ups than most Si5351 boards have
+#ifndef SI5351_I2C_KHZ
+#define SI5351_I2C_KHZ	400
+#endif
+
+// VFO selectors, the values are the old storage addresses
 #define VFO_A 16
 #define VFO_B 20
-#define CW_SIDETONE 24
-#define CW_SPEED 28
-#define SLOPE_X 32 // the screen calibration parameters 
-#define SLOPE_Y 36
-#define OFFSET_X 40
-#define OFFSET_Y 44
-#define CW_DELAYTIME 48
-#define MASTER_CAL 128
-#define VFO_A_MODE  238 // 2: LSB, 3: USB
-#define VFO_B_MODE  242
-#define CW_KEY_TYPE 254 // handkey, iambic a, iambic b : 0,1,2f
+
+// stored VFO modes
+#define VFO_MODE_LSB 2
+#define VFO_MODE_USB 3
+
+// Settings block in e_storage, that is fake EEPROM in flash. Saved as one
+// unit by settings_save(), settings.c converts older layouts.
+#define SETTINGS_ADDR		52
+#define SETTINGS_MAGIC		0x5842
+#define SETTINGS_VERSION	1
+
+typedef struct __attribute__((packed))
+{
+	uint16_t magic;
+	uint8_t version;
+	uint8_t reserved;
+	uint32_t usb_cal;
+	uint32_t vfo_a;
+	uint32_t vfo_b;
+	uint32_t cw_sidetone;
+	int32_t cw_speed;
+	int32_t cw_delay;
+	int32_t slope_x;			// the screen calibration parameters
+	int32_t slope_y;
+	int32_t offset_x;
+	int32_t offset_y;
+	int32_t master_cal;
+	uint8_t vfo_a_mode;			// VFO_MODE_LSB or VFO_MODE_USB
+	uint8_t vfo_b_mode;
+	uint8_t cw_key_type;		// handkey, iambic a, iambic b : 0,1,2
+	uint8_t reserved2;
+	uint16_t crc;				// over everything above
+	uint16_t reserved3;
+} Settings;
+
+extern Settings settings;
 
 
 #define	 KEEP_VFO   0
 #define  CLEAR_VFO	1
-#define CW_SPEED 28
 #define TX_SSB 0
 #define TX_CW 1
 #define IAMBICA 0x00 // 0 for Iambic A, 1 for Iambic B
@@ -76,12 +102,6 @@
 #define OPEN_KEY 	0
 #define CLOSED_KEY 	1
 
-// the screen calibration parameters : int slope_x=104, slope_y=137, offset_x=28, offset_y=29;
-#define SLOPE_X 32
-#define SLOPE_Y 36
-#define OFFSET_X 40
-#define OFFSET_Y 44
-
 
 // NUmbers corrected to be correct with CI-V
 #define LSB		0
@@ -100,11 +120,55 @@ typedef struct {
   char id;
 } Button;
 
+// Retained UI element, painted by the compositor in ubitx_ui.c when dirty.
+// The area covers x..x+w and y..y+h like displayFillrect.
+typedef struct _widget {
+  int x, y, w, h;
+  const Button *btn;	// button shown by this widget, NULL for status fields
+  char text[32];
+  uint16_t color, bg;
+  uint8_t font;
+  int value;
+  bool selected;
+  bool dirty;
+  bool self_drawn;		// contents drawn outside the compositor, paint only clears
+  void (*paint)(struct _widget *wg);
+} Widget;
+
 typedef struct {
   uint8_t x0, y0, x1, y1;} grid_entry;
 
 typedef struct { uint8_t x, y; char inf;} pad_grid_entry;
 
+// Si5351 I2C traffic, printed and cleared by si5351_stats_print()
+typedef struct
+{
+	uint32_t bytes;					// bytes on the wire, address byte not counted
+	uint32_t transactions;
+	uint32_t bytes_saved;			// skipped because the shadow already matched
+	uint32_t transactions_saved;
+	uint32_t aborts;				// NACKed transfers, sent again
+	uint32_t errors;				// ranges given up after SI5351_RETRIES, failed blocking writes
+	uint32_t timeouts;				// si5351bx_sync() calls that gave up
+} si5351_counters;
+
+extern si5351_counters si5351_stats;
+
+#define PLAN_SZ		PAN_SZ
+
+// Precomputed Si5351 msynth registers for a frequency sweep
+typedef struct
+{
+	uint32_t start;
+	uint32_t step;
+	uint32_t vcoa;				// si5351bx_vcoa the plan was built for
+	uint16_t count;
+	uint8_t rdiv;
+	bool valid;
+	bool on[PLAN_SZ];			// false if the step is out of range
+	uint8_t regs[PLAN_SZ][8];
+} Sweep_plan;
+
 
 
   //frequency is the current frequency on the dial
@@ -142,13 +206,18 @@ extern uint32_t vfo_a_freq, vfo_b_freq, sideTone, usbCarrier;
 extern uint8_t mode_vfoa, mode_vfob;
 extern unsigned long firstIF;
 extern uint32_t time_tick;
+extern uint32_t enc_last;
 
 extern bool keyDown;
 extern bool accel_vfo;
 
 extern int cwSpeed; //this is actuall the dot period in milliseconds
 extern uint8_t cw_mode;
-extern uint16_t pan_data[];
+#define PAN_SPAN	200000l
+extern uint16_t *pan_data;
+extern uint32_t pan_center;
+extern uint32_t pan_sweeps;
+extern uint32_t pan_restarts;
 extern bool sweep_on;
 
 void saveVFOs(void);
@@ -172,15 +241,22 @@ void checkCAT(void);
 //displays a nice dialog box with a title and instructions as footnotes
 void displayDialog(char *title, char *instructions);
 void guiUpdate(bool vfo_redraw);
+void ui_init(void);
+void ui_compose(void);
+void ui_invalidate(int x, int y, int w, int h);
 void setfrequency(unsigned long f);
 uint32_t getfrequency(void);
 void drawTx(void);
 void doSetup2(void);
 void redraw_menus(void);
 void draw_s_meter (bool redraw);
+uint8_t get_s_value (uint8_t max);
 uint16_t analogRead (uint8_t pin);
+bool get_pan_data (void);
 void clearSweep (void);
 void displaySweep (void);
+void clearWaterfall (void);
+void displayWaterfall (void);
 
 bool btnDown(void);
 void readTouchCalibration(void);
@@ -190,12 +266,21 @@ void checkTouch(void);
 void enc_setup(void);
 int enc_read(void);
 
+void settings_load (void);
+void settings_save (void);
+
 void set_calibration (uint32_t cal);
 uint32_t get_calibration (void);
 void load_calibration (void);
 
 
+bool si5351bx_regs(uint32_t fout, uint8_t *vals);
+void si5351_stats_print(void);
 void si5351bx_setfreq(uint8_t clknum, uint32_t fout);
+bool si5351bx_sync(void);
+void si5351bx_finetune(uint8_t clknum, uint32_t fout);
+void si5351bx_plan(Sweep_plan *plan, uint32_t start, uint32_t step, uint16_t count);
+void si5351bx_play(Sweep_plan *plan, uint8_t clknum, uint16_t i);
 void si5351_set_calibration(int32_t cal);
 void initOscillators(void);
 void printCarrierFreq(uint32_t freq);
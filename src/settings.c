@@ -0,0 +1,211 @@
+// Settings, one versioned and CRC protected block in the e_storage image.
+// Loaded once at boot, the code works on the settings struct and calls
+// settings_save() after a change, e_storage writes only the words that moved.
+//
+// SM0KBW
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include "pico/stdlib.h"
+#include "pbitx.h"
+#include "e_storage.h"
+
+// The layout is stored as is, any move of a field needs a new version
+static_assert (sizeof(Settings) == 56, "Settings size changed");
+static_assert (SETTINGS_ADDR % 4 == 0  &&  SETTINGS_ADDR + sizeof(Settings) <= 128, "Settings overlap the v0 values");
+static_assert (offsetof(Settings, usb_cal) == 4, "Settings layout changed");
+static_assert (offsetof(Settings, vfo_a) == 8, "Settings layout changed");
+static_assert (offsetof(Settings, vfo_b) == 12, "Settings layout changed");
+static_assert (offsetof(Settings, cw_sidetone) == 16, "Settings layout changed");
+static_assert (offsetof(Settings, cw_speed) == 20, "Settings layout changed");
+static_assert (offsetof(Settings, cw_delay) == 24, "Settings layout changed");
+static_assert (offsetof(Settings, slope_x) == 28, "Settings layout changed");
+static_assert (offsetof(Settings, master_cal) == 44, "Settings layout changed");
+static_assert (offsetof(Settings, vfo_a_mode) == 48, "Settings layout changed");
+static_assert (offsetof(Settings, cw_key_type) == 50, "Settings layout changed");
+static_assert (offsetof(Settings, crc) == 52, "Settings layout changed");
+
+// version 0, a raw value every four bytes of the old eeprom page
+#define V0_USB_CAL		8
+#define V0_VFO_A		16
+#define V0_VFO_B		20
+#define V0_CW_SIDETONE	24
+#define V0_CW_SPEED		28
+#define V0_SLOPE_X		32
+#define V0_SLOPE_Y		36
+#define V0_OFFSET_X		40
+#define V0_OFFSET_Y		44
+#define V0_CW_DELAYTIME	48
+#define V0_MASTER_CAL	128
+#define V0_VFO_A_MODE	238
+#define V0_VFO_B_MODE	242
+#define V0_CW_KEY_TYPE	254		// wrapped into bytes 0 and 1 on write
+
+// defaults, the touch values from a test run of the calibration routine
+#define DEF_USB_CAL		11052000
+#define DEF_VFO_A		7150000
+#define DEF_VFO_B		14150000
+#define DEF_SIDETONE	800
+#define DEF_CW_SPEED	100
+#define DEF_CW_DELAY	50
+#define DEF_MASTER_CAL	11850
+#define DEF_SLOPE_X		104
+#define DEF_SLOPE_Y		137
+#define DEF_OFFSET_X	28
+#define DEF_OFFSET_Y	29
+
+// a 25 MHz crystal off by more than 100 ppm is broken, not calibrated
+#define MASTER_CAL_MAX	100000
+#define SLOPE_MAX		1000		// raw touch units per 10 pixels
+#define OFFSET_MAX		4095		// raw touch units
+
+Settings settings;
+
+
+static uint16_t settings_crc (void)
+{
+	return crc16 ((const uint8_t *)&settings, offsetof(Settings, crc));
+}
+
+
+static void settings_from_v0 (void)
+{
+	memset (&settings, 0, sizeof(settings));
+
+	settings.usb_cal = e_get (V0_USB_CAL);
+	settings.vfo_a = e_get (V0_VFO_A);
+	settings.vfo_b = e_get (V0_VFO_B);
+	settings.cw_sidetone = e_get (V0_CW_SIDETONE);
+	settings.cw_speed = e_get (V0_CW_SPEED);
+	settings.cw_delay = e_get (V0_CW_DELAYTIME);
+	settings.slope_x = e_get (V0_SLOPE_X);
+	settings.slope_y = e_get (V0_SLOPE_Y);
+	settings.offset_x = e_get (V0_OFFSET_X);
+	settings.offset_y = e_get (V0_OFFSET_Y);
+	settings.master_cal = e_get (V0_MASTER_CAL);
+	settings.vfo_a_mode = e_get (V0_VFO_A_MODE);
+	settings.vfo_b_mode = e_get (V0_VFO_B_MODE);
+	settings.cw_key_type = e_get (V0_CW_KEY_TYPE);
+}
+
+
+static void settings_defaults (void)
+{
+	memset (&settings, 0, sizeof(settings));
+
+	settings.usb_cal = DEF_USB_CAL;
+	settings.vfo_a = DEF_VFO_A;
+	settings.vfo_b = DEF_VFO_B;
+	settings.cw_sidetone = DEF_SIDETONE;
+	settings.cw_speed = DEF_CW_SPEED;
+	settings.cw_delay = DEF_CW_DELAY;
+	settings.slope_x = DEF_SLOPE_X;
+	settings.slope_y = DEF_SLOPE_Y;
+	settings.offset_x = DEF_OFFSET_X;
+	settings.offset_y = DEF_OFFSET_Y;
+	settings.master_cal = DEF_MASTER_CAL;
+}
+
+
+// The v0 words stay where they were after the conversion, they are the
+// fallback for a damaged block when they still look like a radio's
+static void settings_fallback (void)
+{
+	settings_from_v0 ();
+
+	if (settings.usb_cal < 11048000  ||  settings.usb_cal > 11060000
+		||  settings.vfo_a < 3500000  ||  settings.vfo_a > 35000000)
+	{
+		printf ("settings: using the defaults\n");
+		settings_defaults ();
+	}
+	else
+		printf ("settings: using the version 0 values\n");
+}
+
+
+// initSettings() range checks the radio values, the calibrations are
+// checked here. True if one was put back to its default.
+static bool settings_check (void)
+{
+	bool fixed = false;
+
+	if (settings.master_cal < -MASTER_CAL_MAX  ||  settings.master_cal > MASTER_CAL_MAX)
+	{
+		settings.master_cal = DEF_MASTER_CAL;
+		fixed = true;
+	}
+
+	if (settings.slope_x <= 0  ||  settings.slope_x > SLOPE_MAX  ||  settings.slope_y <= 0  ||  settings.slope_y > SLOPE_MAX
+		||  settings.offset_x < 0  ||  settings.offset_x > OFFSET_MAX  ||  settings.offset_y < 0  ||  settings.offset_y > OFFSET_MAX)
+	{
+		settings.slope_x = DEF_SLOPE_X;
+		settings.slope_y = DEF_SLOPE_Y;
+		settings.offset_x = DEF_OFFSET_X;
+		settings.offset_y = DEF_OFFSET_Y;
+		fixed = true;
+	}
+
+	if (fixed)
+		printf ("settings: calibration out of range, default used\n");
+
+	return fixed;
+}
+
+
+// Read the block, convert older layouts. A block with a bad CRC, or from a
+// version this firmware does not know, is replaced by the v0 values or the
+// defaults, and written back.
+void settings_load (void)
+{
+	bool save = false;
+
+	e_get_block (SETTINGS_ADDR, &settings, sizeof(settings));
+
+	if (settings.magic != SETTINGS_MAGIC)
+	{
+		printf ("settings: converting version 0\n");
+		settings_from_v0 ();
+		save = true;
+	}
+	else if (settings.crc != settings_crc ())
+	{
+		printf ("settings: bad CRC\n");
+		settings_fallback ();
+		save = true;
+	}
+	else if (settings.version == 0  ||  settings.version > SETTINGS_VERSION)
+	{
+		printf ("settings: unknown version %u\n", settings.version);
+		settings_fallback ();
+		save = true;
+	}
+
+	// a new version adds its conversion here, each case falls through to the next
+	switch (settings.version)
+	{
+		case 1:
+			break;
+	}
+
+	if (settings_check ()  ||  settings.version != SETTINGS_VERSION)
+		save = true;
+
+	if (save)
+		settings_save ();
+}
+
+
+void settings_save (void)
+{
+	settings.magic = SETTINGS_MAGIC;
+	settings.version = SETTINGS_VERSION;
+	settings.crc = settings_crc ();
+
+	e_put_block (SETTINGS_ADDR, &settings, sizeof(settings));
+}
@@ -29,9 +29,9 @@ extern uint32_t si5351bx_vcoa;
 void setupExit(void)
 {
 	menuOn = false;
+	e_flush();
 	displayClear(DISPLAY_NAVY);
-	displayVFO(CLEAR_VFO);  
-	guiUpdate(KEEP_VFO);
+	guiUpdate(CLEAR_VFO);
 }
 
 
@@ -118,7 +118,8 @@ void setupBFO(void)
 		sleep_ms (100);
 	}
 	
-	e_put(USB_CAL, usbCarrier);  
+	settings.usb_cal = usbCarrier;
+	settings_save();
 	si5351bx_setfreq(0, usbCarrier);          
 	setfrequency(frequency);
 	updateDisplay(CLEAR_VFO);
@@ -154,7 +155,8 @@ void setupCwDelay(void)
 		displayText(buff, 20, 100, DISPLAY_CYAN, DISPLAY_BLACK, A_NORMAL);
 	}
 	
-	e_put(CW_DELAYTIME, cwDelayTime);
+	settings.cw_delay = cwDelayTime;
+	settings_save();
 	sleep_ms (25);
 }
 
@@ -219,7 +221,8 @@ void setupKeyer(void)
 	
 	cw_mode = tmp_key;
   
-	e_put(CW_KEY_TYPE, tmp_key);
+	settings.cw_key_type = tmp_key;
+	settings_save();
 }
 
 void drawSetupMenu(void)
@@ -82,10 +82,10 @@ void readTouchCalibration(void)
 	printf ("readTouchCalibration\n");
 
 	
-	slope_x = e_get (SLOPE_X); 
-	slope_y = e_get (SLOPE_Y); 
-	offset_x = e_get (OFFSET_X); 
-	offset_y = e_get (OFFSET_Y);   
+	slope_x = settings.slope_x; 
+	slope_y = settings.slope_y; 
+	offset_x = settings.offset_x; 
+	offset_y = settings.offset_y;   
 	
 	// for debugging
 //	printf("readTouchCalib...\n slope_x %d slope_y %d\n offset_x %d offset_y %d\n", slope_x, slope_y, offset_x, offset_y);
@@ -93,10 +93,11 @@ void readTouchCalibration(void)
 
 void writeTouchCalibration(void)
 {
-	e_put (SLOPE_X, slope_x);
-	e_put(SLOPE_Y, slope_y);
-	e_put(OFFSET_X, offset_x);
-	e_put(OFFSET_Y, offset_y);    
+	settings.slope_x = slope_x;
+	settings.slope_y = slope_y;
+	settings.offset_x = offset_x;
+	settings.offset_y = offset_y;    
+	settings_save();
 }
 
 
@@ -129,7 +130,8 @@ static void touch_update(void)
 	uint16_t rx_str[10];
   
  
-  
+	// the display may still own the bus
+	lcd_wait ();
 	spi_set_baudrate (SPI_PORT, TOUCH_BAUD); 
 
 	gpio_put(TFT_CS, HIGH);
@@ -0,0 +1,25 @@
+// TinyUSB configuration, a composite device with three CDC ports:
+// CI-V CAT, binary telemetry and the debug console
+#ifndef _TUSB_CONFIG_H_
+#define _TUSB_CONFIG_H_
+
+#ifndef CFG_TUSB_RHPORT0_MODE
+#define CFG_TUSB_RHPORT0_MODE	OPT_MODE_DEVICE
+#endif
+
+#ifndef CFG_TUSB_OS
+#define CFG_TUSB_OS				OPT_OS_PICO
+#endif
+
+#define CFG_TUD_ENDPOINT0_SIZE	64
+
+#define CFG_TUD_CDC				3
+#define CFG_TUD_MSC				0
+#define CFG_TUD_HID				0
+#define CFG_TUD_MIDI			0
+#define CFG_TUD_VENDOR			0
+
+#define CFG_TUD_CDC_RX_BUFSIZE	256
+#define CFG_TUD_CDC_TX_BUFSIZE	1024	// room for a panorama frame
+
+#endif // _TUSB_CONFIG_H_
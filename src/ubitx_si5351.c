@@ -1,8 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include "pico/binary_info.h"
 #include "hardware/i2c.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
 #include "pico/stdlib.h"
 #include "pbitx.h"
 #include "e_storage.h"
@@ -47,6 +50,16 @@
 #define SI5351BX_ADDR 0x60              // I2C address of Si5351   (typical)
 #define SI5351BX_XTALPF 2               // 1:6pf  2:8pf  3:10pf
 
+// A NACKed range is sent again this many times before it is given up
+#ifndef SI5351_RETRIES
+#define SI5351_RETRIES 3
+#endif
+
+// si5351bx_sync() gives up after this, a full queue retried at 100 kHz fits
+#ifndef SI5351_SYNC_US
+#define SI5351_SYNC_US 20000
+#endif
+
 // If using 27mhz crystal, set XTAL=27000000, MSA=33.  Then vco=891mhz
 #define SI5351BX_XTAL 25000000          // Crystal freq in Hz
 #define SI5351BX_MSA  35                // VCOA is at 25mhz*35 = 875mhz
@@ -58,6 +71,42 @@ uint8_t  si5351bx_drive[3] = {3, 3, 3}; // 0=2ma 1=4ma 2=6ma 3=8ma for CLK 0,1,2
 uint8_t  si5351bx_clken = 0xFF;         // Private, all CLK output drivers off
 int32_t calibration = 11850;
 
+// Shadow of the msynth and clock control registers (0 - 65). A write only sends
+// the contiguous range that differs from what the chip already holds.
+#define SHADOW_SZ	(42 + 3 * 8)
+
+static uint8_t shadow[SHADOW_SZ];
+static bool shadow_known[SHADOW_SZ];
+
+// Write queue. The shadow holds what the chip should hold, a slot marks the
+// range of a register group that is not sent yet. A new write to the same
+// clock widens the range, so only the latest values go out. The I2C IRQ
+// sends the slots in order: msynth CLK0-2, drive control, output enable.
+// One range is on the bus at a time, the next one starts at its STOP, so an
+// abort only loses the range in flight.
+#define Q_SLOTS		5
+#define Q_CTRL		3
+#define Q_ENABLE	4
+
+typedef struct
+{
+	uint8_t first;
+	uint8_t last;
+	bool dirty;
+} q_slot;
+
+static volatile q_slot q[Q_SLOTS];
+static uint8_t tx_buf[9];				// register + 8 msynth bytes
+static volatile uint8_t tx_len = 0;
+static volatile uint8_t tx_pos = 0;
+static int8_t tx_slot = -1;				// slot of the range in flight, -1 when idle
+static uint8_t tx_first, tx_last;		// and its registers
+static uint8_t tx_retries = 0;
+static bool q_lost = false;				// a range was given up since the last si5351bx_sync()
+static bool q_running = false;
+
+si5351_counters si5351_stats;
+
 void i2cWriten(uint8_t reg, uint8_t *vals, uint8_t vcnt); 
 void i2cWrite(uint8_t reg, uint8_t val);
 
@@ -65,7 +114,8 @@ void i2cWrite(uint8_t reg, uint8_t val);
 void set_calibration (uint32_t cal)
 {
 	calibration = cal;
-	e_put(MASTER_CAL, cal);
+	settings.master_cal = cal;
+	settings_save();
 }
 
 
@@ -77,7 +127,7 @@ uint32_t get_calibration (void)
 
 void load_calibration (void)
 {
-	calibration = e_get (MASTER_CAL);
+	calibration = settings.master_cal;
 }
 
 
@@ -100,10 +150,244 @@ void i2cWriten(uint8_t reg, uint8_t *vals, uint8_t vcnt)
 	{
 		buff[i] = *vals++;
 	}
-	i2c_write_blocking (i2c1, SI5351BX_ADDR, buff, (size_t)len, false);			
+	if (i2c_write_blocking (i2c1, SI5351BX_ADDR, buff, (size_t)len, false) != len)
+		si5351_stats.errors++;
+	si5351_stats.bytes += len;
+	si5351_stats.transactions++;
  }
 
 
+static uint8_t q_slot_of(uint8_t reg)
+{
+	if (reg >= 42)
+		return (reg - 42) / 8;
+	if (reg >= 16)
+		return Q_CTRL;
+	return Q_ENABLE;
+}
+
+
+// Take the next pending range out of the queue, false if there is none
+static bool q_next(void)
+{
+	uint8_t i, r;
+
+	for (i = 0; i < Q_SLOTS; i++)
+	{
+		if (q[i].dirty)
+		{
+			tx_buf[0] = q[i].first;
+			for (r = q[i].first; r <= q[i].last; r++)
+				tx_buf[r - q[i].first + 1] = shadow[r];
+
+			tx_len = q[i].last - q[i].first + 2;
+			tx_pos = 0;
+			tx_slot = i;
+			tx_first = q[i].first;
+			tx_last = q[i].last;
+			q[i].dirty = false;
+
+			si5351_stats.bytes += tx_len;
+			si5351_stats.transactions++;
+			return true;
+		}
+	}
+
+	tx_slot = -1;
+	return false;
+}
+
+
+// The range in flight was NACKed. Queue it again together with whatever was
+// written to the slot since, or give it up after SI5351_RETRIES tries in a
+// row. A range that is given up is marked unknown, the next write of those
+// registers sends them whatever the shadow says.
+static void q_retry(void)
+{
+	uint8_t r;
+
+	if (++tx_retries > SI5351_RETRIES)
+	{
+		for (r = tx_first; r <= tx_last; r++)
+			shadow_known[r] = false;
+		tx_retries = 0;
+		q_lost = true;
+		si5351_stats.errors++;
+		return;
+	}
+
+	if (q[tx_slot].dirty)
+	{
+		if (tx_first < q[tx_slot].first)
+			q[tx_slot].first = tx_first;
+		if (tx_last > q[tx_slot].last)
+			q[tx_slot].last = tx_last;
+	}
+	else
+	{
+		q[tx_slot].first = tx_first;
+		q[tx_slot].last = tx_last;
+		q[tx_slot].dirty = true;
+	}
+}
+
+
+// Keep the TX FIFO filled, the last byte of a range carries the STOP and the
+// next range waits for STOP_DET
+static void si5351_irq(void)
+{
+	i2c_hw_t *hw = i2c_get_hw(i2c1);
+	uint32_t stat = hw->raw_intr_stat;
+
+	if (stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS)
+	{
+		// the FIFO was flushed, the shadow still has the values
+		(void)hw->clr_tx_abrt;
+		si5351_stats.aborts++;
+		if (tx_slot >= 0)
+			q_retry();
+		tx_slot = -1;
+		tx_pos = tx_len = 0;
+	}
+	else
+	if (tx_slot >= 0  &&  tx_pos == tx_len  &&  (stat & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS))
+	{
+		tx_slot = -1;
+		tx_retries = 0;
+	}
+	(void)hw->clr_stop_det;
+
+	if (tx_slot < 0  &&  !q_next ())
+	{
+		hw->intr_mask = I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+		return;
+	}
+
+	while (tx_pos < tx_len  &&  i2c_get_write_available(i2c1))
+	{
+		hw->data_cmd = tx_buf[tx_pos] | (tx_pos == tx_len - 1 ? I2C_IC_DATA_CMD_STOP_BITS : 0);
+		tx_pos++;
+	}
+
+	// TX_EMPTY brings us back for the rest of the range, STOP_DET once it is out
+	hw->intr_mask = (tx_pos < tx_len ? I2C_IC_INTR_MASK_M_TX_EMPTY_BITS : I2C_IC_INTR_MASK_M_STOP_DET_BITS) |
+		I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+}
+
+
+// Write through the shadow, only the changed registers are queued
+static void si5351bx_write(uint8_t reg, uint8_t *vals, uint8_t vcnt)
+{
+	int8_t first = -1, last = -1;
+	uint8_t i, slot;
+	uint32_t irq;
+
+	if (!q_running  ||  reg + vcnt > SHADOW_SZ)
+	{
+		si5351bx_sync();
+		i2cWriten(reg, vals, vcnt);
+		return;
+	}
+
+	for (i = 0; i < vcnt; i++)
+	{
+		if (!shadow_known[reg + i]  ||  shadow[reg + i] != vals[i])
+		{
+			if (first < 0)
+				first = i;
+			last = i;
+		}
+	}
+
+	if (first < 0)
+	{
+		si5351_stats.bytes_saved += vcnt + 1;
+		si5351_stats.transactions_saved++;
+		return;
+	}
+
+	si5351_stats.bytes_saved += vcnt - (last - first + 1);
+	slot = q_slot_of(reg);
+
+	irq = save_and_disable_interrupts();
+
+	for (i = first; i <= last; i++)
+	{
+		shadow[reg + i] = vals[i];
+		shadow_known[reg + i] = true;
+	}
+
+	if (q[slot].dirty)
+	{
+		// coalesce with the write still waiting for the bus
+		si5351_stats.transactions_saved++;
+		if (reg + first < q[slot].first)
+			q[slot].first = reg + first;
+		if (reg + last > q[slot].last)
+			q[slot].last = reg + last;
+	}
+	else
+	{
+		q[slot].first = reg + first;
+		q[slot].last = reg + last;
+		q[slot].dirty = true;
+	}
+
+	// TX_EMPTY fires right away if the bus is idle, else the STOP of the
+	// range in flight picks the slot up
+	if (tx_slot < 0)
+		i2c_get_hw(i2c1)->intr_mask = I2C_IC_INTR_MASK_M_TX_EMPTY_BITS | I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+	restore_interrupts(irq);
+}
+
+
+// Completion barrier, returns when every queued write is on the chip. False
+// when that took longer than SI5351_SYNC_US, the queue carries on, or when a
+// range was given up since the last call.
+bool si5351bx_sync(void)
+{
+	i2c_hw_t *hw;
+	uint32_t start;
+	uint8_t i;
+	bool busy, lost;
+
+	if (!q_running)
+		return true;
+
+	hw = i2c_get_hw(i2c1);
+	start = time_us_32();
+
+	for (;;)
+	{
+		busy = tx_slot >= 0  ||  !(hw->status & I2C_IC_STATUS_TFE_BITS)  ||  (hw->status & I2C_IC_STATUS_MST_ACTIVITY_BITS);
+		for (i = 0; i < Q_SLOTS; i++)
+			busy |= q[i].dirty;
+
+		if (!busy)
+		{
+			lost = q_lost;
+			q_lost = false;
+			return !lost;
+		}
+
+		if (time_us_32() - start > SI5351_SYNC_US)
+		{
+			si5351_stats.timeouts++;
+			return false;
+		}
+	}
+}
+
+
+void si5351_stats_print(void)
+{
+	printf ("si5351: %lu bytes %lu transactions, saved %lu bytes %lu transactions, %lu aborts %lu errors %lu timeouts\n",
+		si5351_stats.bytes, si5351_stats.transactions, si5351_stats.bytes_saved, si5351_stats.transactions_saved,
+		si5351_stats.aborts, si5351_stats.errors, si5351_stats.timeouts);
+	memset (&si5351_stats, 0, sizeof(si5351_stats));
+}
+
+
 
 // Call once at power-up, start PLL
 void si5351bx_init(void) 
@@ -112,7 +396,7 @@ void si5351bx_init(void)
 	uint32_t msxp1;
 	
 
-	i2c_init (i2c1, 100 * 1000);	
+	i2c_init (i2c1, SI5351_I2C_KHZ * 1000);	
 	
 //	printf ("setting up i2c1 over pins GP14 and GP15, that is over I2C_SDA and I2C_SCL\nreturned %d\n", n);
 	
@@ -128,6 +412,7 @@ void si5351bx_init(void)
 
 //	printf ("sending val %d to port 0x3\n", si5351bx_clken);
 	
+	memset (shadow_known, 0, sizeof(shadow_known));   // chip state unknown after reset
 	i2cWrite(3, si5351bx_clken);          // Disable all CLK output drivers
 	i2cWrite(0xB7, SI5351BX_XTALPF << 6);  // Set 25mhz crystal load capacitance
 	msxp1 = 128 * SI5351BX_MSA - 512;     // and msxp2=0, msxp3=1, not fractional
@@ -136,39 +421,161 @@ void si5351bx_init(void)
 	i2cWrite(0xB1, 0x20);                  // Reset PLLA  (0x80 resets PLLB)
 	i2cWriten(0x22, vals, 8);               // Write to 8 PLLA msynth regs
 	i2cWrite(0xB1, 0xA0);                  // Reset PLLA  & PPLB (0x80 resets PLLB)
+
+	// from here on the msynth writes go through the queue, the blocking
+	// writes above have left the target address set to the Si5351
+	irq_set_exclusive_handler(I2C1_IRQ, si5351_irq);
+	i2c_get_hw(i2c1)->intr_mask = I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+	irq_set_enabled(I2C1_IRQ, true);
+	q_running = true;
 }
 
 
-// Set a CLK to fout Hz
-void si5351bx_setfreq(uint8_t clknum, uint32_t fout) 
+// Compute the 8 msynth registers for fout, false if fout is out of range
+bool si5351bx_regs(uint32_t fout, uint8_t *vals)
 {
 	uint32_t  msa, msb, msc, msxp1, msxp2, msxp3p2top;
+
+	if ((fout < 500000) || (fout > 109000000))
+		return false;
+
+	msa = si5351bx_vcoa / fout;     // Integer part of vco/fout
+	msb = si5351bx_vcoa % fout;     // Fractional part of vco/fout
+	msc = fout;                      // Divide by 2 till fits in reg
 	
-	if ((fout < 500000) || (fout > 109000000)) // If clock freq out of range
+	while (msc & 0xfff00000)
+	{
+		msb = msb >> 1;
+		msc = msc >> 1;
+	}
+	
+	msxp1 = (128 * msa + 128 * msb / msc - 512) | (((uint32_t)si5351bx_rdiv) << 20);
+	msxp2 = 128 * msb - 128 * msb / msc * msc; // msxp3 == msc;
+	msxp3p2top = (((msc & 0x0F0000) << 4) | msxp2);     // 2 top nibbles
+
+	vals[0] = BB1(msc);
+	vals[1] = BB0(msc);
+	vals[2] = BB2(msxp1);
+	vals[3] = BB1(msxp1);
+	vals[4] = BB0(msxp1);
+	vals[5] = BB2(msxp3p2top);
+	vals[6] = BB1(msxp2);
+	vals[7] = BB0(msxp2);
+
+	return true;
+}
+
+
+// Load precomputed msynth registers into a CLK, NULL shuts it down
+static void si5351bx_load(uint8_t clknum, uint8_t *vals)
+{
+	if (vals == NULL)
 		si5351bx_clken |= 1 << clknum;      //  shut down the clock
 	else
 	{
-		msa = si5351bx_vcoa / fout;     // Integer part of vco/fout
-		msb = si5351bx_vcoa % fout;     // Fractional part of vco/fout
-		msc = fout;                      // Divide by 2 till fits in reg
-		
-		while (msc & 0xfff00000)
-		{
-			msb = msb >> 1;
-			msc = msc >> 1;
-		}
-		
-		msxp1 = (128 * msa + 128 * msb / msc - 512) | (((uint32_t)si5351bx_rdiv) << 20);
-		msxp2 = 128 * msb - 128 * msb / msc * msc; // msxp3 == msc;
-		msxp3p2top = (((msc & 0x0F0000) << 4) | msxp2);     // 2 top nibbles
-		uint8_t vals[8] = { BB1(msc), BB0(msc), BB2(msxp1), BB1(msxp1), BB0(msxp1), BB2(msxp3p2top), BB1(msxp2), BB0(msxp2)};
-		i2cWriten(42 + (clknum * 8), vals, 8); // Write to 8 msynth regs
-		i2cWrite(16 + clknum, 0x0C | si5351bx_drive[clknum]); // use local msynth
+		uint8_t ctrl = 0x0C | si5351bx_drive[clknum];
+
+		si5351bx_write(42 + (clknum * 8), vals, 8); // Write to 8 msynth regs
+		si5351bx_write(16 + clknum, &ctrl, 1); // use local msynth
 		
 		si5351bx_clken &= ~(1 << clknum);   // Clear uint8_t to enable clock
 	}
 	
-	i2cWrite(3, si5351bx_clken);        // Enable/disable clock
+	si5351bx_write(3, &si5351bx_clken, 1);        // Enable/disable clock
+}
+
+
+// Set a CLK to fout Hz
+void si5351bx_setfreq(uint8_t clknum, uint32_t fout) 
+{
+	uint8_t vals[8];
+
+	if (si5351bx_regs(fout, vals))
+		si5351bx_load(clknum, vals);
+	else
+		si5351bx_load(clknum, NULL);
+}
+
+
+// Fine tuning keeps the msynth denominator (P3) at its largest value, so a
+// small step only moves P2 and the shadow sends just registers 5 - 7 of the
+// block in one burst. The drive and enable registers are not touched, no click.
+// The error at 52 MHz is under 1.5 Hz, the shifted denominator of
+// si5351bx_regs() gives up to 2.4 Hz.
+#define FINE_C	0xFFFFF
+
+void si5351bx_finetune(uint8_t clknum, uint32_t fout)
+{
+	uint32_t msa, msb, msxp1, msxp2, msxp3p2top;
+	uint8_t vals[8];
+
+	// the clock has to be running on its own msynth already
+	if ((fout < 500000) || (fout > 109000000) || si5351bx_rdiv
+		|| (si5351bx_clken & (1 << clknum)) || !shadow_known[16 + clknum])
+	{
+		si5351bx_setfreq(clknum, fout);
+		return;
+	}
+
+	msa = si5351bx_vcoa / fout;
+	msb = ((uint64_t)(si5351bx_vcoa % fout) * FINE_C + fout / 2) / fout;
+
+	if (msb == FINE_C)					// rounded up to the next integer
+	{
+		msa++;
+		msb = 0;
+	}
+
+	msxp1 = 128 * msa + 128 * msb / FINE_C - 512;
+	msxp2 = 128 * msb - 128 * msb / FINE_C * FINE_C;
+	msxp3p2top = (((FINE_C & 0x0F0000) << 4) | msxp2);
+
+	vals[0] = BB1(FINE_C);
+	vals[1] = BB0(FINE_C);
+	vals[2] = BB2(msxp1);
+	vals[3] = BB1(msxp1);
+	vals[4] = BB0(msxp1);
+	vals[5] = BB2(msxp3p2top);
+	vals[6] = BB1(msxp2);
+	vals[7] = BB0(msxp2);
+
+	si5351bx_write(42 + (clknum * 8), vals, 8);
+}
+
+
+// Sweep plan, the register blocks for count frequencies from start in step Hz.
+// The plan is rebuilt only when the range, VCOA (calibration) or rdiv changes,
+// a sweep then only replays the blocks over I2C.
+void si5351bx_plan(Sweep_plan *plan, uint32_t start, uint32_t step, uint16_t count)
+{
+	uint16_t i;
+
+	if (count > PLAN_SZ)
+		count = PLAN_SZ;
+
+	if (plan->valid  &&  plan->start == start  &&  plan->step == step  &&  plan->count == count
+		&&  plan->vcoa == si5351bx_vcoa  &&  plan->rdiv == si5351bx_rdiv)
+		return;
+
+	for (i = 0; i < count; i++)
+		plan->on[i] = si5351bx_regs(start + i * step, plan->regs[i]);
+
+	plan->start = start;
+	plan->step = step;
+	plan->count = count;
+	plan->vcoa = si5351bx_vcoa;
+	plan->rdiv = si5351bx_rdiv;
+	plan->valid = true;
+}
+
+
+// Set a CLK to step i of a plan
+void si5351bx_play(Sweep_plan *plan, uint8_t clknum, uint16_t i)
+{
+	if (i >= plan->count)
+		return;
+
+	si5351bx_load(clknum, plan->on[i] ? plan->regs[i] : NULL);
 }
 
 
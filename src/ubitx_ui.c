@@ -115,7 +115,6 @@ const pad_grid_entry pad_grid[MAX_BUTTONS] = {
   {104, 93, '-'}   // extra End entry 
 };
 
-uint16_t pan_data[PAN_SZ];
 void wait4btn_up(void);
 bool getButton(char *text, Button *b);
 void formatFreq(uint32_t f, char *buff); 
@@ -173,6 +172,8 @@ void formatFreq(uint32_t f, char *buff)
 void drawCommandbar(char *text)
 {
   displayRawText(text, 68, 24, DISPLAY_WHITE, DISPLAY_NAVY, A_NORMAL);
+  // painted over the RIT and TX fields, have them restored on the next frame
+  ui_invalidate(68, 24 + TEXT_LINE_HEIGHT, strlen(text) * 16, 16);
 }
 
 
@@ -241,26 +242,147 @@ void displayDialog(char *title, char *instructions)
 	displayRawText(instructions, 20, 190, DISPLAY_WHITE, DISPLAY_NAVY, A_NORMAL);
 }
 
+// Panorama scope, one column per bin inside the frame. sweep_top keeps the
+// top row of every bar on the screen so only the difference is painted.
+#define SWEEP_X		33
+#define SWEEP_TOP	151
+#define SWEEP_BASE	210
+#define SWEEP_MARK	159
+
+static uint8_t sweep_top[PAN_SZ];
+
+// Background of column x, the red centre marker shows above the bars
+static uint16_t sweepBackground(uint16_t x)
+{
+	return (x == SWEEP_MARK || x == SWEEP_MARK + 1) ? DISPLAY_RED : DISPLAY_BLACK;
+}
+
 void clearSweep (void)
 {
 	displayRect(32,150,256, 60, DISPLAY_WHITE);
 	displayFillrect(33,151,254, 58, DISPLAY_BLACK);
+	displayVline(SWEEP_MARK, SWEEP_TOP, SWEEP_BASE - SWEEP_TOP - 1, DISPLAY_RED);
+	displayVline(SWEEP_MARK + 1, SWEEP_TOP, SWEEP_BASE - SWEEP_TOP - 1, DISPLAY_RED);
+	memset(sweep_top, SWEEP_BASE, sizeof(sweep_top));
 }
+
 void displaySweep (void)
 {
-	uint8_t val;
-	uint16_t i;
+	uint8_t top, prev;
+	uint16_t i, x;
+	uint32_t t = time_us_32();
+
+	for (i = 0; i < PAN_SZ; i++)
+	{
+		x = SWEEP_X + i;
+		top = SWEEP_BASE - ((pan_data[i] >> 4) & 0x3C);
+		if (top < SWEEP_TOP)
+			top = SWEEP_TOP;
+
+		prev = sweep_top[i];
+
+		// one vertical window per column, grow in green, shrink with the background
+		if (top < prev)
+			displayVline(x, top, prev - top - 1, DISPLAY_GREENYELLOW);
+		else
+		if (top > prev)
+			displayVline(x, prev, top - prev - 1, sweepBackground(x));
+
+		sweep_top[i] = top;
+	}
+
+	lcd_stats.sweep_us = time_us_32() - t;
+}
+
+
+// Waterfall under the scope. The display runs in landscape, where the ILI9341
+// vertical scroll moves the picture sideways, so the history is kept as a ring
+// instead: every sweep writes one line at wf_row, which then steps down and
+// wraps at the bottom.
+#ifndef WATERFALL_H
+#define WATERFALL_H	28
+#endif
+#define WF_Y		(SWEEP_BASE + 1)
+
+#if WATERFALL_H < 1 || WF_Y + WATERFALL_H > D_HEIGHT
+#error "WATERFALL_H does not fit below the scope"
+#endif
+
+// Colour for the 16 levels displaySweep uses, black through blue, green, yellow to red
+static const uint16_t wf_colours[16] =
+{
+	0x0000, 0x0008, 0x0010, 0x001F, 0x021F, 0x041F, 0x05FF, 0x07F0,
+	0x07E0, 0x47E0, 0x87E0, 0xC7E0, 0xFFE0, 0xFCE0, 0xFA00, 0xF800,
+};
+
+static uint8_t wf_line[PAN_SZ * 2];
+static uint8_t wf_row = 0;
+
+void clearWaterfall (void)
+{
+	displayFillrect(SWEEP_X, WF_Y, PAN_SZ - 1, WATERFALL_H - 1, DISPLAY_BLACK);
+	wf_row = 0;
+}
 
-	displayRect(159,150,1, 60, DISPLAY_RED);
+void displayWaterfall (void)
+{
+	uint16_t i, c;
+
+	// the previous line may still be on its way to the display
+	lcd_wait();
 
 	for (i = 0; i < PAN_SZ; i++)
 	{
-		val = 0xD2 - ((pan_data[i] >> 4) & 0x3C);
-//		displayRect(i + 33, 151, 254, 58, DISPLAY_BLACK);
-		displayRect(i + 32, val, 1, (210 - val), DISPLAY_GREENYELLOW);
-	
+		c = wf_colours[(pan_data[i] >> 6) & 0x0F];
+		wf_line[2 * i] = c >> 8;
+		wf_line[2 * i + 1] = c & 0xFF;
 	}
 
+	displayBitmap(SWEEP_X, WF_Y + wf_row, PAN_SZ, 1, wf_line);
+
+	if (++wf_row >= WATERFALL_H)
+		wf_row = 0;
+}
+
+
+// Horizontal advance of c in the LU_NORMAL frequency readout, see displayText
+static uint16_t freqAdvance(char c)
+{
+	return (c == '.' || c == ':') ? 12 : 24;
+}
+
+
+// Draw the main frequency readout at x, y. shown holds what is on the screen,
+// only characters that differ from it are redrawn, contiguous changes as one
+// text run. A narrow '.' draws into the next cell, so a run never ends on one.
+static void drawFreqDigits(char *text, char *shown, uint16_t x, uint16_t y)
+{
+	char run[12];
+	uint16_t x0;
+	uint8_t i, n;
+
+	i = 0;
+	while (text[i] != '\0')
+	{
+		if (text[i] == shown[i])
+		{
+			x += freqAdvance(text[i++]);
+			continue;
+		}
+
+		x0 = x;
+		n = 0;
+		while (text[i] != '\0'  &&  (text[i] != shown[i]  ||  (n > 0  &&  freqAdvance(run[n - 1]) < 24)))
+		{
+			run[n++] = text[i];
+			x += freqAdvance(text[i++]);
+		}
+		run[n] = '\0';
+
+		displayText((uint8_t *)run, x0, y, DISPLAY_CYAN, DISPLAY_DARKGREEN, LU_NORMAL);
+	}
+
+	strcpy(shown, text);
 }
 
 
@@ -272,12 +394,16 @@ void displayVFO(uint8_t clr)
 	char dbuff[30], buff[30], vbuff[10];
 	
 	static char vfoDisplay[12];
+	static char freqDisplay[12];
+	static char vfoLabel[6];
 	uint8_t digit;
 	bool dirty;
 
 	if (clr == CLEAR_VFO)
 	{
 		memset(vfoDisplay, 0, 12);
+		memset(freqDisplay, 0, 12);
+		memset(vfoLabel, 0, 6);
 	}
 		getButton("VFOA", &b);
 		
@@ -302,16 +428,25 @@ void displayVFO(uint8_t clr)
 	{
 		displayFillrect(b.x, b.y - 1, b.w, b.h + 2, DISPLAY_BLACK);
 	}
-		
-	displayRect(b.x, b.y - 1, b.w , b.h + 2, DISPLAY_WHITE);
 
+	// frames and label only when the readout is redrawn from scratch
+	if (freqDisplay[0] == '\0')
+	{
+		displayRect(b.x, b.y - 1, b.w , b.h + 2, DISPLAY_WHITE);
+		displayRect(57, 1, 181, 33, DISPLAY_BLUE);
+	}
 
 	x = b.x + 2;
 	y = b.y + 2;
 
-	displayRect(57, 1, 181, 33, DISPLAY_BLUE);
-	displayText((uint8_t *)dbuff, 58, 2, DISPLAY_CYAN, DISPLAY_DARKGREEN, LU_NORMAL); 	
-	displayText((uint8_t *)vbuff, 248, 4, DISPLAY_NAVY, DISPLAY_CYAN, A_BOLD);
+	drawFreqDigits(dbuff, freqDisplay, 58, 2);
+
+	if (strcmp(vfoLabel, vbuff))
+	{
+		displayText((uint8_t *)vbuff, 248, 4, DISPLAY_NAVY, DISPLAY_CYAN, A_BOLD);
+		strcpy(vfoLabel, vbuff);
+	}
+
 	dirty = strcmp (vfoDisplay, buff);
 //	printf ("display: %s %s\n", dbuff, vbuff);
 	
@@ -336,29 +471,288 @@ void displayVFO(uint8_t clr)
 
 
 
+// Retained widgets. State changes only mark a widget dirty, ui_compose()
+// repaints what changed once per frame.
+
+#define W_RIT		(MAX_BUTTONS - 1)
+#define W_TX		(W_RIT + 1)
+#define W_STATUS	(W_RIT + 2)
+#define W_SM_FRAME	(W_RIT + 3)
+#define W_SMETER	(W_RIT + 4)
+#define W_SWEEP		(W_RIT + 5)
+#define W_WATERFALL	(W_RIT + 6)
+#define MAX_WIDGETS	(W_RIT + 7)
+#define MAX_DIRTY	8
+
+typedef struct { int x0, y0, x1, y1; } Rect;
+
+static Widget widgets[MAX_WIDGETS];
+
+
+// is the function of button b active right now
+static bool btnSelected(const Button *b)
+{
+	return (!strcmp(b->text, "RIT") && ritOn) || 
+		(!strcmp(b->text, "USB") && (mode == USB)) || 
+		(!strcmp(b->text, "LSB") && (mode == LSB)) || 
+		(!strcmp(b->text, "**") &&  accel_vfo) || 
+		(!strcmp(b->text, "A/B") && split_on) ||
+		(!strcmp(b->text, "CW") && (mode == CW));
+}
+
+
+static void paintButton(const Button *b, bool selected)
+{
+	displayFillrect(b->x, b->y, b->w ,b->h, DISPLAY_BLACK);
+
+	if (selected)
+		displayText((uint8_t *)(b->text), b->x + 4, b->y, DISPLAY_BLACK, DISPLAY_ORANGE, A_BOLD);   
+	else
+		displayText((uint8_t *)(b->text), b->x + 4, b->y, DISPLAY_GREEN, DISPLAY_BLACK, A_BOLD);
+}
+
+
+static void paintBtnWidget(Widget *wg)
+{
+	paintButton(wg->btn, wg->selected);
+	displayRect(wg->x, wg->y, wg->w, wg->h, DISPLAY_BLUE);
+}
+
+
+static void paintText(Widget *wg)
+{
+	displayRawText(wg->text, wg->x, wg->y - TEXT_LINE_HEIGHT, wg->color, wg->bg, wg->font);
+}
+
+
+static void paintFill(Widget *wg)
+{
+	displayFillrect(wg->x, wg->y, wg->w, wg->h, wg->bg);
+}
+
+
+static void paintStatus(Widget *wg)
+{
+	paintFill(wg);
+	// displayRawText moves down one text line, the text ends up where drawCWStatus put it
+	displayRawText(wg->text, wg->x, wg->y - 1, wg->color, wg->bg, wg->font);
+}
+
+
+static void paintTx(Widget *wg)
+{
+	if (wg->value)
+		displayText((uint8_t *)("TX"), wg->x, wg->y, DISPLAY_BLACK, DISPLAY_ORANGE, A_BOLD);  
+	else
+		paintFill(wg);
+}
+
+
+static void paintSmeterFrame(Widget *wg)
+{
+	paintFill(wg);
+	displayRect(wg->x, wg->y, wg->w, wg->h, DISPLAY_GREEN);
+}
+
+
+static void paintSmeter(Widget *wg)
+{
+	uint8_t ch1, ch2;
+	uint16_t ch2_colour;
+
+	if (wg->value < 9)
+	{
+		ch1 = wg->value;
+		ch2 = 0;
+		ch2_colour = DISPLAY_YELLOW;
+	}
+	else
+	{
+		ch1 = 8;
+		ch2 = (wg->value > 9) ? 10 : 9;
+		ch2_colour = DISPLAY_RED;
+	}	
+
+	displayChar(wg->x, wg->y, ch1, DISPLAY_YELLOW, DISPLAY_BLUE, S_METER);
+	displayChar(wg->x + 24, wg->y, ch2, ch2_colour, DISPLAY_BLUE, S_METER);
+}
+
+
+static void paintSweep(Widget *wg)
+{
+	(void)wg;
+	clearSweep();
+}
+
+
+// Only there while sweeping, otherwise the status bar below shows through
+static void paintWaterfall(Widget *wg)
+{
+	(void)wg;
+	if (sweep_on)
+		clearWaterfall();
+}
+
+
+static void widgetInit(Widget *wg, int x, int y, int w, int h, uint16_t bg, void (*paint)(Widget *))
+{
+	memset(wg, 0, sizeof(Widget));
+	wg->x = x;
+	wg->y = y;
+	wg->w = w;
+	wg->h = h;
+	wg->bg = bg;
+	wg->paint = paint;
+	wg->dirty = true;
+}
+
+
+void ui_init(void)
+{
+	int i;
+
+	// btn_set[0] is the VFO readout, displayVFO() owns it
+	for (i = 1; i < MAX_BUTTONS; i++)
+	{
+		widgetInit(&widgets[i - 1], btn_set[i].x, btn_set[i].y, btn_set[i].w, btn_set[i].h, DISPLAY_BLACK, paintBtnWidget);
+		widgets[i - 1].btn = &btn_set[i];
+	}
+
+	widgetInit(&widgets[W_RIT], 68, 24 + TEXT_LINE_HEIGHT, 160, 16, DISPLAY_NAVY, paintText);
+	widgetInit(&widgets[W_TX], 280, 24, 37, 28, DISPLAY_NAVY, paintTx);
+	widgetInit(&widgets[W_STATUS], 0, 201, D_WIDTH - 1, D_HEIGHT - 202, DISPLAY_NAVY, paintStatus);
+	widgetInit(&widgets[W_SM_FRAME], 2, 4, 50, 28, DISPLAY_BLUE, paintSmeterFrame);
+	widgetInit(&widgets[W_SMETER], 4, 10, 47, 19, DISPLAY_BLUE, paintSmeter);
+	// the scope and the waterfall lie over the status bar, a new status text
+	// does not clear them
+	widgetInit(&widgets[W_SWEEP], 32, 150, 256, 60, DISPLAY_BLACK, paintSweep);
+	widgetInit(&widgets[W_WATERFALL], SWEEP_X, WF_Y, PAN_SZ - 1, WATERFALL_H - 1, DISPLAY_BLACK, paintWaterfall);
+	widgets[W_SWEEP].self_drawn = true;
+	widgets[W_WATERFALL].self_drawn = true;
+}
+
+
+static void ui_set_text(Widget *wg, char *text, uint16_t color, uint8_t font)
+{
+	if (strcmp(wg->text, text) || wg->color != color || wg->font != font)
+	{
+		strncpy(wg->text, text, sizeof(wg->text) - 1);
+		wg->color = color;
+		wg->font = font;
+		wg->dirty = true;
+	}
+}
+
+
+static void ui_set_value(Widget *wg, int value)
+{
+	if (wg->value != value)
+	{
+		wg->value = value;
+		wg->dirty = true;
+	}
+}
+
+
+static bool rectOverlap(Rect *a, Rect *b)
+{
+	return a->x0 <= b->x1 && b->x0 <= a->x1 && a->y0 <= b->y1 && b->y0 <= a->y1;
+}
+
+
+static void widgetRect(Widget *wg, Rect *r)
+{
+	r->x0 = wg->x;
+	r->y0 = wg->y;
+	r->x1 = wg->x + wg->w;
+	r->y1 = wg->y + wg->h;
+}
+
+
+// Mark every widget touching the area dirty, used after painting over them
+void ui_invalidate(int x, int y, int w, int h)
+{
+	Rect a = {x, y, x + w, y + h};
+	Rect r;
+
+	for (int i = 0; i < MAX_WIDGETS; i++)
+	{
+		widgetRect(&widgets[i], &r);
+		if (rectOverlap(&a, &r))
+			widgets[i].dirty = true;
+	}
+}
+
+
+// Repaint what changed since the last frame. Widgets are painted in list order,
+// a later one lies on top. A widget is painted when it is dirty or when a widget
+// under it was painted over it, the area of every painted widget is collected
+// for that. A widget painted again damages nothing under it, so a new S-meter
+// value leaves its frame alone. Self drawn widgets, the scope and the
+// waterfall, are only painted when dirty themselves, a paint would clear what
+// they hold.
+void ui_compose(void)
+{
+	Rect painted[MAX_DIRTY];
+	Rect r;
+	int n = 0;
+	int i, j;
+	bool paint;
+
+	// buttons follow the radio state
+	for (i = 0; i < W_RIT; i++)
+	{
+		if (widgets[i].selected != btnSelected(widgets[i].btn))
+		{
+			widgets[i].selected = !widgets[i].selected;
+			widgets[i].dirty = true;
+		}
+	}
+
+	for (i = 0; i < MAX_WIDGETS; i++)
+	{
+		widgetRect(&widgets[i], &r);
+
+		paint = widgets[i].dirty;
+		for (j = 0; j < n && !paint && !widgets[i].self_drawn; j++)
+			paint = rectOverlap(&r, &painted[j]);
+
+		widgets[i].dirty = false;
+		if (!paint)
+			continue;
+
+		widgets[i].paint(&widgets[i]);
+
+		if (n == MAX_DIRTY)
+		{
+			painted[0].x0 = MIN(r.x0, painted[0].x0);
+			painted[0].y0 = MIN(r.y0, painted[0].y0);
+			painted[0].x1 = MAX(r.x1, painted[0].x1);
+			painted[0].y1 = MAX(r.y1, painted[0].y1);
+		}
+		else
+			painted[n++] = r;
+	}
+}
+
+
 void btnDraw(Button *b)
 {
 	if (!strcmp(b->text, "VFOA"))
 	{
 		displayVFO(KEEP_VFO);
+		return;
 	}
-	else
-	{	
-		displayFillrect(b->x, b->y, b->w ,b->h, DISPLAY_BLACK);
-
-		if (
-			(!strcmp(b->text, "RIT") && ritOn) || 
-			(!strcmp(b->text, "USB") && (mode == USB)) || 
-			(!strcmp(b->text, "LSB") && (mode == LSB)) || 
-			(!strcmp(b->text, "**") &&  accel_vfo) || 
-			(!strcmp(b->text, "A/B") && split_on))
-				displayText((uint8_t *)(b->text), b->x + 4, b->y, DISPLAY_BLACK, DISPLAY_ORANGE, A_BOLD);   
-		else
-		if (!strcmp(b->text, "CW") && (mode == CW))
-			displayText((uint8_t *)(b->text), b->x + 4, b->y, DISPLAY_BLACK, DISPLAY_ORANGE, A_BOLD );   
-		else
-			displayText((uint8_t *)(b->text), b->x + 4, b->y, DISPLAY_GREEN, DISPLAY_BLACK, A_BOLD);
+
+	for (int i = 0; i < W_RIT; i++)
+	{
+		// one of btn_set, the compositor picks the new state up
+		if (!strcmp(b->text, widgets[i].btn->text))
+			return;
 	}
+
+	// keypad and other transient buttons are painted right away
+	paintButton(b, btnSelected(b));
 }
 
 void displayRIT(void)
@@ -369,11 +763,11 @@ void displayRIT(void)
 	{
 		strcpy(cbuff, "Tx: ");
 		formatFreq(ritTxFrequency, &cbuff[2]);
-		displayRawText(cbuff, 68, 24, DISPLAY_ORANGE, DISPLAY_NAVY, A_BOLD);
+		ui_set_text(&widgets[W_RIT], cbuff, DISPLAY_ORANGE, A_BOLD);
 	}
 	else 
 	{
-      displayRawText("          ", 68, 24, DISPLAY_WHITE, DISPLAY_NAVY, A_NORMAL);
+		ui_set_text(&widgets[W_RIT], "          ", DISPLAY_WHITE, A_NORMAL);
 	}
 }
 
@@ -498,7 +892,6 @@ void drawCWStatus(void)
 {
 	char buff[30], cbuff[30];
 	
-	displayFillrect(0, 201, 320, 39, DISPLAY_NAVY);
 	strcpy(buff, "CW:");
 	int wpm = 1200/cwSpeed;    
 	itoa(wpm,cbuff, 10);
@@ -509,7 +902,7 @@ void drawCWStatus(void)
 	strcat(buff, "hz");
 	strcat(buff, " V:1.0");
 	
-	displayRawText(buff, 0, 200, DISPLAY_CYAN, DISPLAY_NAVY, A_NORMAL);  
+	ui_set_text(&widgets[W_STATUS], buff, DISPLAY_CYAN, A_NORMAL);
 }
 
 
@@ -517,10 +910,7 @@ void drawTx(void)
 {
 		printf ("mode %d\n", mode);
 
-	if (inTx)
-		displayText((uint8_t *)("TX"), 280, 24, DISPLAY_BLACK, DISPLAY_ORANGE, A_BOLD);  
-	else
-		displayFillrect(280, 24, 37, 28, DISPLAY_NAVY);
+	ui_set_value(&widgets[W_TX], inTx);
 }
 
 void drawStatusbar(void)
@@ -550,55 +940,24 @@ uint8_t get_s_value(uint8_t max)
 void guiUpdate(bool redraw)
 {
 	displayVFO(redraw);
-	
-	for (int i = 0; i < MAX_BUTTONS; i++)
-	{
-		Button b;
-		memcpy(&b, btn_set + i, sizeof(Button));
-		btnDraw(&b);
-		displayRect(b.x, b.y, b.w, b.h, DISPLAY_BLUE);
-	}
-	
+
+	// the screen has been cleared, everything has to be painted again
+	if (redraw)
+		ui_invalidate(0, 0, D_WIDTH, D_HEIGHT);
 	
 	displayRIT();
 	drawStatusbar();
+	ui_compose();
 }
 
 
 
 void draw_s_meter (bool redraw)
 {
-	uint8_t ch1, ch2;
-	uint8_t x, y;
-	uint8_t s = get_s_value(11);
-	uint16_t ch2_colour;
-
 	if (redraw)
-	{
-		displayFillrect(2, 4, 50, 28, DISPLAY_BLUE);
-		displayRect(2, 4, 50, 28, DISPLAY_GREEN);
-	}
-	
-	if (s < 9)
-	{
-		ch1 = s;
-		ch2 = 0;
-		ch2_colour = DISPLAY_YELLOW;
+		widgets[W_SM_FRAME].dirty = true;
 
-	}
-	else
-	{
-		ch1 = 8;
-		ch2 = (s > 9) ? 10 : 9;
-		ch2_colour = DISPLAY_RED;
-		
-	}	
- 	x = 4;
-	y = 10;
-	
-	displayChar(x, y, ch1, DISPLAY_YELLOW, DISPLAY_BLUE, S_METER);
-	displayChar(x + 24, y, ch2, ch2_colour, DISPLAY_BLUE, S_METER);
-		
+	ui_set_value(&widgets[W_SMETER], get_s_value(11));
 }
 
 
@@ -757,7 +1116,8 @@ int setCwSpeed(void)
   
     cwSpeed = wpm;
 
-    e_put(CW_SPEED, cwSpeed);
+    settings.cw_speed = cwSpeed;
+	settings_save();
 	set_cw_speed (wpm);
     sleep_ms(25);
 	printf ("wpm %d cwSpeed %d\n", wpm, cwSpeed);
@@ -799,7 +1159,8 @@ void setCwTone(void)
 		}
 	}
 //	noTone(CW_TONE);
-	e_put(CW_SIDETONE, sideTone);
+	settings.cw_sidetone = sideTone;
+	settings_save();
 	set_cw_mon_freq (sideTone);
 
 
@@ -826,7 +1187,11 @@ void exec_command(Button *b)
 		cwToggle(b);
 	else
 	if (!strcmp(b->text, "FRQ"))
+	{
 		sweep_on = !sweep_on;
+		widgets[W_SWEEP].dirty = true;
+		widgets[W_WATERFALL].dirty = true;
+	}
 	else
 	if (!strcmp(b->text, "VFOA"))
 	{
@@ -864,7 +1229,11 @@ void exec_command(Button *b)
 		switchBand(28000000l);  
 	else
 	if (!strcmp(b->text, "<|>"))
+	{
 		sweep_on = !sweep_on;
+		widgets[W_SWEEP].dirty = true;
+		widgets[W_WATERFALL].dirty = true;
+	}
 	else
 	if (!strcmp(b->text, "WPM"))
 		setCwSpeed();
@@ -0,0 +1,149 @@
+// USB descriptors for the composite CDC device
+//
+// SM0KBW
+
+#include <stdint.h>
+#include <string.h>
+#include "tusb.h"
+#include "pico/unique_id.h"
+
+// TinyUSB example VID, use your own PID range for anything distributed
+#define USB_VID		0xCAFE
+#define USB_PID		0x4003
+#define USB_BCD		0x0200
+
+enum
+{
+	ITF_NUM_CAT = 0,
+	ITF_NUM_CAT_DATA,
+	ITF_NUM_TELEMETRY,
+	ITF_NUM_TELEMETRY_DATA,
+	ITF_NUM_CONSOLE,
+	ITF_NUM_CONSOLE_DATA,
+	ITF_NUM_TOTAL
+};
+
+enum
+{
+	STRID_LANGID = 0,
+	STRID_MANUFACTURER,
+	STRID_PRODUCT,
+	STRID_SERIAL,
+	STRID_CAT,
+	STRID_TELEMETRY,
+	STRID_CONSOLE,
+};
+
+#define CONFIG_TOTAL_LEN	(TUD_CONFIG_DESC_LEN + CFG_TUD_CDC * TUD_CDC_DESC_LEN)
+
+// notification, OUT and IN endpoint per port
+#define EP_CAT_NOTIF		0x81
+#define EP_CAT_OUT			0x02
+#define EP_CAT_IN			0x82
+#define EP_TELEMETRY_NOTIF	0x83
+#define EP_TELEMETRY_OUT	0x04
+#define EP_TELEMETRY_IN		0x84
+#define EP_CONSOLE_NOTIF	0x85
+#define EP_CONSOLE_OUT		0x06
+#define EP_CONSOLE_IN		0x86
+
+
+static const tusb_desc_device_t desc_device =
+{
+	.bLength			= sizeof(tusb_desc_device_t),
+	.bDescriptorType	= TUSB_DESC_DEVICE,
+	.bcdUSB				= USB_BCD,
+
+	// interface association, needed for more than one CDC
+	.bDeviceClass		= TUSB_CLASS_MISC,
+	.bDeviceSubClass	= MISC_SUBCLASS_COMMON,
+	.bDeviceProtocol	= MISC_PROTOCOL_IAD,
+	.bMaxPacketSize0	= CFG_TUD_ENDPOINT0_SIZE,
+
+	.idVendor			= USB_VID,
+	.idProduct			= USB_PID,
+	.bcdDevice			= 0x0100,
+
+	.iManufacturer		= STRID_MANUFACTURER,
+	.iProduct			= STRID_PRODUCT,
+	.iSerialNumber		= STRID_SERIAL,
+
+	.bNumConfigurations	= 1
+};
+
+
+static const uint8_t desc_configuration[] =
+{
+	TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0x00, 100),
+
+	// interface, string, notification endpoint and size, data OUT, IN and size
+	TUD_CDC_DESCRIPTOR(ITF_NUM_CAT, STRID_CAT, EP_CAT_NOTIF, 8, EP_CAT_OUT, EP_CAT_IN, 64),
+	TUD_CDC_DESCRIPTOR(ITF_NUM_TELEMETRY, STRID_TELEMETRY, EP_TELEMETRY_NOTIF, 8, EP_TELEMETRY_OUT, EP_TELEMETRY_IN, 64),
+	TUD_CDC_DESCRIPTOR(ITF_NUM_CONSOLE, STRID_CONSOLE, EP_CONSOLE_NOTIF, 8, EP_CONSOLE_OUT, EP_CONSOLE_IN, 64),
+};
+
+
+static const char *desc_strings[] =
+{
+	NULL,						// language, handled below
+	"SM0KBW",
+	"pbitx",
+	NULL,						// serial, the flash unique id
+	"pbitx CAT",
+	"pbitx telemetry",
+	"pbitx console",
+};
+
+
+const uint8_t *tud_descriptor_device_cb (void)
+{
+	return (const uint8_t *)&desc_device;
+}
+
+
+const uint8_t *tud_descriptor_configuration_cb (uint8_t index)
+{
+	(void)index;
+	return desc_configuration;
+}
+
+
+const uint16_t *tud_descriptor_string_cb (uint8_t index, uint16_t langid)
+{
+	static uint16_t desc_str[33];
+	char serial[2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+	const char *str;
+	uint8_t i, n;
+
+	(void)langid;
+
+	if (index == STRID_LANGID)
+	{
+		desc_str[1] = 0x0409;			// English
+		n = 1;
+	}
+	else
+	{
+		if (index >= sizeof(desc_strings) / sizeof(desc_strings[0]))
+			return NULL;
+
+		if (index == STRID_SERIAL)
+		{
+			pico_get_unique_board_id_string (serial, sizeof(serial));
+			str = serial;
+		}
+		else
+			str = desc_strings[index];
+
+		n = strlen (str);
+		if (n > 32)
+			n = 32;
+
+		for (i = 0; i < n; i++)
+			desc_str[1 + i] = str[i];
+	}
+
+	desc_str[0] = (TUSB_DESC_STRING << 8) | (2 * n + 2);
+
+	return desc_str;
+}
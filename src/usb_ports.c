@@ -0,0 +1,159 @@
+// USB CDC ports. CI-V, telemetry and the debug console each have their own
+// CDC interface so printf can never end up inside a CAT frame.
+//
+// Nothing here blocks: a write takes what fits in the TinyUSB FIFO and a
+// port without a host (DTR low) swallows its data. printf goes to a ring
+// first, it is called from interrupts too, and usb_task() moves the ring
+// to the console port from the main loop.
+//
+// SM0KBW
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/stdlib.h"
+#include "pico/stdio/driver.h"
+#include "hardware/sync.h"
+#include "tusb.h"
+#include "usb_ports.h"
+
+usb_counters usb_stats[USB_PORTS];
+
+static char console_ring[USB_CONSOLE_SZ];
+static volatile uint16_t console_head = 0;
+static uint16_t console_tail = 0;
+
+
+static void console_out (const char *buf, int len)
+{
+	uint32_t ints;
+
+	ints = save_and_disable_interrupts ();
+
+	while (len-- > 0)
+	{
+		if ((uint16_t)(console_head - console_tail) < USB_CONSOLE_SZ)
+			console_ring[console_head++ % USB_CONSOLE_SZ] = *buf;
+		else
+			usb_stats[USB_CONSOLE].tx_dropped++;
+		buf++;
+	}
+
+	restore_interrupts (ints);
+}
+
+
+static int console_in (char *buf, int len)
+{
+	uint32_t n;
+
+	n = usb_read (USB_CONSOLE, (uint8_t *)buf, len);
+
+	return n ? (int)n : PICO_ERROR_NO_DATA;
+}
+
+
+static stdio_driver_t usb_console =
+{
+	.out_chars = console_out,
+	.in_chars = console_in,
+	.crlf_enabled = true,
+};
+
+
+void usb_init (void)
+{
+	tusb_init ();
+	stdio_set_driver_enabled (&usb_console, true);
+}
+
+
+// Service the USB stack and the console ring, called from the main loop
+void usb_task (void)
+{
+	uint8_t port;
+	uint32_t n;
+	uint16_t head;
+
+	tud_task ();
+
+	head = console_head;
+	while (console_tail != head)
+	{
+		// contiguous part of the ring
+		n = head - console_tail;
+		if (console_tail % USB_CONSOLE_SZ + n > USB_CONSOLE_SZ)
+			n = USB_CONSOLE_SZ - console_tail % USB_CONSOLE_SZ;
+
+		n = usb_write (USB_CONSOLE, (uint8_t *)&console_ring[console_tail % USB_CONSOLE_SZ], n);
+		if (n == 0)
+			break;
+		console_tail += n;
+	}
+
+	for (port = 0; port < USB_PORTS; port++)
+		if (tud_cdc_n_connected (port))
+			tud_cdc_n_write_flush (port);
+}
+
+
+bool usb_connected (uint8_t port)
+{
+	return tud_cdc_n_connected (port);
+}
+
+
+uint32_t usb_read (uint8_t port, uint8_t *buf, uint32_t len)
+{
+	uint32_t n;
+
+	if (!tud_cdc_n_available (port))
+		return 0;
+
+	n = tud_cdc_n_read (port, buf, len);
+	usb_stats[port].rx_bytes += n;
+
+	return n;
+}
+
+
+uint32_t usb_write_space (uint8_t port)
+{
+	if (!tud_cdc_n_connected (port))
+		return 0;
+
+	return tud_cdc_n_write_available (port);
+}
+
+
+// Returns how much of buf was taken, without a host everything is dropped
+uint32_t usb_write (uint8_t port, const uint8_t *buf, uint32_t len)
+{
+	uint32_t n;
+
+	if (!tud_cdc_n_connected (port))
+	{
+		usb_stats[port].tx_dropped += len;
+		return len;
+	}
+
+	n = tud_cdc_n_write_available (port);
+	if (n > len)
+		n = len;
+
+	n = tud_cdc_n_write (port, buf, n);
+	usb_stats[port].tx_bytes += n;
+
+	return n;
+}
+
+
+void usb_stats_print (void)
+{
+	uint8_t p;
+
+	for (p = 0; p < USB_PORTS; p++)
+		printf ("usb%d: rx %lu tx %lu bytes, %lu dropped\n", p,
+			usb_stats[p].rx_bytes, usb_stats[p].tx_bytes, usb_stats[p].tx_dropped);
+}
@@ -0,0 +1,32 @@
+// USB CDC ports of the composite device
+#ifndef _USB_PORTS_
+#define _USB_PORTS_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define USB_CAT			0		// CI-V or Kenwood ASCII CAT
+#define USB_TELEMETRY	1		// binary panorama stream
+#define USB_CONSOLE		2		// printf
+#define USB_PORTS		3
+
+#define USB_CONSOLE_SZ	1024	// console ring, power of two
+
+typedef struct
+{
+	uint32_t rx_bytes;
+	uint32_t tx_bytes;
+	uint32_t tx_dropped;		// no host or no room
+} usb_counters;
+
+extern usb_counters usb_stats[USB_PORTS];
+
+void usb_init (void);
+void usb_task (void);
+bool usb_connected (uint8_t port);
+uint32_t usb_read (uint8_t port, uint8_t *buf, uint32_t len);
+uint32_t usb_write (uint8_t port, const uint8_t *buf, uint32_t len);
+uint32_t usb_write_space (uint8_t port);
+void usb_stats_print (void);
+
+#endif // _USB_PORTS_
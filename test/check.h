@@ -0,0 +1,30 @@
+// Minimal checks for the host tests, a failed check is reported and counted,
+// main() returns check_result()
+#ifndef _CHECK_H_
+#define _CHECK_H_
+
+#include <stdio.h>
+
+static int check_failures = 0;
+
+#define CHECK(c) do { \
+	if (!(c)) { \
+		fprintf (stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #c); \
+		check_failures++; \
+	} } while (0)
+
+#define CHECK_EQ(a, b) do { \
+	long long a_ = (long long)(a), b_ = (long long)(b); \
+	if (a_ != b_) { \
+		fprintf (stderr, "%s:%d: check failed: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, a_, b_); \
+		check_failures++; \
+	} } while (0)
+
+static inline int check_result (void)
+{
+	if (check_failures)
+		fprintf (stderr, "%d checks failed\n", check_failures);
+	return check_failures != 0;
+}
+
+#endif
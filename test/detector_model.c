@@ -0,0 +1,126 @@
+// Detector model, see detector_model.h
+
+#include <string.h>
+#include <math.h>
+#include "host.h"
+#include "si5351_model.h"
+#include "detector_model.h"
+
+#define EVENTS		16
+
+detector_model detector;
+
+// Where the detector is heading from t on
+static struct {
+	uint64_t t;
+	double target;
+} event[EVENTS];
+static uint8_t ev_head, ev_count;
+
+static double level, target;
+static uint64_t t_level;		// level is the output at this time, the last sample
+static uint32_t rnd;
+
+
+double detector_level (uint32_t rf)
+{
+	double v = detector.floor, d;
+	uint8_t i;
+
+	for (i = 0; i < detector.carriers; i++)
+	{
+		d = ((double)rf - detector.carrier[i].freq) / (detector.bw / 2);
+		v += detector.carrier[i].level / (1 + d * d);
+	}
+
+	return v;
+}
+
+
+static void push (uint64_t t, double to)
+{
+	if (ev_count == EVENTS)
+		return;
+	event[(ev_head + ev_count++) % EVENTS].t = t;
+	event[(ev_head + ev_count - 1) % EVENTS].target = to;
+}
+
+
+static void settle (uint64_t t)
+{
+	if (t > t_level)
+	{
+		level = target + (level - target) * exp (-(double)(t - t_level) / detector.tau_ns);
+		t_level = t;
+	}
+}
+
+
+static void on_write (uint8_t clk)
+{
+	if (clk != 2)
+		return;
+
+	// the first register changed before a sample that has been taken on the old LO
+	if (host_i2c_data_ns < t_level)
+		detector.late_retunes++;
+
+	push (host_i2c_data_ns, detector.junk);
+	push (host_i2c_stop_ns, detector_level ((uint32_t)(si5351_model_freq (2) + 0.5) - detector.if_freq));
+}
+
+
+// Gaussian enough, the sum of four uniform draws
+static double noise (void)
+{
+	double s = 0;
+	uint8_t i;
+
+	for (i = 0; i < 4; i++)
+	{
+		rnd = rnd * 1103515245 + 12345;
+		s += (double)(rnd >> 8) / (1 << 24) - 0.5;
+	}
+
+	return s * sqrt (3.0) * detector.noise;
+}
+
+
+static uint16_t sample (uint8_t input, uint64_t t_ns)
+{
+	double v;
+
+	(void)input;
+	while (ev_count  &&  event[ev_head].t <= t_ns)
+	{
+		settle (event[ev_head].t);
+		target = event[ev_head].target;
+		ev_head = (ev_head + 1) % EVENTS;
+		ev_count--;
+	}
+	settle (t_ns);
+	detector.samples++;
+
+	v = level + noise () + 0.5;
+	return v < 0 ? 0 : v > 4095 ? 4095 : (uint16_t)v;
+}
+
+
+void detector_model_attach (uint32_t if_freq)
+{
+	memset (&detector, 0, sizeof(detector));
+	detector.if_freq = if_freq;
+	detector.floor = 400;
+	detector.bw = 2400;
+	detector.tau_ns = 5000;
+	detector.junk = 4095;
+	detector.noise = 20;
+
+	ev_head = ev_count = 0;
+	level = target = detector.floor;
+	t_level = host_ns;
+	rnd = 11;
+
+	si5351.on_write = on_write;
+	host_adc_hook = sample;
+}
@@ -0,0 +1,40 @@
+// The log detector behind the panorama. It follows the Si5351 model's CLK2,
+// the level is the spectrum below at CLK2 minus the first IF, reached with a
+// first order settling after every retune. While a retune is on the wire the
+// msynth is between values and the detector sees junk. The ADC samples it
+// with noise at the times the host SDK gives.
+
+#ifndef _DETECTOR_MODEL_H_
+#define _DETECTOR_MODEL_H_
+
+#include <stdint.h>
+
+#define DETECTOR_CARRIERS	8
+
+typedef struct {
+	uint32_t freq;				// Hz
+	double level;				// ADC counts above the floor
+} detector_carrier;
+
+typedef struct {
+	uint32_t if_freq;			// subtracted from CLK2
+	double floor;				// ADC counts
+	double bw;					// half power width of a carrier, Hz
+	double tau_ns;				// settling time constant
+	double junk;				// level while a retune is on the wire
+	double noise;				// rms per sample, ADC counts
+	detector_carrier carrier[DETECTOR_CARRIERS];
+	uint8_t carriers;
+	uint32_t samples;
+	uint32_t late_retunes;		// retunes that moved the LO under a sample already taken
+} detector_model;
+
+extern detector_model detector;
+
+// Hook into the Si5351 model and the ADC with the defaults
+void detector_model_attach (uint32_t if_freq);
+
+// Settled level at an RF frequency
+double detector_level (uint32_t rf);
+
+#endif
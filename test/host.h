@@ -0,0 +1,77 @@
+// Test side of the host SDK. sdk_host.c runs the firmware against a virtual
+// clock, the models for the display, the Si5351, the detector and the USB
+// host hook in through the pointers below.
+//
+// Time only moves when the firmware sleeps, reads the clock or waits for a
+// transfer, and every one of those calls runs host_poll(), that is where
+// the simulated interrupts fire.
+
+#ifndef _HOST_H_
+#define _HOST_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+#define HOST_GPIOS		30
+#define HOST_DMA_CH		12
+#define HOST_CDC_PORTS	3
+
+// Virtual clock in ns, time_us_32() costs a microsecond so polling loops end
+extern uint64_t host_ns;
+extern uint64_t host_sleep_us;		// time spent in sleep_us() and sleep_ms()
+
+// Pin levels and an observer for output changes
+extern bool host_gpio[HOST_GPIOS];
+extern void (*host_gpio_hook)(unsigned pin, bool level);
+
+// One SPI frame of bits (8 or 16) as it leaves spi0, MSB first
+extern void (*host_spi_hook)(uint16_t frame, uint8_t bits);
+extern uint32_t host_spi_baud;
+
+// I2C target. Gets every transaction when its STOP goes out, returns false
+// to NACK it. host_i2c_nack makes the next n address phases fail.
+extern bool (*host_i2c_hook)(uint8_t addr, const uint8_t *data, size_t len);
+extern uint32_t host_i2c_nack;
+extern uint32_t host_i2c_baud;
+
+// Wire times of the transaction host_i2c_hook is given, the end of its first
+// byte after the register address and the STOP
+extern uint64_t host_i2c_data_ns, host_i2c_stop_ns;
+
+// ADC sample of input at time t_ns, called for adc_read() and for every
+// sample of a free running capture as its conversion completes
+extern uint16_t (*host_adc_hook)(uint8_t input, uint64_t t_ns);
+#define HOST_ADC_SAMPLE_NS	2000
+
+// Flash, host_flash[] backs XIP_BASE. host_flash_cut counts flash operations
+// down, the one that takes it to zero is torn half way and longjmps to
+// host_flash_jmp, the power cut.
+extern uint32_t host_flash_cut;
+extern jmp_buf host_flash_jmp;
+extern uint32_t host_flash_erases[];	// per sector
+extern uint32_t host_flash_programs;
+
+// UART0 both ways
+void host_uart_rx (const uint8_t *data, size_t len);
+size_t host_uart_tx (uint8_t *data, size_t max);
+
+// USB CDC interfaces as seen from the PC. A port the PC has not opened
+// drops what is flushed, one it does not read fills up.
+extern bool host_cdc_connected[HOST_CDC_PORTS];
+void host_cdc_rx (uint8_t port, const uint8_t *data, size_t len);
+size_t host_cdc_tx (uint8_t port, uint8_t *data, size_t max);
+
+// Text as the firmware's printf hands it to the stdio driver it enabled,
+// printf itself stays on the host's stdout
+void host_stdio_out (const char *buf, int len);
+
+// Run the device models and any interrupt that is due
+void host_poll (void);
+void host_run_us (uint32_t us);
+
+// Back to power up, clears every model and the clock
+void host_reset (void);
+
+#endif
@@ -0,0 +1,297 @@
+// ILI9341 model, see ili9341_emu.h
+//
+// Only what the driver uses is decoded: SWRESET, SLPOUT, DISPON, MADCTL,
+// PIXFMT, CASET, PASET and RAMWR. The other commands take their parameters
+// and are otherwise ignored. Timing follows the datasheet, 5 ms from SWRESET
+// to the next command and 120 ms from SWRESET to SLPOUT.
+
+#include <stdio.h>
+#include <string.h>
+#include "host.h"
+#include "ili9341.h"
+#include "ili9341_emu.h"
+
+#define RESET_CMD_NS	5000000ull
+#define RESET_SLPOUT_NS	120000000ull
+#define SLPOUT_CMD_NS	5000000ull
+
+ili9341 ili;
+
+static uint8_t cs_pin, dc_pin;
+static bool selected;
+static uint8_t cmd;
+static uint8_t arg[4];
+static uint8_t nargs;
+static uint16_t sc, ec, sp, ep;			// column and page window
+static uint16_t col, page;
+static bool hi_pending;
+static uint8_t hi;
+static uint64_t reset_ns, slpout_ns;
+static bool after_reset, after_slpout;	// the next command is checked against the delay
+static uint64_t frame_ns, frame_sleep;
+
+
+static void gpio_change (unsigned pin, bool level)
+{
+	if (pin == cs_pin)
+	{
+		if (!level  &&  !selected)
+			ili.frame.cs_toggles++;
+		selected = !level;
+	}
+}
+
+
+static void ram_pixel (uint16_t c)
+{
+	uint16_t x = col, y = page;
+	uint16_t t;
+
+	// the address counter runs in the MADCTL orientation
+	if (ili.madctl & MADCTL_MV)
+	{
+		t = x;
+		x = y;
+		y = t;
+	}
+	if (ili.madctl & MADCTL_MX)
+		x = ILI_GRAM_W - 1 - x;
+	if (ili.madctl & MADCTL_MY)
+		y = ILI_GRAM_H - 1 - y;
+
+	if (x < ILI_GRAM_W  &&  y < ILI_GRAM_H  &&  page <= ep)
+	{
+		ili.gram[y][x] = c;
+		ili.frame.pixels++;
+	}
+	else
+	{
+		if (!ili.frame.clipped)
+			fprintf (stderr, "ili9341: pixel %u,%u outside the panel or window\n", col, page);
+		ili.frame.clipped++;
+	}
+
+	if (++col > ec)
+	{
+		col = sc;
+		page++;
+	}
+}
+
+
+static void command (uint8_t c)
+{
+	if (after_reset  &&  host_ns - reset_ns < RESET_CMD_NS)
+	{
+		fprintf (stderr, "ili9341: command %02x %llu us after SWRESET\n", c, (unsigned long long)(host_ns - reset_ns) / 1000);
+		ili.timing_errors++;
+	}
+	if (after_slpout  &&  host_ns - slpout_ns < SLPOUT_CMD_NS)
+	{
+		fprintf (stderr, "ili9341: command %02x %llu us after SLPOUT\n", c, (unsigned long long)(host_ns - slpout_ns) / 1000);
+		ili.timing_errors++;
+	}
+	after_reset = false;
+	after_slpout = false;
+
+	cmd = c;
+	nargs = 0;
+	hi_pending = false;
+	ili.frame.commands++;
+
+	switch (c)
+	{
+		case ILI9341_SWRESET:
+			ili.madctl = 0;
+			ili.pixfmt = 0x66;
+			ili.sleeping = true;
+			ili.display_on = false;
+			sc = sp = 0;
+			ec = ILI_GRAM_W - 1;
+			ep = ILI_GRAM_H - 1;
+			reset_ns = host_ns;
+			after_reset = true;
+			break;
+
+		case ILI9341_SLPOUT:
+			if (host_ns - reset_ns < RESET_SLPOUT_NS)
+			{
+				fprintf (stderr, "ili9341: SLPOUT %llu us after SWRESET\n", (unsigned long long)(host_ns - reset_ns) / 1000);
+				ili.timing_errors++;
+			}
+			ili.sleeping = false;
+			slpout_ns = host_ns;
+			after_slpout = true;
+			break;
+
+		case ILI9341_DISPON:
+			ili.display_on = true;
+			break;
+
+		case ILI9341_RAMWR:
+			col = sc;
+			page = sp;
+			break;
+	}
+}
+
+
+static void data (uint8_t d)
+{
+	if (cmd == ILI9341_RAMWR)
+	{
+		if (!hi_pending)
+		{
+			hi = d;
+			hi_pending = true;
+		}
+		else
+		{
+			ram_pixel ((hi << 8) | d);
+			hi_pending = false;
+		}
+		return;
+	}
+
+	if (nargs < sizeof(arg))
+		arg[nargs] = d;
+	nargs++;
+
+	switch (cmd)
+	{
+		case ILI9341_MADCTL:
+			ili.madctl = d;
+			break;
+
+		case ILI9341_PIXFMT:
+			ili.pixfmt = d;
+			break;
+
+		case ILI9341_CASET:
+			if (nargs == 4)
+			{
+				sc = (arg[0] << 8) | arg[1];
+				ec = (arg[2] << 8) | arg[3];
+			}
+			break;
+
+		case ILI9341_PASET:
+			if (nargs == 4)
+			{
+				sp = (arg[0] << 8) | arg[1];
+				ep = (arg[2] << 8) | arg[3];
+			}
+			break;
+	}
+}
+
+
+static void spi_frame (uint16_t frame, uint8_t bits)
+{
+	if (!selected)
+	{
+		ili.frame.stray += bits / 8;
+		return;
+	}
+
+	ili.frame.bytes += bits / 8;
+
+	if (!host_gpio[dc_pin])
+	{
+		command (bits == 16 ? frame & 0xff : frame);
+		return;
+	}
+
+	if (bits == 16)
+		data (frame >> 8);
+	data (frame);
+}
+
+
+void ili_attach (uint8_t cs, uint8_t dc)
+{
+	memset (&ili, 0, sizeof(ili));
+	cs_pin = cs;
+	dc_pin = dc;
+	selected = false;
+	cmd = 0;
+	reset_ns = slpout_ns = 0;
+	after_reset = after_slpout = false;
+	ili.sleeping = true;
+	ec = ILI_GRAM_W - 1;
+	ep = ILI_GRAM_H - 1;
+	host_spi_hook = spi_frame;
+	host_gpio_hook = gpio_change;
+	ili_frame_start ();
+}
+
+
+void ili_frame_start (void)
+{
+	memset (&ili.frame, 0, sizeof(ili.frame));
+	frame_ns = host_ns;
+	frame_sleep = host_sleep_us;
+}
+
+
+ili_counters ili_frame_end (void)
+{
+	ili.frame.sleep_us = host_sleep_us - frame_sleep;
+	ili.frame.elapsed_us = (host_ns - frame_ns) / 1000;
+	return ili.frame;
+}
+
+
+// The panel is mounted so that the GRAM rows run along the landscape x axis
+uint16_t ili_pixel (uint16_t x, uint16_t y)
+{
+	return ili.gram[x][y];
+}
+
+
+bool ili_write_ppm (const char *path)
+{
+	FILE *f = fopen (path, "wb");
+	uint16_t x, y, c;
+
+	if (!f)
+		return false;
+
+	fprintf (f, "P6\n%d %d\n255\n", ILI_VIEW_W, ILI_VIEW_H);
+	for (y = 0; y < ILI_VIEW_H; y++)
+	{
+		for (x = 0; x < ILI_VIEW_W; x++)
+		{
+			c = ili_pixel (x, y);
+			fputc (((c >> 11) & 0x1f) * 255 / 31, f);
+			fputc (((c >> 5) & 0x3f) * 255 / 63, f);
+			fputc ((c & 0x1f) * 255 / 31, f);
+		}
+	}
+
+	return fclose (f) == 0;
+}
+
+
+uint32_t ili_crc (void)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	uint16_t x, y, c;
+	uint8_t b, i;
+
+	for (y = 0; y < ILI_VIEW_H; y++)
+	{
+		for (x = 0; x < ILI_VIEW_W; x++)
+		{
+			c = ili_pixel (x, y);
+			for (b = 0; b < 2; b++)
+			{
+				crc ^= b ? c & 0xff : c >> 8;
+				for (i = 0; i < 8; i++)
+					crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+			}
+		}
+	}
+
+	return ~crc;
+}
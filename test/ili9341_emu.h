@@ -0,0 +1,58 @@
+// ILI9341 model for the host tests. Decodes the SPI stream the driver sends
+// (CS and D/C from the GPIO model) into a 240 x 320 GRAM and keeps the
+// traffic counters the display benchmarks report per frame.
+
+#ifndef _ILI9341_EMU_H_
+#define _ILI9341_EMU_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ILI_GRAM_W	240
+#define ILI_GRAM_H	320
+
+// landscape view of the GRAM, the way the panel is mounted in the radio
+#define ILI_VIEW_W	320
+#define ILI_VIEW_H	240
+
+typedef struct {
+	uint32_t bytes;			// bytes clocked in with TFT_CS low
+	uint32_t commands;		// command bytes, each starts a controller transaction
+	uint32_t cs_toggles;	// TFT_CS assertions
+	uint32_t pixels;		// pixels written to GRAM
+	uint32_t sleep_us;		// time the firmware slept
+	uint32_t elapsed_us;	// time since ili_frame_start()
+	uint32_t stray;			// bytes sent with TFT_CS high
+	uint32_t clipped;		// pixels outside the address range
+} ili_counters;
+
+typedef struct {
+	uint16_t gram[ILI_GRAM_H][ILI_GRAM_W];
+	uint8_t madctl;
+	uint8_t pixfmt;
+	bool sleeping;
+	bool display_on;
+	uint32_t timing_errors;	// commands that came too soon after SWRESET or SLPOUT
+	ili_counters frame;
+} ili9341;
+
+extern ili9341 ili;
+
+// Reset the controller and hook it to the SPI and GPIO models
+void ili_attach (uint8_t cs_pin, uint8_t dc_pin);
+
+// Start a new set of per frame counters
+void ili_frame_start (void);
+// Close the frame, returns its counters
+ili_counters ili_frame_end (void);
+
+// RGB565 at x, y of the landscape view
+uint16_t ili_pixel (uint16_t x, uint16_t y);
+
+// Write the landscape view as a binary PPM, false if the file can't be written
+bool ili_write_ppm (const char *path);
+
+// CRC-32 of the landscape view, for golden values
+uint32_t ili_crc (void);
+
+#endif
@@ -0,0 +1,134 @@
+// Panorama frame decoder, see pan_decode.h and the layout in pan_stream.c
+
+#include <string.h>
+#include "pan_stream.h"
+#include "e_storage.h"
+#include "pan_decode.h"
+
+
+static uint16_t get16 (const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+
+static uint32_t get32 (const uint8_t *p)
+{
+	return get16 (p) | (uint32_t)get16 (p + 2) << 16;
+}
+
+
+static bool unpack_key (pan_decoder *d, const uint8_t *p, uint16_t len)
+{
+	uint16_t i, want = (d->n / 2) * 3 + (d->n & 1) * 2;
+
+	if (len != want)
+		return false;
+
+	for (i = 0; i + 1 < d->n; i += 2, p += 3)
+	{
+		d->bins[i] = p[0] | (p[1] & 0x0F) << 8;
+		d->bins[i + 1] = p[1] >> 4 | p[2] << 4;
+	}
+
+	if (i < d->n)
+		d->bins[i] = get16 (p) & 0x0FFF;
+
+	return true;
+}
+
+
+static bool unpack_delta (pan_decoder *d, const uint8_t *p, uint16_t len)
+{
+	const uint8_t *end = p + len;
+	uint16_t i, z;
+	uint8_t shift;
+	int16_t v;
+
+	for (i = 0; i < d->n; i++)
+	{
+		for (z = 0, shift = 0; ; shift += 7)
+		{
+			if (p == end  ||  shift > 14)
+				return false;
+			z |= (uint16_t)(*p & 0x7F) << shift;
+			if (!(*p++ & 0x80))
+				break;
+		}
+
+		v = (int16_t)(z >> 1) ^ -(int16_t)(z & 1);
+		v += d->bins[i];
+		if (v < 0  ||  v > 0x0FFF)
+			return false;
+		d->bins[i] = v;
+	}
+
+	return p == end;
+}
+
+
+int pan_decode (pan_decoder *d, const uint8_t *buf, size_t len)
+{
+	uint16_t payload, n;
+	size_t total;
+	bool ok;
+
+	if (len < 2)
+		return PAN_DEC_MORE;
+	if (buf[0] != PAN_SYNC0  ||  buf[1] != PAN_SYNC1)
+		return PAN_DEC_BAD;
+	if (len < PAN_HDR_SZ)
+		return PAN_DEC_MORE;
+
+	payload = get16 (buf + 24);
+	total = PAN_HDR_SZ + payload + 2;
+	if (payload > 2 * PAN_SZ + 2  ||  buf[2] != PAN_VERSION)
+	{
+		d->have_ref = false;
+		return PAN_DEC_BAD;
+	}
+	if (len < total)
+		return PAN_DEC_MORE;
+
+	if (get16 (buf + total - 2) != crc16 (buf + 2, total - 4))
+	{
+		d->have_ref = false;
+		return PAN_DEC_BAD;
+	}
+
+	n = get16 (buf + 22);
+	if (n == 0  ||  n > PAN_SZ)
+	{
+		d->have_ref = false;
+		return PAN_DEC_BAD;
+	}
+
+	if (buf[3] & PAN_F_DELTA)
+	{
+		if (!d->have_ref  ||  n != d->n  ||  get16 (buf + 4) != d->next_seq)
+		{
+			d->have_ref = false;
+			return PAN_DEC_NO_REF;
+		}
+		ok = unpack_delta (d, buf + PAN_HDR_SZ, payload);
+	}
+	else
+	{
+		d->n = n;
+		ok = unpack_key (d, buf + PAN_HDR_SZ, payload);
+	}
+
+	d->have_ref = ok;
+	if (!ok)
+		return PAN_DEC_BAD;
+
+	d->flags = buf[3];
+	d->seq = get16 (buf + 4);
+	d->next_seq = d->seq + 1;
+	d->ms = get32 (buf + 6);
+	d->center = get32 (buf + 10);
+	d->span = get32 (buf + 14);
+	d->step = get32 (buf + 18);
+
+	return total;
+}
@@ -0,0 +1,32 @@
+// Host side of the panorama stream, what a PC program does with the frames
+// pan_stream.c sends on the telemetry port.
+
+#ifndef _PAN_DECODE_H_
+#define _PAN_DECODE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "pbitx.h"
+
+#define PAN_DEC_MORE	0			// not a whole frame yet
+#define PAN_DEC_BAD		(-1)		// no sync, bad CRC or a payload that does not add up
+#define PAN_DEC_NO_REF	(-2)		// delta frame without a frame before it
+
+typedef struct {
+	uint8_t flags;
+	uint16_t seq;
+	uint32_t ms;
+	uint32_t center, span, step;
+	uint16_t n;
+	uint16_t bins[PAN_SZ];
+	bool have_ref;					// bins hold the last frame, deltas can go on it
+	uint16_t next_seq;
+} pan_decoder;
+
+// Decode the frame at the start of buf. Returns its length, or one of the
+// codes above. A bad frame or one after a gap drops the reference, the
+// deltas that follow are refused until the next key frame.
+int pan_decode (pan_decoder *d, const uint8_t *buf, size_t len);
+
+#endif
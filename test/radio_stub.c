@@ -0,0 +1,93 @@
+// The radio behind the CAT front ends, what dispatch.c and cat_kenwood.c
+// reach of pbitx.c reduced to its state. Tests set radio_s for the S meter
+// and count the calls in radio_calls.
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/stdlib.h"
+#include "pbitx.h"
+#include "radio_stub.h"
+
+uint32_t frequency = 7074000;
+uint32_t vfo_a_freq = 7074000;
+uint32_t vfo_b_freq = 14074000;
+uint8_t mode = USB;
+bool inTx = false;
+bool split_on = false;
+Settings settings;
+
+uint8_t radio_s;
+uint32_t radio_calls;
+
+extern uint8_t active_vfo;
+
+
+void radio_reset (void)
+{
+	frequency = vfo_a_freq = 7074000;
+	vfo_b_freq = 14074000;
+	mode = USB;
+	inTx = split_on = false;
+	active_vfo = VFO_A;
+	radio_s = 0;
+	radio_calls = 0;
+}
+
+
+uint32_t millis (void) { return to_ms_since_boot (get_absolute_time ()); }
+void redraw_menus (void) {}
+void settings_save (void) {}
+
+uint32_t getfrequency (void) { return frequency; }
+void setfrequency (unsigned long f) { frequency = f; radio_calls++; }
+uint8_t getmode (void) { return mode; }
+void setmode (uint8_t m) { mode = m; radio_calls++; }
+void startTx (bool soft) { (void)soft; inTx = true; radio_calls++; }
+void stopTx (bool soft) { (void)soft; inTx = false; radio_calls++; }
+
+uint8_t get_s_value (uint8_t max)
+{
+	return radio_s < max ? radio_s : max;
+}
+
+
+void switchVFO (int vfoSelect)
+{
+	if (vfoSelect == active_vfo)
+		return;
+
+	if (active_vfo == VFO_A)
+		vfo_a_freq = frequency;
+	else
+		vfo_b_freq = frequency;
+	active_vfo = vfoSelect;
+	frequency = vfoSelect == VFO_A ? vfo_a_freq : vfo_b_freq;
+	radio_calls++;
+}
+
+
+void sel_active_vfo (uint8_t v)
+{
+	switchVFO (v);
+}
+
+
+void swap_vfo (void)
+{
+	uint32_t f = vfo_a_freq;
+
+	vfo_a_freq = vfo_b_freq;
+	vfo_b_freq = f;
+	frequency = active_vfo == VFO_A ? vfo_a_freq : vfo_b_freq;
+	radio_calls++;
+}
+
+
+void eq_vfo_ab (uint8_t v)
+{
+	if (v == VFO_A)
+		vfo_a_freq = vfo_b_freq;
+	else
+		vfo_b_freq = vfo_a_freq;
+	frequency = vfo_a_freq;
+	radio_calls++;
+}
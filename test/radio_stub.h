@@ -0,0 +1,12 @@
+// Radio state for the CAT tests, see radio_stub.c
+#ifndef _RADIO_STUB_H_
+#define _RADIO_STUB_H_
+
+#include <stdint.h>
+
+extern uint8_t radio_s;			// S meter reading get_s_value() gives
+extern uint32_t radio_calls;	// state changes the CAT commands made
+
+void radio_reset (void);
+
+#endif
@@ -0,0 +1,22 @@
+#pragma once
+#include "pico/stdlib.h"
+
+typedef struct
+{
+	volatile uint32_t cs, result, fcs, fifo, div, intr, inte, intf, ints;
+} adc_hw_t;
+
+extern adc_hw_t *adc_hw;
+
+void adc_init (void);
+void adc_gpio_init (uint gpio);
+void adc_select_input (uint input);
+uint16_t adc_read (void);
+void adc_set_clkdiv (float div);
+void adc_fifo_setup (bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift);
+void adc_fifo_drain (void);
+bool adc_fifo_is_empty (void);
+uint8_t adc_fifo_get_level (void);
+uint16_t adc_fifo_get (void);
+uint16_t adc_fifo_get_blocking (void);
+void adc_run (bool run);
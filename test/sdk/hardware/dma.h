@@ -0,0 +1,36 @@
+#pragma once
+#include "pico/stdlib.h"
+
+#define DREQ_UART0_TX	20
+#define DREQ_UART0_RX	21
+#define DREQ_ADC		36
+#ifndef DMA_IRQ_0
+#define DMA_IRQ_0		11
+#endif
+
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 };
+
+typedef struct
+{
+	uint32_t ctrl;
+} dma_channel_config;
+
+int dma_claim_unused_channel (bool required);
+dma_channel_config dma_channel_get_default_config (uint channel);
+void channel_config_set_transfer_data_size (dma_channel_config *c, enum dma_channel_transfer_size size);
+void channel_config_set_read_increment (dma_channel_config *c, bool incr);
+void channel_config_set_write_increment (dma_channel_config *c, bool incr);
+void channel_config_set_dreq (dma_channel_config *c, uint dreq);
+void channel_config_set_ring (dma_channel_config *c, bool write, uint size_bits);
+void channel_config_set_chain_to (dma_channel_config *c, uint chain_to);
+void dma_channel_configure (uint channel, const dma_channel_config *c, volatile void *write_addr, const volatile void *read_addr, uint count, bool trigger);
+void dma_channel_set_read_addr (uint channel, const volatile void *read_addr, bool trigger);
+void dma_channel_set_write_addr (uint channel, volatile void *write_addr, bool trigger);
+void dma_channel_set_trans_count (uint channel, uint32_t count, bool trigger);
+void dma_channel_start (uint channel);
+bool dma_channel_is_busy (uint channel);
+void dma_channel_wait_for_finish_blocking (uint channel);
+void dma_channel_abort (uint channel);
+void dma_channel_set_irq0_enabled (uint channel, bool enabled);
+void dma_channel_acknowledge_irq0 (uint channel);
+bool dma_channel_get_irq0_status (uint channel);
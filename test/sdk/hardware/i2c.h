@@ -0,0 +1,34 @@
+#pragma once
+#include "pico/stdlib.h"
+
+typedef struct i2c_inst i2c_inst_t;
+extern i2c_inst_t *i2c1;
+
+// DW_apb_i2c register block, the clr_ registers are acknowledged by the model
+// once the interrupt handler has returned
+typedef struct
+{
+	volatile uint32_t con, tar, sar, _pad0, data_cmd;
+	volatile uint32_t ss_scl_hcnt, ss_scl_lcnt, fs_scl_hcnt, fs_scl_lcnt, _pad1[2];
+	volatile uint32_t intr_stat, intr_mask, raw_intr_stat, rx_tl, tx_tl;
+	volatile uint32_t clr_intr, clr_rx_under, clr_rx_over, clr_tx_over, clr_rd_req;
+	volatile uint32_t clr_tx_abrt, clr_rx_done, clr_activity, clr_stop_det, clr_start_det, clr_gen_call;
+	volatile uint32_t enable, status, txflr, rxflr, sda_hold, tx_abrt_source;
+} i2c_hw_t;
+
+#define I2C_IC_DATA_CMD_STOP_BITS				0x200
+#define I2C_IC_INTR_MASK_M_TX_EMPTY_BITS		0x010
+#define I2C_IC_INTR_MASK_M_TX_ABRT_BITS			0x040
+#define I2C_IC_INTR_MASK_M_STOP_DET_BITS		0x200
+#define I2C_IC_RAW_INTR_STAT_TX_EMPTY_BITS		0x010
+#define I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS		0x040
+#define I2C_IC_RAW_INTR_STAT_STOP_DET_BITS		0x200
+#define I2C_IC_STATUS_TFE_BITS					0x004
+#define I2C_IC_STATUS_MST_ACTIVITY_BITS			0x020
+
+uint i2c_init (i2c_inst_t *i2c, uint baudrate);
+uint i2c_set_baudrate (i2c_inst_t *i2c, uint baudrate);
+uint i2c_get_index (i2c_inst_t *i2c);
+i2c_hw_t *i2c_get_hw (i2c_inst_t *i2c);
+size_t i2c_get_write_available (i2c_inst_t *i2c);
+int i2c_write_blocking (i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop);
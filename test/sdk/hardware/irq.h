@@ -0,0 +1,13 @@
+#pragma once
+#include "pico/stdlib.h"
+
+#define UART0_IRQ	20
+#define I2C1_IRQ	24
+#define DMA_IRQ_0	11
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY	0x80
+
+typedef void (*irq_handler_t)(void);
+
+void irq_set_exclusive_handler (uint num, irq_handler_t handler);
+void irq_add_shared_handler (uint num, irq_handler_t handler, uint8_t priority);
+void irq_set_enabled (uint num, bool enabled);
@@ -0,0 +1,10 @@
+#pragma once
+#include "pico/stdlib.h"
+
+uint pwm_gpio_to_slice_num (uint gpio);
+uint pwm_gpio_to_channel (uint gpio);
+void pwm_set_wrap (uint slice, uint16_t wrap);
+void pwm_set_chan_level (uint slice, uint chan, uint16_t level);
+void pwm_set_clkdiv (uint slice, float div);
+void pwm_set_clkdiv_int_frac (uint slice, uint8_t integer, uint8_t fract);
+void pwm_set_enabled (uint slice, bool enabled);
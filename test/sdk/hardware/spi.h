@@ -0,0 +1,39 @@
+#pragma once
+#include "pico/stdlib.h"
+
+typedef struct spi_inst spi_inst_t;
+extern spi_inst_t *spi0;
+#define spi_default		spi0
+
+typedef struct
+{
+	volatile uint32_t cr0, cr1, dr, sr, cpsr, imsc, ris, mis, icr, dmacr;
+} spi_hw_t;
+
+typedef int spi_cpol_t;
+typedef int spi_cpha_t;
+typedef int spi_order_t;
+
+#define SPI_MSB_FIRST			1
+#define SPI_SSPCR0_SCR_BITS		0xff00
+#define SPI_SSPCR0_SCR_LSB		8
+#define SPI_SSPCR0_DSS_BITS		0x000f
+#define SPI_SSPCR0_DSS_LSB		0
+#define SPI_SSPICR_RORIC_BITS	0x1
+
+uint spi_init (spi_inst_t *spi, uint baudrate);
+uint spi_set_baudrate (spi_inst_t *spi, uint baudrate);
+void spi_set_format (spi_inst_t *spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order);
+spi_hw_t *spi_get_hw (spi_inst_t *spi);
+uint spi_get_index (const spi_inst_t *spi);
+uint spi_get_dreq (spi_inst_t *spi, bool is_tx);
+bool spi_is_busy (const spi_inst_t *spi);
+bool spi_is_readable (const spi_inst_t *spi);
+bool spi_is_writable (const spi_inst_t *spi);
+int spi_write_blocking (spi_inst_t *spi, const uint8_t *src, size_t len);
+int spi_write16_blocking (spi_inst_t *spi, const uint16_t *src, size_t len);
+int spi_write16_read16_blocking (spi_inst_t *spi, const uint16_t *src, uint16_t *dst, size_t len);
+
+void hw_write_masked (volatile uint32_t *addr, uint32_t values, uint32_t write_mask);
+void hw_set_bits (volatile uint32_t *addr, uint32_t mask);
+void hw_clear_bits (volatile uint32_t *addr, uint32_t mask);
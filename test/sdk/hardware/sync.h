@@ -0,0 +1,7 @@
+#pragma once
+#include <stdint.h>
+
+// interrupts are simulated, see host_poll()
+uint32_t save_and_disable_interrupts (void);
+void restore_interrupts (uint32_t status);
+unsigned int get_core_num (void);
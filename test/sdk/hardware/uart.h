@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct uart_inst uart_inst_t;
+extern uart_inst_t *uart0;
+extern uart_inst_t *uart1;
+
+#define UART_PARITY_NONE	0
+#ifndef UART0_IRQ
+#define UART0_IRQ			20
+#endif
+
+unsigned uart_init (uart_inst_t *uart, unsigned baud);
+unsigned uart_get_index (uart_inst_t *uart);
+void uart_set_hw_flow (uart_inst_t *uart, bool cts, bool rts);
+void uart_set_format (uart_inst_t *uart, unsigned data_bits, unsigned stop_bits, int parity);
+void uart_set_fifo_enabled (uart_inst_t *uart, bool enabled);
+void uart_set_irq_enables (uart_inst_t *uart, bool rx, bool tx);
+bool uart_is_readable (uart_inst_t *uart);
+bool uart_is_writable (uart_inst_t *uart);
+char uart_getc (uart_inst_t *uart);
+void uart_putc_raw (uart_inst_t *uart, char c);
+void uart_write_blocking (uart_inst_t *uart, const uint8_t *src, size_t len);
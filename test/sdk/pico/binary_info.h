@@ -0,0 +1,5 @@
+#pragma once
+#include "pico/stdlib.h"
+
+#define bi_decl(x)
+#define bi_2pins_with_func(a, b, c)	0
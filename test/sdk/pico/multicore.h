@@ -0,0 +1,8 @@
+#pragma once
+#include "pico/stdlib.h"
+
+void multicore_launch_core1 (void (*entry)(void));
+void multicore_lockout_victim_init (void);
+bool multicore_lockout_victim_is_initialized (uint core);
+void multicore_lockout_start_blocking (void);
+void multicore_lockout_end_blocking (void);
@@ -0,0 +1,13 @@
+#pragma once
+#include <stdbool.h>
+
+#define PICO_ERROR_NO_DATA	-3
+
+typedef struct stdio_driver
+{
+	void (*out_chars)(const char *buf, int len);
+	void (*out_flush)(void);
+	int (*in_chars)(char *buf, int len);
+	struct stdio_driver *next;
+	bool crlf_enabled;
+} stdio_driver_t;
@@ -0,0 +1,78 @@
+// Host stand-in for the parts of the Pico SDK the firmware uses. Only what
+// the sources under src/ need is declared, sdk_host.c implements it on top
+// of a virtual clock and the device models in test/.
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef unsigned int uint;
+typedef uint64_t absolute_time_t;
+
+#define __in_flash(...)
+#define __not_in_flash_func(f)		f
+#define __time_critical_func(f)		f
+
+// flash is a RAM array on the host, reads through XIP_BASE land in it
+#define PICO_FLASH_SIZE_BYTES		(2 * 1024 * 1024)
+extern uint8_t host_flash[PICO_FLASH_SIZE_BYTES];
+#define XIP_BASE					((uintptr_t)host_flash)
+
+#define GPIO_FUNC_UART		2
+#define GPIO_FUNC_SPI		1
+#define GPIO_FUNC_I2C		3
+#define GPIO_FUNC_PWM		4
+#define GPIO_FUNC_SIO		5
+#define GPIO_OUT			1
+#define GPIO_IN				0
+#define GPIO_IRQ_EDGE_FALL	4
+#define GPIO_IRQ_EDGE_RISE	8
+
+#define PICO_OK				0
+#define PICO_ERROR_TIMEOUT	-1
+#define PICO_ERROR_GENERIC	-2
+
+#ifndef MIN
+#define MIN(a, b)	((a) < (b) ? (a) : (b))
+#define MAX(a, b)	((a) > (b) ? (a) : (b))
+#endif
+
+void gpio_init (uint gpio);
+void gpio_set_dir (uint gpio, bool out);
+void gpio_set_function (uint gpio, int fn);
+void gpio_pull_up (uint gpio);
+void gpio_pull_down (uint gpio);
+void gpio_put (uint gpio, bool value);
+bool gpio_get (uint gpio);
+
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t events);
+void gpio_set_irq_enabled_with_callback (uint gpio, uint32_t events, bool enabled, gpio_irq_callback_t cb);
+
+void sleep_us (uint64_t us);
+void sleep_ms (uint32_t ms);
+uint32_t time_us_32 (void);
+uint64_t time_us_64 (void);
+absolute_time_t get_absolute_time (void);
+uint32_t to_ms_since_boot (absolute_time_t t);
+int64_t absolute_time_diff_us (absolute_time_t from, absolute_time_t to);
+absolute_time_t make_timeout_time_ms (uint32_t ms);
+static inline void tight_loop_contents (void) {}
+
+struct repeating_timer { int64_t delay_us; void *user_data; };
+typedef bool (*repeating_timer_callback_t)(struct repeating_timer *t);
+bool add_repeating_timer_us (int64_t us, repeating_timer_callback_t cb, void *user_data, struct repeating_timer *t);
+bool add_repeating_timer_ms (int32_t ms, repeating_timer_callback_t cb, void *user_data, struct repeating_timer *t);
+
+bool stdio_init_all (void);
+void stdio_flush (void);
+void stdio_set_driver_enabled (void *driver, bool enabled);
+int stdio_usb_connected (void);
+int getchar_timeout_us (uint32_t us);
+int putchar_raw (int c);
+
+// newlib has it, glibc does not
+char *itoa (int value, char *s, int radix);
+
+#include "hardware/sync.h"
+#include "hardware/uart.h"
@@ -0,0 +1,1231 @@
+// Host implementation of the SDK calls in sdk/, see host.h
+//
+// SPI frames are handed to host_spi_hook as the transfer starts, the clock
+// then runs for the wire time when the firmware waits for it. An ADC capture
+// is sampled when it completes, so the model sees the timestamps of every
+// conversion. I2C bytes leave the TX FIFO at the bus rate while the clock runs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "pico/unique_id.h"
+#include "pico/stdio/driver.h"
+#include "hardware/spi.h"
+#include "hardware/dma.h"
+#include "hardware/i2c.h"
+#include "hardware/adc.h"
+#include "hardware/irq.h"
+#include "hardware/flash.h"
+#include "hardware/pwm.h"
+#include "tusb.h"
+#include "host.h"
+
+#define HOST_IRQS		32
+#define I2C_FIFO_SZ		16
+#define I2C_TXN_SZ		64
+#define I2C_IDLE		0xFFFFFFFFu		// data_cmd holds nothing new
+#define UART_BUF_SZ		4096
+#define CDC_RX_SZ		4096
+#define CDC_WIRE_SZ		(64 * 1024)
+
+uint64_t host_ns;
+uint64_t host_sleep_us;
+static uint32_t host_ps;				// below one ns, keeps the wire time exact
+
+bool host_gpio[HOST_GPIOS];
+void (*host_gpio_hook)(unsigned pin, bool level);
+
+void (*host_spi_hook)(uint16_t frame, uint8_t bits);
+uint32_t host_spi_baud;
+
+bool (*host_i2c_hook)(uint8_t addr, const uint8_t *data, size_t len);
+uint32_t host_i2c_nack;
+uint32_t host_i2c_baud;
+uint64_t host_i2c_data_ns, host_i2c_stop_ns;
+
+uint16_t (*host_adc_hook)(uint8_t input, uint64_t t_ns);
+
+uint8_t host_flash[PICO_FLASH_SIZE_BYTES];
+uint32_t host_flash_cut;
+jmp_buf host_flash_jmp;
+uint32_t host_flash_erases[PICO_FLASH_SIZE_BYTES / FLASH_SECTOR_SIZE];
+uint32_t host_flash_programs;
+
+bool host_cdc_connected[HOST_CDC_PORTS];
+
+// the instance pointers only have to be distinct
+static spi_hw_t spi_regs;
+static i2c_hw_t i2c_regs;
+static adc_hw_t adc_regs;
+spi_inst_t *spi0 = (spi_inst_t *)&spi_regs;
+i2c_inst_t *i2c1 = (i2c_inst_t *)&i2c_regs;
+adc_hw_t *adc_hw = &adc_regs;
+static int uart_dummy[2];
+uart_inst_t *uart0 = (uart_inst_t *)&uart_dummy[0];
+uart_inst_t *uart1 = (uart_inst_t *)&uart_dummy[1];
+
+static irq_handler_t irq_handler[HOST_IRQS];
+static bool irq_enabled[HOST_IRQS];
+static uint32_t irq_off = 0;
+static bool in_irq = false;
+
+typedef struct
+{
+	bool claimed;
+	bool busy;
+	bool adc;
+	uint32_t ctrl;
+	volatile void *write_addr;
+	const volatile void *read_addr;
+	uint32_t count;
+	uint64_t start_ns;
+	uint64_t done_ns;
+} dma_ch;
+
+static dma_ch dma[HOST_DMA_CH];
+
+static struct
+{
+	uint16_t fifo[I2C_FIFO_SZ];
+	uint8_t head, count;
+	bool in_txn;
+	uint8_t txn[I2C_TXN_SZ];
+	uint8_t txn_len;
+	uint64_t byte_done;
+} i2c;
+
+static uint8_t adc_input;
+
+static struct
+{
+	uint8_t rx[UART_BUF_SZ], tx[UART_BUF_SZ];
+	uint32_t rx_head, rx_tail, tx_head, tx_tail;
+	bool rx_irq, tx_irq;
+} uart;
+
+static struct
+{
+	uint8_t rx[CDC_RX_SZ];
+	uint32_t rx_head, rx_tail;
+	uint8_t tx[CFG_TUD_CDC_TX_BUFSIZE];
+	uint32_t tx_len;
+	uint8_t wire[CDC_WIRE_SZ];
+	uint32_t wire_head, wire_tail;
+} cdc[HOST_CDC_PORTS];
+
+
+static void add_ps (uint64_t ps)
+{
+	ps += host_ps;
+	host_ns += ps / 1000;
+	host_ps = ps % 1000;
+}
+
+
+// ps on the wire for bits at baud
+static uint64_t wire_ps (uint64_t bits, uint32_t baud)
+{
+	return baud ? bits * 1000000000000ull / baud : 0;
+}
+
+
+// ---------------------------------------------------------------- I2C model
+
+static uint64_t i2c_byte_ns (void)
+{
+	return wire_ps (9, host_i2c_baud ? host_i2c_baud : 100000) / 1000;
+}
+
+
+// Move what the firmware wrote to data_cmd into the FIFO
+static void i2c_pick (void)
+{
+	uint32_t v = i2c_regs.data_cmd;
+
+	if (v == I2C_IDLE)
+		return;
+	i2c_regs.data_cmd = I2C_IDLE;
+
+	if (i2c.count == I2C_FIFO_SZ)
+	{
+		fprintf (stderr, "host: I2C TX FIFO overflow\n");
+		abort ();
+	}
+	if (i2c.count == 0)
+		i2c.byte_done = host_ns + i2c_byte_ns () * (i2c.in_txn ? 1 : 2);
+	i2c.fifo[(i2c.head + i2c.count++) % I2C_FIFO_SZ] = v & 0x3ff;
+}
+
+
+// Clock out the bytes whose time has come
+static void i2c_shift (void)
+{
+	uint16_t b;
+
+	while (i2c.count  &&  host_ns >= i2c.byte_done)
+	{
+		if (!i2c.in_txn)
+		{
+			if (host_i2c_nack)
+			{
+				// address NACK, the controller flushes the FIFO and flags the abort
+				host_i2c_nack--;
+				i2c.count = 0;
+				i2c.txn_len = 0;
+				i2c_regs.raw_intr_stat |= I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS;
+				i2c_regs.tx_abrt_source = 1;
+				break;
+			}
+			i2c.in_txn = true;
+		}
+
+		b = i2c.fifo[i2c.head];
+		i2c.head = (i2c.head + 1) % I2C_FIFO_SZ;
+		i2c.count--;
+		if (i2c.txn_len < I2C_TXN_SZ)
+			i2c.txn[i2c.txn_len++] = b;
+		if (i2c.txn_len == 2)
+			host_i2c_data_ns = i2c.byte_done;
+
+		if (b & I2C_IC_DATA_CMD_STOP_BITS)
+		{
+			host_i2c_stop_ns = i2c.byte_done;
+			if (host_i2c_hook)
+				host_i2c_hook (i2c_regs.tar, i2c.txn, i2c.txn_len);
+			i2c.in_txn = false;
+			i2c.txn_len = 0;
+			i2c_regs.raw_intr_stat |= I2C_IC_RAW_INTR_STAT_STOP_DET_BITS;
+		}
+
+		if (i2c.count)
+			i2c.byte_done += i2c_byte_ns () * (i2c.in_txn ? 1 : 2);
+	}
+
+	i2c_regs.txflr = i2c.count;
+	i2c_regs.status = (i2c.count == 0 ? I2C_IC_STATUS_TFE_BITS : 0) |
+		(i2c.count || i2c.in_txn ? I2C_IC_STATUS_MST_ACTIVITY_BITS : 0);
+	if (i2c.count == 0)
+		i2c_regs.raw_intr_stat |= I2C_IC_RAW_INTR_STAT_TX_EMPTY_BITS;
+	else
+		i2c_regs.raw_intr_stat &= ~I2C_IC_RAW_INTR_STAT_TX_EMPTY_BITS;
+}
+
+
+static void irq_call (uint num)
+{
+	in_irq = true;
+	irq_handler[num] ();
+	in_irq = false;
+}
+
+
+void host_poll (void)
+{
+	uint8_t i;
+
+	i2c_pick ();
+	i2c_shift ();
+
+	for (i = 0; i < HOST_DMA_CH; i++)
+	{
+		if (dma[i].busy  &&  host_ns >= dma[i].done_ns)
+			dma_channel_is_busy (i);
+	}
+
+	if (irq_off  ||  in_irq)
+		return;
+
+	if (irq_enabled[I2C1_IRQ]  &&  irq_handler[I2C1_IRQ]  &&  (i2c_regs.raw_intr_stat & i2c_regs.intr_mask))
+	{
+		irq_call (I2C1_IRQ);
+		// the handler has read clr_tx_abrt and clr_stop_det
+		i2c_regs.raw_intr_stat &= ~(I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS | I2C_IC_RAW_INTR_STAT_STOP_DET_BITS);
+		i2c_pick ();
+		i2c_shift ();
+	}
+
+	if (irq_enabled[UART0_IRQ]  &&  irq_handler[UART0_IRQ]  &&
+		((uart.rx_irq  &&  uart.rx_head != uart.rx_tail)  ||  uart.tx_irq))
+		irq_call (UART0_IRQ);
+}
+
+
+void host_run_us (uint32_t us)
+{
+	uint64_t end = host_ns + (uint64_t)us * 1000;
+
+	while (host_ns < end)
+	{
+		host_ns += 1000;
+		host_poll ();
+	}
+}
+
+
+void host_reset (void)
+{
+	host_ns = 0;
+	host_ps = 0;
+	host_sleep_us = 0;
+	memset (host_gpio, 0, sizeof(host_gpio));
+	host_gpio_hook = NULL;
+	host_spi_hook = NULL;
+	host_spi_baud = 0;
+	host_i2c_hook = NULL;
+	host_i2c_nack = 0;
+	host_i2c_data_ns = host_i2c_stop_ns = 0;
+	host_i2c_baud = 0;
+	host_adc_hook = NULL;
+	memset (host_flash, 0xff, sizeof(host_flash));
+	host_flash_cut = 0;
+	memset (host_flash_erases, 0, sizeof(host_flash_erases));
+	host_flash_programs = 0;
+	memset (host_cdc_connected, 0, sizeof(host_cdc_connected));
+
+	memset (&spi_regs, 0, sizeof(spi_regs));
+	memset (&i2c_regs, 0, sizeof(i2c_regs));
+	i2c_regs.data_cmd = I2C_IDLE;
+	i2c_regs.status = I2C_IC_STATUS_TFE_BITS;
+	memset (&i2c, 0, sizeof(i2c));
+	memset (&adc_regs, 0, sizeof(adc_regs));
+	memset (dma, 0, sizeof(dma));
+	memset (irq_handler, 0, sizeof(irq_handler));
+	memset (irq_enabled, 0, sizeof(irq_enabled));
+	irq_off = 0;
+	in_irq = false;
+	memset (&uart, 0, sizeof(uart));
+	memset (cdc, 0, sizeof(cdc));
+}
+
+
+// ---------------------------------------------------------------- time
+
+uint32_t time_us_32 (void)
+{
+	host_ns += 100;
+	host_poll ();
+	return host_ns / 1000;
+}
+
+
+uint64_t time_us_64 (void)
+{
+	host_ns += 100;
+	host_poll ();
+	return host_ns / 1000;
+}
+
+
+void sleep_us (uint64_t us)
+{
+	host_sleep_us += us;
+	host_ns += us * 1000;
+	host_poll ();
+}
+
+
+void sleep_ms (uint32_t ms)
+{
+	sleep_us ((uint64_t)ms * 1000);
+}
+
+
+absolute_time_t get_absolute_time (void)
+{
+	return time_us_64 ();
+}
+
+
+uint32_t to_ms_since_boot (absolute_time_t t)
+{
+	return t / 1000;
+}
+
+
+int64_t absolute_time_diff_us (absolute_time_t from, absolute_time_t to)
+{
+	return (int64_t)(to - from);
+}
+
+
+absolute_time_t make_timeout_time_ms (uint32_t ms)
+{
+	return time_us_64 () + (uint64_t)ms * 1000;
+}
+
+
+bool add_repeating_timer_us (int64_t us, repeating_timer_callback_t cb, void *user_data, struct repeating_timer *t)
+{
+	(void)cb;
+	t->delay_us = us;
+	t->user_data = user_data;
+	return true;
+}
+
+
+bool add_repeating_timer_ms (int32_t ms, repeating_timer_callback_t cb, void *user_data, struct repeating_timer *t)
+{
+	return add_repeating_timer_us ((int64_t)ms * 1000, cb, user_data, t);
+}
+
+
+// ---------------------------------------------------------------- interrupts
+
+uint32_t save_and_disable_interrupts (void)
+{
+	return irq_off++;
+}
+
+
+void restore_interrupts (uint32_t status)
+{
+	irq_off = status;
+	host_poll ();
+}
+
+
+unsigned int get_core_num (void)
+{
+	return 0;
+}
+
+
+void irq_set_exclusive_handler (uint num, irq_handler_t handler)
+{
+	irq_handler[num] = handler;
+}
+
+
+void irq_add_shared_handler (uint num, irq_handler_t handler, uint8_t priority)
+{
+	(void)priority;
+	irq_handler[num] = handler;
+}
+
+
+void irq_set_enabled (uint num, bool enabled)
+{
+	irq_enabled[num] = enabled;
+	host_poll ();
+}
+
+
+// ---------------------------------------------------------------- GPIO
+
+void gpio_init (uint gpio)
+{
+	host_gpio[gpio] = false;
+}
+
+
+void gpio_set_dir (uint gpio, bool out)
+{
+	(void)gpio;
+	(void)out;
+}
+
+
+void gpio_set_function (uint gpio, int fn)
+{
+	(void)gpio;
+	(void)fn;
+}
+
+
+void gpio_pull_up (uint gpio)
+{
+	host_gpio[gpio] = true;
+}
+
+
+void gpio_pull_down (uint gpio)
+{
+	host_gpio[gpio] = false;
+}
+
+
+void gpio_put (uint gpio, bool value)
+{
+	bool changed = host_gpio[gpio] != value;
+
+	host_gpio[gpio] = value;
+	if (changed  &&  host_gpio_hook)
+		host_gpio_hook (gpio, value);
+}
+
+
+bool gpio_get (uint gpio)
+{
+	return host_gpio[gpio];
+}
+
+
+void gpio_set_irq_enabled_with_callback (uint gpio, uint32_t events, bool enabled, gpio_irq_callback_t cb)
+{
+	(void)gpio;
+	(void)events;
+	(void)enabled;
+	(void)cb;
+}
+
+
+// ---------------------------------------------------------------- SPI
+
+uint spi_init (spi_inst_t *spi, uint baudrate)
+{
+	(void)spi;
+	host_spi_baud = baudrate;
+	spi_regs.cr0 = 7;
+	return baudrate;
+}
+
+
+uint spi_set_baudrate (spi_inst_t *spi, uint baudrate)
+{
+	(void)spi;
+	host_spi_baud = baudrate;
+	return baudrate;
+}
+
+
+void spi_set_format (spi_inst_t *spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order)
+{
+	(void)spi;
+	(void)cpol;
+	(void)cpha;
+	(void)order;
+	hw_write_masked (&spi_regs.cr0, data_bits - 1, SPI_SSPCR0_DSS_BITS);
+}
+
+
+spi_hw_t *spi_get_hw (spi_inst_t *spi)
+{
+	(void)spi;
+	return &spi_regs;
+}
+
+
+uint spi_get_index (const spi_inst_t *spi)
+{
+	(void)spi;
+	return 0;
+}
+
+
+uint spi_get_dreq (spi_inst_t *spi, bool is_tx)
+{
+	(void)spi;
+	return is_tx ? 16 : 17;
+}
+
+
+bool spi_is_busy (const spi_inst_t *spi)
+{
+	(void)spi;
+	return false;
+}
+
+
+bool spi_is_readable (const spi_inst_t *spi)
+{
+	(void)spi;
+	return false;
+}
+
+
+bool spi_is_writable (const spi_inst_t *spi)
+{
+	(void)spi;
+	return true;
+}
+
+
+static uint8_t spi_bits (void)
+{
+	return (spi_regs.cr0 & SPI_SSPCR0_DSS_BITS) + 1;
+}
+
+
+static void spi_frame (uint16_t frame)
+{
+	if (host_spi_hook)
+		host_spi_hook (frame, spi_bits ());
+}
+
+
+int spi_write_blocking (spi_inst_t *spi, const uint8_t *src, size_t len)
+{
+	size_t i;
+
+	(void)spi;
+	for (i = 0; i < len; i++)
+		spi_frame (src[i]);
+	add_ps (wire_ps ((uint64_t)len * spi_bits (), host_spi_baud));
+	host_poll ();
+	return len;
+}
+
+
+int spi_write16_blocking (spi_inst_t *spi, const uint16_t *src, size_t len)
+{
+	size_t i;
+
+	(void)spi;
+	for (i = 0; i < len; i++)
+		spi_frame (src[i]);
+	add_ps (wire_ps ((uint64_t)len * spi_bits (), host_spi_baud));
+	host_poll ();
+	return len;
+}
+
+
+int spi_write16_read16_blocking (spi_inst_t *spi, const uint16_t *src, uint16_t *dst, size_t len)
+{
+	spi_write16_blocking (spi, src, len);
+	memset (dst, 0, len * 2);
+	return len;
+}
+
+
+void hw_write_masked (volatile uint32_t *addr, uint32_t values, uint32_t write_mask)
+{
+	*addr = (*addr & ~write_mask) | (values & write_mask);
+}
+
+
+void hw_set_bits (volatile uint32_t *addr, uint32_t mask)
+{
+	*addr |= mask;
+}
+
+
+void hw_clear_bits (volatile uint32_t *addr, uint32_t mask)
+{
+	*addr &= ~mask;
+}
+
+
+// ---------------------------------------------------------------- DMA
+
+#define CTRL_SIZE		0x3
+#define CTRL_INCR_READ	0x4
+#define CTRL_INCR_WRITE	0x8
+
+int dma_claim_unused_channel (bool required)
+{
+	int i;
+
+	for (i = 0; i < HOST_DMA_CH; i++)
+	{
+		if (!dma[i].claimed)
+		{
+			dma[i].claimed = true;
+			return i;
+		}
+	}
+	if (required)
+		abort ();
+	return -1;
+}
+
+
+dma_channel_config dma_channel_get_default_config (uint channel)
+{
+	dma_channel_config c = { DMA_SIZE_32 | CTRL_INCR_READ };
+
+	(void)channel;
+	return c;
+}
+
+
+void channel_config_set_transfer_data_size (dma_channel_config *c, enum dma_channel_transfer_size size)
+{
+	c->ctrl = (c->ctrl & ~CTRL_SIZE) | size;
+}
+
+
+void channel_config_set_read_increment (dma_channel_config *c, bool incr)
+{
+	c->ctrl = incr ? c->ctrl | CTRL_INCR_READ : c->ctrl & ~CTRL_INCR_READ;
+}
+
+
+void channel_config_set_write_increment (dma_channel_config *c, bool incr)
+{
+	c->ctrl = incr ? c->ctrl | CTRL_INCR_WRITE : c->ctrl & ~CTRL_INCR_WRITE;
+}
+
+
+void channel_config_set_dreq (dma_channel_config *c, uint dreq)
+{
+	(void)c;
+	(void)dreq;
+}
+
+
+void channel_config_set_ring (dma_channel_config *c, bool write, uint size_bits)
+{
+	(void)c;
+	(void)write;
+	(void)size_bits;
+}
+
+
+void channel_config_set_chain_to (dma_channel_config *c, uint chain_to)
+{
+	(void)c;
+	(void)chain_to;
+}
+
+
+static uint32_t dma_load (const volatile uint8_t *p, uint8_t size)
+{
+	if (size == DMA_SIZE_8)
+		return *p;
+	if (size == DMA_SIZE_16)
+		return *(const volatile uint16_t *)p;
+	return *(const volatile uint32_t *)p;
+}
+
+
+static void dma_store (volatile uint8_t *p, uint8_t size, uint32_t v)
+{
+	if (size == DMA_SIZE_8)
+		*p = v;
+	else if (size == DMA_SIZE_16)
+		*(volatile uint16_t *)p = v;
+	else
+		*(volatile uint32_t *)p = v;
+}
+
+
+void dma_channel_start (uint channel)
+{
+	dma_ch *d = &dma[channel];
+	uint8_t size = d->ctrl & CTRL_SIZE;
+	uint8_t step = 1 << size;
+	const volatile uint8_t *rd = d->read_addr;
+	volatile uint8_t *wr = d->write_addr;
+	uint32_t i;
+
+	dma_channel_wait_for_finish_blocking (channel);
+	d->busy = true;
+	d->adc = false;
+	d->start_ns = host_ns;
+
+	if (d->write_addr == &spi_regs.dr)
+	{
+		for (i = 0; i < d->count; i++, rd += (d->ctrl & CTRL_INCR_READ) ? step : 0)
+			spi_frame (dma_load (rd, size));
+		d->done_ns = host_ns + (wire_ps ((uint64_t)d->count * spi_bits (), host_spi_baud) + 999) / 1000;
+	}
+	else if (d->read_addr == &adc_regs.fifo)
+	{
+		// sampled when the capture completes, see dma_channel_is_busy()
+		d->adc = true;
+		d->done_ns = host_ns + (uint64_t)d->count * HOST_ADC_SAMPLE_NS;
+	}
+	else
+	{
+		for (i = 0; i < d->count; i++)
+		{
+			dma_store (wr, size, dma_load (rd, size));
+			rd += (d->ctrl & CTRL_INCR_READ) ? step : 0;
+			wr += (d->ctrl & CTRL_INCR_WRITE) ? step : 0;
+		}
+		d->done_ns = host_ns;
+	}
+}
+
+
+void dma_channel_configure (uint channel, const dma_channel_config *c, volatile void *write_addr, const volatile void *read_addr, uint count, bool trigger)
+{
+	dma_channel_wait_for_finish_blocking (channel);
+	dma[channel].ctrl = c->ctrl;
+	dma[channel].write_addr = write_addr;
+	dma[channel].read_addr = read_addr;
+	dma[channel].count = count;
+	if (trigger)
+		dma_channel_start (channel);
+}
+
+
+void dma_channel_set_read_addr (uint channel, const volatile void *read_addr, bool trigger)
+{
+	dma[channel].read_addr = read_addr;
+	if (trigger)
+		dma_channel_start (channel);
+}
+
+
+void dma_channel_set_write_addr (uint channel, volatile void *write_addr, bool trigger)
+{
+	dma[channel].write_addr = write_addr;
+	if (trigger)
+		dma_channel_start (channel);
+}
+
+
+void dma_channel_set_trans_count (uint channel, uint32_t count, bool trigger)
+{
+	dma[channel].count = count;
+	if (trigger)
+		dma_channel_start (channel);
+}
+
+
+bool dma_channel_is_busy (uint channel)
+{
+	dma_ch *d = &dma[channel];
+	uint8_t step = 1 << (d->ctrl & CTRL_SIZE);
+	volatile uint8_t *wr = d->write_addr;
+	uint32_t i;
+
+	if (!d->busy  ||  host_ns < d->done_ns)
+		return d->busy;
+
+	if (d->adc)
+	{
+		for (i = 0; i < d->count; i++, wr += (d->ctrl & CTRL_INCR_WRITE) ? step : 0)
+			dma_store (wr, d->ctrl & CTRL_SIZE, host_adc_hook ? host_adc_hook (adc_input, d->start_ns + (uint64_t)(i + 1) * HOST_ADC_SAMPLE_NS) : 0);
+	}
+	d->busy = false;
+	return false;
+}
+
+
+void dma_channel_wait_for_finish_blocking (uint channel)
+{
+	if (!dma[channel].busy)
+		return;
+	if (host_ns < dma[channel].done_ns)
+	{
+		host_poll ();			// what was put on the bus before the wait goes out in time
+		host_ns = dma[channel].done_ns;
+		host_poll ();
+	}
+	dma_channel_is_busy (channel);
+}
+
+
+void dma_channel_abort (uint channel)
+{
+	dma[channel].busy = false;
+}
+
+
+void dma_channel_set_irq0_enabled (uint channel, bool enabled)
+{
+	(void)channel;
+	(void)enabled;
+}
+
+
+void dma_channel_acknowledge_irq0 (uint channel)
+{
+	(void)channel;
+}
+
+
+bool dma_channel_get_irq0_status (uint channel)
+{
+	return !dma_channel_is_busy (channel);
+}
+
+
+// ---------------------------------------------------------------- I2C
+
+uint i2c_init (i2c_inst_t *i2c_inst, uint baudrate)
+{
+	(void)i2c_inst;
+	host_i2c_baud = baudrate;
+	return baudrate;
+}
+
+
+uint i2c_set_baudrate (i2c_inst_t *i2c_inst, uint baudrate)
+{
+	return i2c_init (i2c_inst, baudrate);
+}
+
+
+uint i2c_get_index (i2c_inst_t *i2c_inst)
+{
+	(void)i2c_inst;
+	return 1;
+}
+
+
+i2c_hw_t *i2c_get_hw (i2c_inst_t *i2c_inst)
+{
+	(void)i2c_inst;
+	return &i2c_regs;
+}
+
+
+size_t i2c_get_write_available (i2c_inst_t *i2c_inst)
+{
+	(void)i2c_inst;
+	i2c_pick ();
+	return I2C_FIFO_SZ - i2c.count;
+}
+
+
+int i2c_write_blocking (i2c_inst_t *i2c_inst, uint8_t addr, const uint8_t *src, size_t len, bool nostop)
+{
+	(void)i2c_inst;
+	(void)nostop;
+
+	// whatever the IRQ path queued goes first
+	i2c_pick ();
+	while (i2c.count  ||  i2c.in_txn)
+	{
+		host_ns = i2c.count ? i2c.byte_done : host_ns + i2c_byte_ns ();
+		i2c_shift ();
+		if (i2c.in_txn  &&  !i2c.count)
+			break;
+	}
+
+	i2c_regs.tar = addr;
+	if (host_i2c_nack)
+	{
+		host_i2c_nack--;
+		host_ns += i2c_byte_ns ();
+		return PICO_ERROR_GENERIC;
+	}
+
+	host_ns += (len + 1) * i2c_byte_ns ();
+	if (host_i2c_hook)
+		host_i2c_hook (addr, src, len);
+	host_poll ();
+	return len;
+}
+
+
+// ---------------------------------------------------------------- ADC
+
+void adc_init (void) {}
+void adc_gpio_init (uint gpio) { (void)gpio; }
+void adc_set_clkdiv (float div) { (void)div; }
+void adc_fifo_drain (void) {}
+bool adc_fifo_is_empty (void) { return true; }
+uint8_t adc_fifo_get_level (void) { return 0; }
+uint16_t adc_fifo_get (void) { return 0; }
+uint16_t adc_fifo_get_blocking (void) { return 0; }
+void adc_run (bool run) { (void)run; }
+
+
+void adc_fifo_setup (bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift)
+{
+	(void)en;
+	(void)dreq_en;
+	(void)dreq_thresh;
+	(void)err_in_fifo;
+	(void)byte_shift;
+}
+
+
+void adc_select_input (uint input)
+{
+	adc_input = input;
+}
+
+
+uint16_t adc_read (void)
+{
+	add_ps (HOST_ADC_SAMPLE_NS * 1000ull);
+	return host_adc_hook ? host_adc_hook (adc_input, host_ns) : 0;
+}
+
+
+// ---------------------------------------------------------------- flash
+
+// True when this operation is the one the power cut hits
+static bool flash_cut (void)
+{
+	return host_flash_cut  &&  --host_flash_cut == 0;
+}
+
+
+void flash_range_erase (uint32_t offset, size_t count)
+{
+	size_t i;
+
+	if (offset % FLASH_SECTOR_SIZE  ||  count % FLASH_SECTOR_SIZE  ||  offset + count > PICO_FLASH_SIZE_BYTES)
+	{
+		fprintf (stderr, "host: bad erase %x %zx\n", (unsigned)offset, count);
+		abort ();
+	}
+
+	for (i = 0; i < count; i += FLASH_SECTOR_SIZE)
+		host_flash_erases[(offset + i) / FLASH_SECTOR_SIZE]++;
+
+	if (flash_cut ())
+	{
+		memset (host_flash + offset, 0xff, count / 2);
+		longjmp (host_flash_jmp, 1);
+	}
+	memset (host_flash + offset, 0xff, count);
+	host_ns += 45000000ull * (count / FLASH_SECTOR_SIZE);
+}
+
+
+void flash_range_program (uint32_t offset, const uint8_t *data, size_t count)
+{
+	size_t i, n = count;
+
+	if (offset % FLASH_PAGE_SIZE  ||  count % FLASH_PAGE_SIZE  ||  offset + count > PICO_FLASH_SIZE_BYTES)
+	{
+		fprintf (stderr, "host: bad program %x %zx\n", (unsigned)offset, count);
+		abort ();
+	}
+
+	host_flash_programs++;
+	if (flash_cut ())
+		n = count / 2;
+
+	// programming only clears bits
+	for (i = 0; i < n; i++)
+		host_flash[offset + i] &= data[i];
+
+	if (n != count)
+		longjmp (host_flash_jmp, 1);
+	host_ns += 400000ull * (count / FLASH_PAGE_SIZE);
+}
+
+
+// ---------------------------------------------------------------- multicore
+
+void multicore_launch_core1 (void (*entry)(void)) { (void)entry; }
+void multicore_lockout_victim_init (void) {}
+bool multicore_lockout_victim_is_initialized (uint core) { (void)core; return false; }
+void multicore_lockout_start_blocking (void) {}
+void multicore_lockout_end_blocking (void) {}
+
+
+void pico_get_unique_board_id_string (char *id_out, uint len)
+{
+	snprintf (id_out, len, "E66038B7133C2F2F");
+}
+
+
+// ---------------------------------------------------------------- PWM
+
+uint pwm_gpio_to_slice_num (uint gpio) { return (gpio >> 1) & 7; }
+uint pwm_gpio_to_channel (uint gpio) { return gpio & 1; }
+void pwm_set_wrap (uint slice, uint16_t wrap) { (void)slice; (void)wrap; }
+void pwm_set_chan_level (uint slice, uint chan, uint16_t level) { (void)slice; (void)chan; (void)level; }
+void pwm_set_clkdiv (uint slice, float div) { (void)slice; (void)div; }
+void pwm_set_clkdiv_int_frac (uint slice, uint8_t integer, uint8_t fract) { (void)slice; (void)integer; (void)fract; }
+void pwm_set_enabled (uint slice, bool enabled) { (void)slice; (void)enabled; }
+
+
+// ---------------------------------------------------------------- UART
+
+unsigned uart_init (uart_inst_t *u, unsigned baud) { (void)u; return baud; }
+unsigned uart_get_index (uart_inst_t *u) { return u == uart1; }
+void uart_set_hw_flow (uart_inst_t *u, bool cts, bool rts) { (void)u; (void)cts; (void)rts; }
+void uart_set_format (uart_inst_t *u, unsigned data_bits, unsigned stop_bits, int parity) { (void)u; (void)data_bits; (void)stop_bits; (void)parity; }
+void uart_set_fifo_enabled (uart_inst_t *u, bool enabled) { (void)u; (void)enabled; }
+
+
+void uart_set_irq_enables (uart_inst_t *u, bool rx, bool tx)
+{
+	(void)u;
+	uart.rx_irq = rx;
+	uart.tx_irq = tx;
+}
+
+
+bool uart_is_readable (uart_inst_t *u)
+{
+	(void)u;
+	return uart.rx_head != uart.rx_tail;
+}
+
+
+bool uart_is_writable (uart_inst_t *u)
+{
+	(void)u;
+	return uart.tx_head - uart.tx_tail < UART_BUF_SZ;
+}
+
+
+char uart_getc (uart_inst_t *u)
+{
+	(void)u;
+	if (uart.rx_head == uart.rx_tail)
+		return 0;
+	return uart.rx[uart.rx_tail++ % UART_BUF_SZ];
+}
+
+
+void uart_putc_raw (uart_inst_t *u, char c)
+{
+	(void)u;
+	if (uart.tx_head - uart.tx_tail < UART_BUF_SZ)
+		uart.tx[uart.tx_head++ % UART_BUF_SZ] = c;
+}
+
+
+void uart_write_blocking (uart_inst_t *u, const uint8_t *src, size_t len)
+{
+	while (len--)
+		uart_putc_raw (u, *src++);
+}
+
+
+void host_uart_rx (const uint8_t *data, size_t len)
+{
+	while (len--  &&  uart.rx_head - uart.rx_tail < UART_BUF_SZ)
+		uart.rx[uart.rx_head++ % UART_BUF_SZ] = *data++;
+	host_poll ();
+}
+
+
+size_t host_uart_tx (uint8_t *data, size_t max)
+{
+	size_t n = 0;
+
+	host_poll ();
+	while (n < max  &&  uart.tx_tail != uart.tx_head)
+		data[n++] = uart.tx[uart.tx_tail++ % UART_BUF_SZ];
+	return n;
+}
+
+
+// ---------------------------------------------------------------- USB CDC
+
+bool tusb_init (void)
+{
+	return true;
+}
+
+
+void tud_task (void)
+{
+	host_poll ();
+}
+
+
+bool tud_cdc_n_connected (uint8_t itf)
+{
+	return itf < HOST_CDC_PORTS  &&  host_cdc_connected[itf];
+}
+
+
+uint32_t tud_cdc_n_available (uint8_t itf)
+{
+	return cdc[itf].rx_head - cdc[itf].rx_tail;
+}
+
+
+uint32_t tud_cdc_n_read (uint8_t itf, void *buf, uint32_t len)
+{
+	uint8_t *p = buf;
+	uint32_t n = 0;
+
+	while (n < len  &&  cdc[itf].rx_tail != cdc[itf].rx_head)
+		p[n++] = cdc[itf].rx[cdc[itf].rx_tail++ % CDC_RX_SZ];
+	return n;
+}
+
+
+uint32_t tud_cdc_n_write_available (uint8_t itf)
+{
+	return CFG_TUD_CDC_TX_BUFSIZE - cdc[itf].tx_len;
+}
+
+
+uint32_t tud_cdc_n_write (uint8_t itf, const void *buf, uint32_t len)
+{
+	uint32_t n = MIN(len, tud_cdc_n_write_available (itf));
+
+	memcpy (cdc[itf].tx + cdc[itf].tx_len, buf, n);
+	cdc[itf].tx_len += n;
+	return n;
+}
+
+
+// Hands the buffer to the PC, or drops it when nobody has the port open
+uint32_t tud_cdc_n_write_flush (uint8_t itf)
+{
+	uint32_t i, n = cdc[itf].tx_len;
+
+	if (!host_cdc_connected[itf])
+		return 0;
+
+	// a PC that does not read leaves the rest in the FIFO
+	for (i = 0; i < n  &&  cdc[itf].wire_head - cdc[itf].wire_tail < CDC_WIRE_SZ; i++)
+		cdc[itf].wire[cdc[itf].wire_head++ % CDC_WIRE_SZ] = cdc[itf].tx[i];
+	memmove (cdc[itf].tx, cdc[itf].tx + i, n - i);
+	cdc[itf].tx_len = n - i;
+	return i;
+}
+
+
+void host_cdc_rx (uint8_t port, const uint8_t *data, size_t len)
+{
+	while (len--  &&  cdc[port].rx_head - cdc[port].rx_tail < CDC_RX_SZ)
+		cdc[port].rx[cdc[port].rx_head++ % CDC_RX_SZ] = *data++;
+}
+
+
+size_t host_cdc_tx (uint8_t port, uint8_t *data, size_t max)
+{
+	size_t n = 0;
+
+	while (n < max  &&  cdc[port].wire_tail != cdc[port].wire_head)
+		data[n++] = cdc[port].wire[cdc[port].wire_tail++ % CDC_WIRE_SZ];
+	return n;
+}
+
+
+// ---------------------------------------------------------------- stdio
+
+bool stdio_init_all (void) { return true; }
+void stdio_flush (void) { fflush (stdout); }
+static stdio_driver_t *stdio_driver;
+
+void stdio_set_driver_enabled (void *driver, bool enabled)
+{
+	if (enabled)
+		stdio_driver = driver;
+	else
+	if (stdio_driver == driver)
+		stdio_driver = NULL;
+}
+
+
+void host_stdio_out (const char *buf, int len)
+{
+	if (stdio_driver)
+		stdio_driver->out_chars (buf, len);
+}
+
+int stdio_usb_connected (void) { return 0; }
+int getchar_timeout_us (uint32_t us) { sleep_us (us); return PICO_ERROR_TIMEOUT; }
+int putchar_raw (int c) { return putchar (c); }
+
+
+char *itoa (int value, char *s, int radix)
+{
+	char tmp[34];
+	unsigned v = value < 0  &&  radix == 10 ? -(unsigned)value : (unsigned)value;
+	int i = 0, n = 0;
+
+	do
+	{
+		tmp[i++] = "0123456789abcdefghijklmnopqrstuvwxyz"[v % radix];
+		v /= radix;
+	} while (v);
+
+	if (value < 0  &&  radix == 10)
+		s[n++] = '-';
+	while (i)
+		s[n++] = tmp[--i];
+	s[n] = '\0';
+	return s;
+}
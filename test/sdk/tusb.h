@@ -0,0 +1,44 @@
+// Host stand-in for the TinyUSB device API, every CDC interface is a pair of
+// byte queues in sdk_host.c
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "tusb_config.h"
+
+typedef struct __attribute__((packed))
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint16_t bcdUSB;
+	uint8_t bDeviceClass;
+	uint8_t bDeviceSubClass;
+	uint8_t bDeviceProtocol;
+	uint8_t bMaxPacketSize0;
+	uint16_t idVendor;
+	uint16_t idProduct;
+	uint16_t bcdDevice;
+	uint8_t iManufacturer;
+	uint8_t iProduct;
+	uint8_t iSerialNumber;
+	uint8_t bNumConfigurations;
+} tusb_desc_device_t;
+
+#define TUSB_DESC_DEVICE		1
+#define TUSB_DESC_STRING		3
+#define TUSB_CLASS_MISC			0xEF
+#define MISC_SUBCLASS_COMMON	2
+#define MISC_PROTOCOL_IAD		1
+#define TUD_CONFIG_DESC_LEN		9
+#define TUD_CDC_DESC_LEN		66
+
+#define TUD_CONFIG_DESCRIPTOR(num, itf, str, len, attr, ma)		9, 2, (len) & 0xff, (len) >> 8, itf, num, str, attr, (ma) / 2
+#define TUD_CDC_DESCRIPTOR(itf, str, ep_notif, notif_sz, ep_out, ep_in, ep_sz)	itf, str, ep_notif, notif_sz, ep_out, ep_in, (ep_sz) & 0xff
+
+bool tusb_init (void);
+void tud_task (void);
+bool tud_cdc_n_connected (uint8_t itf);
+uint32_t tud_cdc_n_available (uint8_t itf);
+uint32_t tud_cdc_n_read (uint8_t itf, void *buf, uint32_t len);
+uint32_t tud_cdc_n_write_available (uint8_t itf);
+uint32_t tud_cdc_n_write (uint8_t itf, const void *buf, uint32_t len);
+uint32_t tud_cdc_n_write_flush (uint8_t itf);
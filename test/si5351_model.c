@@ -0,0 +1,64 @@
+// Si5351 model, see si5351_model.h
+
+#include <string.h>
+#include "host.h"
+#include "si5351_model.h"
+
+si5351_model si5351;
+
+
+static bool si5351_write (uint8_t addr, const uint8_t *data, size_t len)
+{
+	uint8_t reg;
+	size_t i;
+
+	if (addr != SI5351_MODEL_ADDR  ||  len == 0)
+		return false;
+
+	si5351.transactions++;
+	si5351.bytes += len;
+
+	reg = data[0];
+	for (i = 1; i < len; i++)
+		si5351.regs[(uint8_t)(reg + i - 1)] = data[i];
+
+	if (si5351.on_write)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			if (reg <= 49 + i * 8  &&  reg + len - 2 >= 42 + i * 8)
+				si5351.on_write (i);
+		}
+	}
+
+	return true;
+}
+
+
+void si5351_model_attach (void)
+{
+	memset (&si5351, 0, sizeof(si5351));
+	si5351.vco = SI5351_MODEL_VCO;
+	host_i2c_hook = si5351_write;
+}
+
+
+// f = VCO * 128 / (P1 + 512 + P2 / P3), divided by 2^rdiv
+double si5351_model_freq (uint8_t clk)
+{
+	const uint8_t *r = si5351.regs + 42 + clk * 8;
+	uint32_t p1, p2, p3;
+	double div;
+
+	if (si5351.regs[3] & (1 << clk))
+		return 0;
+
+	p3 = ((r[5] & 0xF0) << 12) | (r[0] << 8) | r[1];
+	p1 = ((r[2] & 0x03) << 16) | (r[3] << 8) | r[4];
+	p2 = ((r[5] & 0x0F) << 16) | (r[6] << 8) | r[7];
+	if (p3 == 0)
+		return 0;
+
+	div = (p1 + 512 + (double)p2 / p3) / 128.0;
+	return si5351.vco / div / (1 << ((r[2] >> 4) & 7));
+}
@@ -0,0 +1,28 @@
+// Si5351 register file on the host I2C bus, with a log of what went over
+// the wire and the output frequency the msynth registers stand for.
+
+#ifndef _SI5351_MODEL_H_
+#define _SI5351_MODEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SI5351_MODEL_ADDR	0x60
+#define SI5351_MODEL_VCO	875000000ull
+
+typedef struct {
+	uint8_t regs[256];
+	double vco;					// Hz, the crystal error is in here
+	uint32_t transactions;
+	uint32_t bytes;				// register address included, I2C address not
+	void (*on_write)(uint8_t clk);	// after a transaction that touched a msynth block
+} si5351_model;
+
+extern si5351_model si5351;
+
+void si5351_model_attach (void);
+
+// Frequency on CLK clk in Hz, 0 if the output is off
+double si5351_model_freq (uint8_t clk);
+
+#endif
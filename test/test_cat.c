@@ -0,0 +1,578 @@
+// The CAT path of the main loop on the host: UART0 and the USB CAT port
+// through civ.c into dispatch.c and cat_kenwood.c against the radio stub,
+// replies read back from both links.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pico/stdlib.h"
+#include "pbitx.h"
+#include "dispatch.h"
+#include "civ.h"
+#include "cat_kenwood.h"
+#include "usb_ports.h"
+#include "tusb.h"
+#include "host.h"
+#include "radio_stub.h"
+#include "check.h"
+
+#define LINK_SZ		4096
+
+// what each link sent since the last link_clear()
+static uint8_t usb_out[LINK_SZ], uart_out[LINK_SZ];
+static size_t usb_n, uart_n;
+
+
+static void boot (void)
+{
+	host_reset ();
+	radio_reset ();
+	host_cdc_connected[USB_CAT] = true;
+	memset (civ_proto, CIV_PROTO_NONE, sizeof(civ_proto));
+	civ_transceive = false;
+	civ_init ();
+	usb_n = uart_n = 0;
+}
+
+
+// One 5 ms tick of the main loop
+static void tick (void)
+{
+	usb_task ();
+	civ_poll ();
+	while (civ_get_frame ())
+		dispatch ();
+	civ_transceive_poll ();
+	civ_flush ();
+	usb_task ();
+	host_ns += 5000000;			// nothing on these links runs on time
+	host_poll ();
+
+	usb_n += host_cdc_tx (USB_CAT, usb_out + usb_n, LINK_SZ - usb_n);
+	uart_n += host_uart_tx (uart_out + uart_n, LINK_SZ - uart_n);
+}
+
+
+static void ticks (uint16_t n)
+{
+	while (n--)
+		tick ();
+}
+
+
+static void link_clear (void)
+{
+	usb_n = uart_n = 0;
+}
+
+
+static bool sent (const uint8_t *out, size_t n, const uint8_t *frame, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i + len <= n; i++)
+		if (!memcmp (out + i, frame, len))
+			return true;
+
+	return false;
+}
+
+
+static void usb_in (const uint8_t *data, size_t len)
+{
+	host_cdc_rx (USB_CAT, data, len);
+}
+
+
+// --------------------------------------------------------------- transceive
+
+static const uint8_t read_freq[] = { 0xFE, 0xFE, CIV_RIG_ADDR, CIV_CTRL_ADDR, GET_DISP_FREQ, END_NUM };
+
+
+// The 0x00 frame transceive sends for f
+static uint8_t trx_freq (uint32_t f, uint8_t *frame)
+{
+	uint8_t i = 0, k;
+
+	frame[i++] = 0xFE;
+	frame[i++] = 0xFE;
+	frame[i++] = 0x00;
+	frame[i++] = CIV_RIG_ADDR;
+	frame[i++] = SET_FREQ_DATA;
+	for (k = 0; k < 5; k++, f /= 100)
+		frame[i++] = (f % 10) | (f / 10 % 10) << 4;
+	frame[i++] = END_NUM;
+
+	return i;
+}
+
+
+static void test_transceive (void)
+{
+	static const uint8_t trx_on[] = { 0xFE, 0xFE, CIV_RIG_ADDR, CIV_CTRL_ADDR, EXT_SETTINGS, 0x05, EXT_TRANSCEIVE_HI, EXT_TRANSCEIVE_LO, 0x01, END_NUM };
+	static const uint8_t trx_read[] = { 0xFE, 0xFE, CIV_RIG_ADDR, CIV_CTRL_ADDR, EXT_SETTINGS, 0x05, EXT_TRANSCEIVE_HI, EXT_TRANSCEIVE_LO, END_NUM };
+	static const uint8_t trx_is_on[] = { 0xFE, 0xFE, CIV_CTRL_ADDR, CIV_RIG_ADDR, EXT_SETTINGS, 0x05, EXT_TRANSCEIVE_HI, EXT_TRANSCEIVE_LO, 0x01, END_NUM };
+	static const uint8_t ok[] = { 0xFE, 0xFE, CIV_CTRL_ADDR, CIV_RIG_ADDR, OK_NUM, END_NUM };
+	uint8_t frame[QUE_SIZE], len;
+
+	// the power up state, before boot() sets it for the other tests
+	CHECK(!civ_transceive);
+	CHECK_EQ(civ_proto[CIV_PORT_USB], CIV_PROTO_NONE);
+	CHECK_EQ(civ_proto[CIV_PORT_UART], CIV_PROTO_NONE);
+
+	boot ();
+
+	// off after power up, a host that polls gets only its replies
+	usb_in (read_freq, sizeof(read_freq));
+	ticks (2);
+	link_clear ();
+	setfrequency (7075000);
+	ticks (40);
+	CHECK_EQ(usb_n, 0);
+	CHECK_EQ(uart_n, 0);
+
+	// turned on, only the port that spoke CI-V hears about changes
+	usb_in (trx_on, sizeof(trx_on));
+	ticks (2);
+	CHECK(sent (usb_out, usb_n, ok, sizeof(ok)));
+	CHECK(civ_transceive);
+	link_clear ();
+	usb_in (trx_read, sizeof(trx_read));
+	ticks (2);
+	CHECK(sent (usb_out, usb_n, trx_is_on, sizeof(trx_is_on)));
+
+	host_uart_rx ((const uint8_t *)"FA;", 3);
+	ticks (2);
+	CHECK_EQ(civ_proto[CIV_PORT_UART], CIV_PROTO_ASCII);
+	link_clear ();
+	setfrequency (7076000);
+	ticks (40);
+	len = trx_freq (7076000, frame);
+	CHECK(sent (usb_out, usb_n, frame, len));
+	CHECK(!sent (uart_out, uart_n, frame, len));
+
+	// once the UART speaks CI-V it gets them too
+	host_uart_rx (read_freq, sizeof(read_freq));
+	ticks (2);
+	link_clear ();
+	setfrequency (7077000);
+	ticks (40);
+	len = trx_freq (7077000, frame);
+	CHECK(sent (usb_out, usb_n, frame, len));
+	CHECK(sent (uart_out, uart_n, frame, len));
+}
+
+
+// ------------------------------------------------------------------ framer
+
+// Replies to read_freq, whatever the frequency is by then
+static uint32_t freq_replies (const uint8_t *out, size_t n)
+{
+	uint32_t count = 0;
+	size_t i;
+
+	for (i = 0; i + 11 <= n; i++)
+		if (out[i] == 0xFE  &&  out[i + 1] == 0xFE  &&  out[i + 2] == CIV_CTRL_ADDR  &&  out[i + 3] == CIV_RIG_ADDR
+			&&  out[i + 4] == GET_DISP_FREQ  &&  out[i + 10] == END_NUM)
+			count++;
+
+	return count;
+}
+
+
+// Noise for the framer, heavy on the bytes it acts on. Never GET_DISP_FREQ,
+// so no read_freq reply comes out of it.
+static uint8_t noise (void)
+{
+	static const uint8_t hot[] = { 0xFE, 0xFE, 0xFE, CIV_EOM, CIV_JAM, CIV_RIG_ADDR, CIV_CTRL_ADDR, 'F', 'A', ';', '\r', 0x00 };
+	uint8_t ch;
+
+	do
+		ch = rand () % 2 ? hot[rand () % sizeof(hot)] : rand ();
+	while (ch == GET_DISP_FREQ);
+
+	return ch;
+}
+
+
+// Random noise with read_freq frames in between, on both links. A jammer
+// code puts the framer back to hunting before each frame, every one of them
+// has to be answered.
+static void test_framer_fuzz (void)
+{
+	static uint8_t chunk[200];
+	uint32_t i, want[CIV_PORTS] = { 0, 0 }, got[CIV_PORTS] = { 0, 0 };
+	uint8_t n, k, p;
+
+	boot ();
+	srand (20);
+	for (i = 0; i < 20000; i++)
+	{
+		p = rand () % CIV_PORTS;
+		n = rand () % 120;
+		for (k = 0; k < n; k++)
+			chunk[k] = noise ();
+		chunk[n++] = CIV_JAM;
+		if (rand () % 2)
+		{
+			memcpy (chunk + n, read_freq, sizeof(read_freq));
+			n += sizeof(read_freq);
+			want[p]++;
+		}
+
+		if (p == CIV_PORT_USB)
+			usb_in (chunk, n);
+		else
+			host_uart_rx (chunk, n);
+		ticks (3);
+
+		got[CIV_PORT_USB] += freq_replies (usb_out, usb_n);
+		got[CIV_PORT_UART] += freq_replies (uart_out, uart_n);
+		link_clear ();
+	}
+
+	CHECK_EQ(got[CIV_PORT_USB], want[CIV_PORT_USB]);
+	CHECK_EQ(got[CIV_PORT_UART], want[CIV_PORT_UART]);
+	for (p = 0; p < CIV_PORTS; p++)
+	{
+		CHECK_EQ(civ_stats[p].overruns, 0);
+		printf ("framer fuzz port %d: %lu frames answered, %lu bytes, %lu too long %lu collisions %lu resyncs\n", p,
+			(unsigned long)got[p], (unsigned long)civ_stats[p].rx_bytes, (unsigned long)civ_stats[p].too_long,
+			(unsigned long)civ_stats[p].collisions, (unsigned long)civ_stats[p].resyncs);
+	}
+}
+
+
+// A burst of polls on USB: how many ticks until all are answered, and how
+// fast the framer itself runs on the host
+static void test_framer_throughput (void)
+{
+	static uint8_t burst[600 * sizeof(read_freq)];
+	uint32_t i, frames = sizeof(burst) / sizeof(read_freq), got = 0, t = 0;
+	clock_t c;
+	double s;
+
+	boot ();
+	for (i = 0; i < frames; i++)
+		memcpy (burst + i * sizeof(read_freq), read_freq, sizeof(read_freq));
+	usb_in (burst, sizeof(burst));
+
+	while (got < frames  &&  t < 1000)
+	{
+		tick ();
+		t++;
+		got += freq_replies (usb_out, usb_n);
+		link_clear ();
+	}
+	CHECK_EQ(got, frames);
+	CHECK(t <= frames / CIV_FRAMES + 2);
+	printf ("framer: %lu frames in %lu ticks, %lu frames/s at 5 ms a tick (the old loop: one byte a tick, %u frames/s)\n",
+		(unsigned long)frames, (unsigned long)t, (unsigned long)(frames * 200 / t), 200 / (unsigned)sizeof(read_freq));
+
+	// host speed of framer and dispatch, the reply path left out
+	host_cdc_connected[USB_CAT] = false;
+	c = clock ();
+	for (i = 0; i < 200; i++)
+	{
+		usb_in (burst, sizeof(burst));
+		while (tud_cdc_n_available (USB_CAT))
+		{
+			civ_poll ();
+			while (civ_get_frame ())
+				dispatch ();
+		}
+	}
+	s = (double)(clock () - c) / CLOCKS_PER_SEC;
+	printf ("framer on the host: %.0f frames/s, %.1f MB/s\n", 200.0 * frames / s, 200.0 * sizeof(burst) / s / 1e6);
+}
+
+
+// ------------------------------------------------------------------ latency
+
+#define PASS_NS		50000ull		// one pass of loop() between ticks
+#define TICK_NS		10000000ull		// DELTA_T, 10 ms
+
+static uint64_t next_tick;
+
+
+// One pass of loop() in pbitx.c, with the CI-V part of its tick when it is
+// due. Without flush a reply waits in the ring for the next civ_poll(), as
+// it did before civ_flush().
+static void loop_pass (bool flush)
+{
+	usb_task ();
+	if (host_ns >= next_tick)
+	{
+		next_tick += TICK_NS;
+		civ_poll ();
+		while (civ_get_frame ())
+			dispatch ();
+		civ_transceive_poll ();
+		if (flush)
+			civ_flush ();
+	}
+	host_ns += PASS_NS;
+	host_poll ();
+
+	usb_n += host_cdc_tx (USB_CAT, usb_out + usb_n, LINK_SZ - usb_n);
+	uart_n += host_uart_tx (uart_out + uart_n, LINK_SZ - uart_n);
+}
+
+
+// Requests at random points of the tick, each timed from the last byte in
+// to the last byte of the reply out. Worst case per link in ns, the mean
+// in mean[].
+static void latency (bool flush, uint64_t worst[2], uint64_t mean[2])
+{
+	uint64_t t0, dt, sum[2] = { 0, 0 };
+	uint16_t i, k, n[2] = { 0, 0 };
+	uint8_t link;
+
+	boot ();
+	next_tick = host_ns;
+	worst[0] = worst[1] = 0;
+	srand (7);
+
+	for (i = 0; i < 400; i++)
+	{
+		for (k = rand () % (TICK_NS / PASS_NS); k; k--)
+			loop_pass (flush);
+		link_clear ();
+
+		link = i & 1;
+		if (link == CIV_PORT_USB)
+			usb_in (read_freq, sizeof(read_freq));
+		else
+			host_uart_rx (read_freq, sizeof(read_freq));
+		t0 = host_ns;
+
+		for (k = 0; k < 1000; k++)
+		{
+			loop_pass (flush);
+			if (freq_replies (link == CIV_PORT_USB ? usb_out : uart_out, link == CIV_PORT_USB ? usb_n : uart_n))
+				break;
+		}
+		CHECK(k < 1000);
+
+		dt = host_ns - t0;
+		sum[link] += dt;
+		n[link]++;
+		if (dt > worst[link])
+			worst[link] = dt;
+	}
+
+	mean[0] = sum[0] / n[0];
+	mean[1] = sum[1] / n[1];
+}
+
+
+static void test_latency (void)
+{
+	uint64_t worst[2], mean[2], old_worst[2], old_mean[2];
+	uint8_t p;
+
+	latency (false, old_worst, old_mean);
+	latency (true, worst, mean);
+
+	for (p = 0; p < 2; p++)
+	{
+		printf ("latency %s: mean %.2f ms, worst %.2f ms (reply held for the next tick: mean %.2f ms, worst %.2f ms)\n",
+			p == CIV_PORT_USB ? "USB " : "UART", mean[p] / 1e6, worst[p] / 1e6, old_mean[p] / 1e6, old_worst[p] / 1e6);
+
+		// a request waits at most a tick, the reply a pass or two to go out
+		CHECK(worst[p] <= TICK_NS + 4 * PASS_NS);
+		CHECK(worst[p] < old_worst[p]);
+	}
+	printf ("latency: the model UART is instant, on the wire add %u us for the reply at %u baud\n",
+		(unsigned)(10 * 11 * 1000000ull / UART_SPEED), (unsigned)UART_SPEED);
+}
+
+
+// ------------------------------------------------------------ Kenwood ASCII
+
+// Commands in order, each with the answer it has to get, "" for none. s is
+// the S meter reading for the command, -1 leaves it.
+static const struct { const char *cmd, *ans; int16_t s; } kw_table[] =
+{
+	{ "FA;",				"FA00007074000;",	-1 },
+	{ "FB;",				"FB00014074000;",	-1 },
+	{ "FA00003573000;",		"",					-1 },
+	{ "FA;",				"FA00003573000;",	-1 },
+	{ "FB00021074000;",		"",					-1 },
+	{ "FB;",				"FB00021074000;",	-1 },
+	{ "FA;",				"FA00003573000;",	-1 },
+	{ "MD;",				"MD2;",				-1 },
+	{ "MD1;",				"",					-1 },
+	{ "MD;",				"MD1;",				-1 },
+	{ "MD3;",				"",					-1 },
+	{ "MD;",				"MD3;",				-1 },
+	{ "IF;",				"IF00003573000     +000000000030000000;",	-1 },
+	{ "TX;",				"",					-1 },
+	{ "IF;",				"IF00003573000     +000000000130000000;",	-1 },
+	{ "RX;",				"",					-1 },
+	{ "FR1;",				"",					-1 },
+	{ "FR;",				"FR1;",				-1 },
+	{ "IF;",				"IF00021074000     +000000000031000000;",	-1 },
+	{ "FB;",				"FB00021074000;",	-1 },
+	{ "FR0;",				"",					-1 },
+	{ "MD2;",				"",					-1 },
+	{ "IF;",				"IF00003573000     +000000000020000000;",	-1 },
+	{ "SM0;",				"SM00000;",			0 },
+	{ "SM0;",				"SM00015;",			120 },
+	{ "SM;",				"SM00030;",			241 },
+	{ "ID;",				"ID020;",			-1 },
+
+	{ "FA123;",				"?;",				-1 },
+	{ "FA0000357300X;",		"?;",				-1 },
+	{ "FA99999999999;",		"?;",				-1 },
+	{ "MD4;",				"?;",				-1 },
+	{ "MD22;",				"?;",				-1 },
+	{ "SM1;",				"?;",				-1 },
+	{ "IF1;",				"?;",				-1 },
+	{ "XX;",				"?;",				-1 },
+	{ "FA;",				"FA00003573000;",	-1 },
+};
+
+
+static void test_kenwood_table (void)
+{
+	uint16_t i;
+
+	boot ();
+	for (i = 0; i < sizeof(kw_table) / sizeof(kw_table[0]); i++)
+	{
+		if (kw_table[i].s >= 0)
+			radio_s = kw_table[i].s;
+
+		link_clear ();
+		usb_in ((const uint8_t *)kw_table[i].cmd, strlen (kw_table[i].cmd));
+		ticks (2);
+		if (usb_n != strlen (kw_table[i].ans)  ||  memcmp (usb_out, kw_table[i].ans, usb_n))
+		{
+			CHECK(!"Kenwood answer");
+			fprintf (stderr, "  %s gave \"%.*s\", want \"%s\"\n", kw_table[i].cmd, (int)usb_n, usb_out, kw_table[i].ans);
+		}
+	}
+	CHECK_EQ(frequency, 3573000);
+	CHECK(!inTx);
+}
+
+
+// Whatever ends up in inque, the framer only hands over ';' terminated
+// commands but kenwood_dispatch() must not rely on it
+static void test_kenwood_fuzz (void)
+{
+	uint32_t i;
+	uint8_t k;
+
+	boot ();
+	srand (25);
+	civ_rx_port = CIV_PORT_USB;
+	for (i = 0; i < 200000; i++)
+	{
+		for (k = 0; k < QUE_SIZE; k++)
+			inque[k] = rand () % 4 ? "FABMDIFSMTXR0123456789;"[rand () % 23] : rand ();
+		if (i % 2)
+			inque[rand () % QUE_SIZE] = ';';
+		kenwood_dispatch ();
+		if (i % 64 == 0)
+		{
+			ticks (1);
+			link_clear ();
+		}
+	}
+	CHECK(frequency <= KW_FREQ_MAX);
+
+	// without a ';' every command is unknown
+	ticks (2);
+	for (i = 0; i < 2000; i++)
+	{
+		for (k = 0; k < QUE_SIZE; k++)
+			inque[k] = k < 2 + i % 14 ? "FA00007074000MD2"[k % 16] : 0;
+		link_clear ();
+		kenwood_dispatch ();
+		ticks (1);
+		CHECK(usb_n == 2  &&  !memcmp (usb_out, "?;", 2));
+	}
+}
+
+
+// Answers in out, one ';' each
+static uint32_t kw_answers (const uint8_t *out, size_t n)
+{
+	uint32_t got = 0;
+
+	while (n--)
+		got += *out++ == ';';
+
+	return got;
+}
+
+
+// What the Kenwood path keeps up with: a polling mix of FA; IF; MD;
+// through the framer, cat_kenwood and civ_exec(), first at the tick rate
+// of the loop, then as fast as the host runs it.
+static void test_kenwood_throughput (void)
+{
+	static const char *mix[] = { "FA;", "IF;", "MD;" };
+	char burst[256];
+	size_t len = 0;
+	uint32_t cmds = 0, got = 0, t = 0, i;
+	clock_t c;
+	double s;
+
+	while (len + 4 <= sizeof(burst))
+	{
+		strcpy (burst + len, mix[cmds % 3]);
+		len += strlen (mix[cmds % 3]);
+		cmds++;
+	}
+
+	boot ();
+	usb_in ((const uint8_t *)burst, len);
+	while (got < cmds  &&  t < 1000)
+	{
+		tick ();
+		t++;
+		got += kw_answers (usb_out, usb_n);
+		link_clear ();
+	}
+	CHECK_EQ(got, cmds);
+	CHECK_EQ(civ_stats[CIV_PORT_USB].tx_dropped, 0);
+	CHECK(t <= cmds / CIV_FRAMES + 2);
+	printf ("kenwood: %lu commands in %lu ticks, %lu commands/s at 5 ms a tick\n",
+		(unsigned long)cmds, (unsigned long)t, (unsigned long)(cmds * 200 / t));
+
+	// host speed of framer, cat_kenwood and civ_exec(), the reply path left out
+	host_cdc_connected[USB_CAT] = false;
+	c = clock ();
+	for (i = 0; i < 200; i++)
+	{
+		usb_in ((const uint8_t *)burst, len);
+		while (tud_cdc_n_available (USB_CAT))
+		{
+			civ_poll ();
+			while (civ_get_frame ())
+				dispatch ();
+		}
+	}
+	s = (double)(clock () - c) / CLOCKS_PER_SEC;
+	printf ("kenwood on the host: %.0f commands/s\n", 200.0 * cmds / s);
+}
+
+
+int main (void)
+{
+	usb_init ();
+
+	test_transceive ();
+	test_kenwood_table ();
+	test_kenwood_fuzz ();
+	test_kenwood_throughput ();
+	test_framer_fuzz ();
+	test_framer_throughput ();
+	test_latency ();
+
+	return check_result ();
+}
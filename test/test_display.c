@@ -0,0 +1,475 @@
+// Display driver and UI against the ILI9341 model. Every drawing call is
+// checked pixel for pixel, against a plain reference for the primitives and
+// text and against a golden CRC for the composed main screen. The traffic
+// counters of each frame are printed, the PPM snapshots end up in the
+// build directory.
+//
+// PBITX_UPDATE_GOLDEN=1 prints the CRCs instead of checking them.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pbitx.h"
+#include "gui_driver.h"
+#include "host.h"
+#include "ili9341_emu.h"
+#include "check.h"
+
+#define GOLDEN_MAIN_SCREEN	0x601b3e85u
+
+void ui_init (void);
+void guiUpdate (bool redraw);
+void displayVFO (uint8_t clr);
+void clearSweep (void);
+void displaySweep (void);
+
+#define SWEEP_X		33		// as in ubitx_ui.c
+#define SWEEP_TOP	151
+#define SWEEP_BASE	210
+#define SWEEP_MARK	159
+const uint8_t *get_font (uint8_t select);
+
+static const char *font_name[] =
+{
+	"A_NORMAL", "A_ITALIC", "A_BOLD", "U_NORMAL", "U_BOLD",
+	"LU_NORMAL", "LU_BOLD", "SEGMENT", "BIG_SEGMENT", "S_METER",
+};
+
+static uint16_t ref[ILI_VIEW_H][ILI_VIEW_W];
+
+
+static void boot (void)
+{
+	host_reset ();
+	ili_attach (TFT_CS, TFT_RS);
+	displayInit ();
+	lcd_wait ();
+}
+
+
+static void frame_report (const char *name)
+{
+	ili_counters c = ili_frame_end ();
+
+	printf ("%-22s %7lu bytes %5lu cmds %5lu cs %5lu px %7lu us sleep %7lu us\n", name,
+		(unsigned long)c.bytes, (unsigned long)c.commands, (unsigned long)c.cs_toggles,
+		(unsigned long)c.pixels, (unsigned long)c.sleep_us, (unsigned long)c.elapsed_us);
+
+	CHECK_EQ(c.stray, 0);
+	CHECK_EQ(c.clipped, 0);
+}
+
+
+static void frame_start (void)
+{
+	lcd_wait ();
+	memset (&lcd_stats, 0, sizeof(lcd_stats));
+	ili_frame_start ();
+}
+
+
+static void ref_grab (void)
+{
+	uint16_t x, y;
+
+	for (y = 0; y < ILI_VIEW_H; y++)
+		for (x = 0; x < ILI_VIEW_W; x++)
+			ref[y][x] = ili_pixel (x, y);
+}
+
+
+static void ref_fill (int x1, int y1, int x2, int y2, uint16_t c)
+{
+	int x, y;
+
+	for (y = y1; y <= y2; y++)
+		for (x = x1; x <= x2; x++)
+			ref[y][x] = c;
+}
+
+
+// A string the way displayRawText places it, glyph after glyph, straight from the font bits
+static void ref_text (const char *s, int x, int y, uint16_t fg, uint16_t bg, uint8_t use_font)
+{
+	const uint8_t *font = get_font (use_font);
+	uint8_t w = font[0], h = font[1];
+	const uint8_t *g;
+	int dx, dy;
+
+	for (; *s  &&  x < ILI_VIEW_W; s++, x += w)
+	{
+		g = font + 4 + (*s - 0x20) * (w * h / 8);
+		for (dy = 0; dy < h; dy++)
+			for (dx = 0; dx < w  &&  x + dx < ILI_VIEW_W; dx++)
+				ref[y + dy][x + dx] = (g[dy * (w / 8) + dx / 8] & (0x80 >> (dx & 7))) ? fg : bg;
+	}
+}
+
+
+static int ref_diff (void)
+{
+	int x, y, n = 0;
+
+	lcd_wait ();
+	for (y = 0; y < ILI_VIEW_H; y++)
+		for (x = 0; x < ILI_VIEW_W; x++)
+			n += ref[y][x] != ili_pixel (x, y);
+	return n;
+}
+
+
+static void test_init (void)
+{
+	boot ();
+	CHECK(ili.display_on);
+	CHECK(!ili.sleeping);
+	CHECK_EQ(ili.madctl, 0x28);
+	CHECK_EQ(ili.pixfmt, 0x55);
+	// 5 ms after SWRESET, 120 ms from SWRESET to SLPOUT and 5 ms after SLPOUT
+	CHECK_EQ(ili.timing_errors, 0);
+	frame_report ("displayInit");
+}
+
+
+static void test_primitives (void)
+{
+	boot ();
+
+	frame_start ();
+	displayClear (DISPLAY_RED);
+	ref_fill (0, 0, ILI_VIEW_W - 1, ILI_VIEW_H - 1, DISPLAY_RED);
+	CHECK_EQ(ref_diff (), 0);
+	CHECK_EQ(ili.frame.bytes, lcd_stats.bytes);
+	CHECK_EQ(ili.frame.cs_toggles, lcd_stats.cs_toggles);
+	frame_report ("displayClear");
+
+	frame_start ();
+	displayFillrect (10, 20, 100, 50, DISPLAY_GREEN);
+	ref_fill (10, 20, 110, 70, DISPLAY_GREEN);
+	CHECK_EQ(ref_diff (), 0);
+	frame_report ("displayFillrect");
+
+	frame_start ();
+	displayRect (150, 100, 60, 40, DISPLAY_WHITE);
+	ref_fill (150, 100, 210, 100, DISPLAY_WHITE);
+	ref_fill (150, 140, 210, 140, DISPLAY_WHITE);
+	ref_fill (150, 100, 150, 140, DISPLAY_WHITE);
+	ref_fill (210, 100, 210, 140, DISPLAY_WHITE);
+	CHECK_EQ(ref_diff (), 0);
+	frame_report ("displayRect");
+
+	frame_start ();
+	displayPixel (319, 239, DISPLAY_YELLOW);
+	ref[239][319] = DISPLAY_YELLOW;
+	CHECK_EQ(ref_diff (), 0);
+	frame_report ("displayPixel");
+}
+
+
+// Every font, first with a cold and then with a warm glyph cache
+static void test_text (void)
+{
+	const char *s = "0123456789";
+	char name[32];
+	uint8_t f, pass;
+
+	boot ();
+
+	for (f = A_NORMAL; f <= BIG_SEGMENT; f++)
+	{
+		displayClear (DISPLAY_BLACK);
+		lcd_wait ();
+		ref_grab ();
+
+		for (pass = 0; pass < 2; pass++)
+		{
+			frame_start ();
+			displayRawText ((char *)s, 0, 0, DISPLAY_WHITE, DISPLAY_NAVY, f);
+			ref_text (s, 0, TEXT_LINE_HEIGHT, DISPLAY_WHITE, DISPLAY_NAVY, f);
+			if (ref_diff ())
+				fprintf (stderr, "font %s differs\n", font_name[f]);
+			CHECK_EQ(ref_diff (), 0);
+
+			snprintf (name, sizeof(name), "%s %s", font_name[f], pass ? "warm" : "cold");
+			frame_report (name);
+		}
+	}
+}
+
+
+// The scope bars of pan_data, rows from the top of each bar down are green
+static int sweep_diff (void)
+{
+	uint16_t i, x, y, top, bg;
+	int n = 0;
+
+	lcd_wait ();
+	for (i = 0; i < PAN_SZ; i++)
+	{
+		x = SWEEP_X + i;
+		top = SWEEP_BASE - ((pan_data[i] >> 4) & 0x3C);
+		if (top < SWEEP_TOP)
+			top = SWEEP_TOP;
+		bg = (x == SWEEP_MARK  ||  x == SWEEP_MARK + 1) ? DISPLAY_RED : DISPLAY_BLACK;
+
+		for (y = SWEEP_TOP; y < SWEEP_BASE; y++)
+			n += ili_pixel (x, y) != (y >= top ? DISPLAY_GREENYELLOW : bg);
+	}
+
+	return n;
+}
+
+
+// The DMA engine: a fill hands its pixels to the DMA and returns, the CPU
+// only waits for the command list. A scope frame costs one window per
+// column that changed.
+static void bench_dma (void)
+{
+	uint64_t t0, t_ret, t_wire;
+	uint16_t i;
+
+	boot ();
+
+	frame_start ();
+	t0 = host_ns;
+	displayClear (DISPLAY_BLUE);
+	t_ret = host_ns - t0;
+	lcd_wait ();
+	t_wire = host_ns - t0;
+	printf ("displayClear returns after %llu us, on the wire for %llu us, %lu transactions\n",
+		(unsigned long long)t_ret / 1000, (unsigned long long)t_wire / 1000, (unsigned long)lcd_stats.transactions);
+	CHECK_EQ(lcd_stats.transactions, 2);
+	CHECK(t_ret * 100 < t_wire);
+	frame_report ("displayClear (DMA)");
+
+	for (i = 0; i < PAN_SZ; i++)
+		pan_data[i] = (i * 37 + 400) % 1024;
+
+	frame_start ();
+	clearSweep ();
+	displaySweep ();
+	CHECK_EQ(sweep_diff (), 0);
+	printf ("first scope frame %lu transactions\n", (unsigned long)lcd_stats.transactions);
+	frame_report ("scope first frame");
+
+	// a small change only touches the columns that moved
+	for (i = 0; i < PAN_SZ; i += 8)
+		pan_data[i] = (pan_data[i] + 300) % 1024;
+
+	frame_start ();
+	displaySweep ();
+	CHECK_EQ(sweep_diff (), 0);
+	CHECK(lcd_stats.transactions <= 2 * (PAN_SZ / 8 + 1));
+	printf ("next scope frame %lu transactions\n", (unsigned long)lcd_stats.transactions);
+	frame_report ("scope next frame");
+}
+
+
+// Glyph blits for every font: one address window per character with
+// displayChar, one per string with displayText. Reports transactions and
+// microseconds per character, wire time included.
+static void bench_glyphs (void)
+{
+	const char *s = "0123456789";
+	uint8_t n = strlen (s);
+	uint64_t t0;
+	uint8_t f, i;
+	uint16_t fg;
+
+	boot ();
+	printf ("%-12s %22s %22s\n", "font", "displayChar", "displayText");
+
+	for (f = A_NORMAL; f <= BIG_SEGMENT; f++)
+	{
+		uint32_t char_tr, text_tr, text_cs;
+		uint64_t char_ns, text_ns;
+		uint8_t w = get_font (f)[0];
+
+		// a colour of its own keeps the glyph cache cold
+		fg = 0x1000 + f;
+
+		frame_start ();
+		t0 = host_ns;
+		for (i = 0; i < n; i++)
+			displayChar (i * w, 0, s[i], fg, DISPLAY_BLACK, f);
+		lcd_wait ();
+		char_ns = host_ns - t0;
+		char_tr = lcd_stats.transactions;
+		CHECK_EQ(ili_frame_end ().commands, 3 * n);
+
+		frame_start ();
+		t0 = host_ns;
+		displayText ((uint8_t *)s, 0, 100, fg + 0x100, DISPLAY_BLACK, f);
+		lcd_wait ();
+		text_ns = host_ns - t0;
+		text_tr = lcd_stats.transactions;
+		text_cs = ili_frame_end ().cs_toggles;
+		CHECK_EQ(ili.frame.commands, 3);
+		CHECK_EQ(text_cs, 1);
+
+		printf ("%-12s %6.1f tr %7.1f us/ch %6.1f tr %7.1f us/ch\n", font_name[f],
+			(double)char_tr / n, char_ns / 1000.0 / n, (double)text_tr / n, text_ns / 1000.0 / n);
+
+		displayClear (DISPLAY_BLACK);
+	}
+}
+
+
+// A tuning session: the knob in 10 Hz and 100 Hz steps, then a band change.
+// Replays the displayVFO calls and reports the glyph cache hit rate. The
+// readout must end up as a clean redraw at the same frequency leaves it.
+static void bench_vfo_cache (void)
+{
+	uint32_t hits, misses, bytes = 0;
+	uint16_t i, calls = 0;
+
+	boot ();
+	displayClear (DISPLAY_NAVY);
+	frequency = 7074000;
+	displayVFO (CLEAR_VFO);
+	lcd_wait ();
+
+	hits = glyph_hits;
+	misses = glyph_misses;
+	memset (&lcd_stats, 0, sizeof(lcd_stats));
+
+	for (i = 0; i < 500; i++, calls++)
+	{
+		frequency += 10;
+		displayVFO (KEEP_VFO);
+	}
+	for (i = 0; i < 200; i++, calls++)
+	{
+		frequency -= 100;
+		displayVFO (KEEP_VFO);
+	}
+	frequency = 14074000;
+	displayVFO (CLEAR_VFO);
+	calls++;
+	for (i = 0; i < 300; i++, calls++)
+	{
+		frequency += (i & 1) ? 10 : -30;
+		displayVFO (KEEP_VFO);
+	}
+	lcd_wait ();
+	bytes = lcd_stats.bytes;
+
+	hits = glyph_hits - hits;
+	misses = glyph_misses - misses;
+	printf ("displayVFO replay: %u calls, %lu glyph hits %lu misses, hit rate %.1f %%, %lu bytes per call\n",
+		calls, (unsigned long)hits, (unsigned long)misses, 100.0 * hits / (hits + misses), (unsigned long)(bytes / calls));
+	CHECK(hits > 9 * misses);
+
+	ref_grab ();
+	displayClear (DISPLAY_NAVY);
+	displayVFO (CLEAR_VFO);
+	CHECK_EQ(ref_diff (), 0);
+	frequency = 7074000;
+}
+
+
+// The screen pbitx.c draws at the end of setup()
+static void test_main_screen (void)
+{
+	uint32_t crc;
+
+	boot ();
+	frame_start ();
+	displayClear (DISPLAY_NAVY);
+	displayVFO (CLEAR_VFO);
+	ui_init ();
+	guiUpdate (CLEAR_VFO);
+	lcd_wait ();
+	frame_report ("main screen");
+
+	CHECK(ili_write_ppm ("main_screen.ppm"));
+	crc = ili_crc ();
+	if (getenv ("PBITX_UPDATE_GOLDEN"))
+		printf ("GOLDEN_MAIN_SCREEN 0x%08x\n", crc);
+	else
+		CHECK_EQ(crc, GOLDEN_MAIN_SCREEN);
+
+	// nothing changed, nothing is sent
+	frame_start ();
+	guiUpdate (KEEP_VFO);
+	lcd_wait ();
+	CHECK_EQ(ili.frame.bytes, 0);
+	frame_report ("main screen again");
+}
+
+
+static uint16_t s_level;
+
+static uint16_t smeter_adc (uint8_t input, uint64_t t_ns)
+{
+	(void)input;
+	(void)t_ns;
+	return s_level;
+}
+
+
+// Small changes on the main screen repaint only their widget: a new S-meter
+// value is its two glyphs, not the frame around them, and a new status text
+// leaves the scope and the waterfall over the status bar alone
+static void test_partial_updates (void)
+{
+	uint16_t scope;
+	ili_counters c;
+	uint16_t i;
+
+	host_adc_hook = smeter_adc;
+	s_level = 0;
+	draw_s_meter (false);
+	ui_compose ();
+	lcd_wait ();
+
+	s_level = 0x0A00;
+	frame_start ();
+	draw_s_meter (false);
+	ui_compose ();
+	lcd_wait ();
+	c = ili.frame;
+	frame_report ("S-meter change");
+	CHECK(c.pixels > 0);
+	CHECK(c.pixels <= 48 * 20);				// the glyphs, the frame is 51 x 29
+
+	sweep_on = true;
+	for (i = 0; i < PAN_SZ; i++)
+		pan_data[i] = i * 16;
+	clearSweep ();
+	clearWaterfall ();
+	displaySweep ();
+	displayWaterfall ();
+	lcd_wait ();
+	scope = ili_pixel (200, 170);
+
+	cwSpeed = 60;
+	frame_start ();
+	guiUpdate (KEEP_VFO);
+	lcd_wait ();
+	c = ili.frame;
+	frame_report ("status change");
+	CHECK(c.pixels > 0);
+	CHECK(c.pixels < 321 * 40 + 320 * TEXT_LINE_HEIGHT);	// the status bar and a line of text
+	CHECK_EQ(ili_pixel (200, 170), scope);
+
+	sweep_on = false;
+	cwSpeed = 100;
+	host_adc_hook = NULL;
+}
+
+
+int main (void)
+{
+	test_init ();
+	test_primitives ();
+	test_text ();
+	test_main_screen ();
+	test_partial_updates ();
+	bench_dma ();
+	bench_glyphs ();
+	bench_vfo_cache ();
+
+	return check_result ();
+}
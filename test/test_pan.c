@@ -0,0 +1,267 @@
+// pan_stream.c against the decoder in pan_decode.c: key and delta frames
+// give back the bins, odd bin counts, a skipped frame and damaged frames.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pbitx.h"
+#include "usb_ports.h"
+#include "pan_stream.h"
+#include "host.h"
+#include "radio_stub.h"
+#include "pan_decode.h"
+#include "check.h"
+
+static uint16_t bins[PAN_SZ];
+static uint8_t wire[16 * 1024];
+static pan_decoder dec;
+
+
+static void boot (void)
+{
+	host_reset ();
+	radio_reset ();
+	host_cdc_connected[USB_TELEMETRY] = true;
+	memset (&pan_stream_stats, 0, sizeof(pan_stream_stats));
+	memset (&dec, 0, sizeof(dec));
+	pan_stream_start (true);
+}
+
+
+// Send one sweep and decode what came out, returns the decoder's verdict
+static int sweep (uint16_t n, uint32_t center, uint32_t span)
+{
+	size_t len;
+
+	pan_stream_sweep (bins, n, center, span);
+	usb_task ();
+	len = host_cdc_tx (USB_TELEMETRY, wire, sizeof(wire));
+	if (len == 0)
+		return PAN_DEC_MORE;
+
+	return pan_decode (&dec, wire, len);
+}
+
+
+static bool bins_match (uint16_t n)
+{
+	uint16_t i;
+
+	if (dec.n != n)
+		return false;
+	for (i = 0; i < n; i++)
+		if (dec.bins[i] != (bins[i] & 0x0FFF))
+			return false;
+
+	return true;
+}
+
+
+// A noise floor that moves a little between sweeps, with a carrier now and
+// then and the odd full scale jump
+static void walk (uint16_t n)
+{
+	uint16_t i;
+	int v;
+
+	for (i = 0; i < n; i++)
+	{
+		v = (bins[i] & 0x0FFF) + rand () % 9 - 4;
+		if (rand () % 50 == 0)
+			v = rand () % 2 ? 4095 : 0;
+		bins[i] = v < 0 ? 0 : v > 4095 ? 4095 : v;
+	}
+}
+
+
+static void test_round_trip (void)
+{
+	uint32_t s, bytes = 0, key_bytes;
+	uint16_t i;
+	int r;
+
+	boot ();
+	srand (24);
+	for (i = 0; i < PAN_SZ; i++)
+		bins[i] = 300 + rand () % 40;
+
+	for (s = 0; s < 1000; s++)
+	{
+		walk (PAN_SZ);
+		r = sweep (PAN_SZ, 7074000, 48000);
+		CHECK(r > 0);
+		CHECK(bins_match (PAN_SZ));
+		CHECK_EQ(dec.center, 7074000);
+		CHECK_EQ(dec.step, 48000 / PAN_SZ);
+		CHECK_EQ(dec.seq, s);
+		CHECK_EQ(!(dec.flags & PAN_F_DELTA), s % PAN_KEY_EVERY == 0);
+		bytes += r;
+	}
+
+	key_bytes = PAN_HDR_SZ + (PAN_SZ / 2) * 3 + 2 + 2;
+	CHECK_EQ(pan_stream_stats.key_frames, 1000 / PAN_KEY_EVERY + 1);
+	CHECK(bytes < 1000 * key_bytes * 8 / 10);
+	printf ("round trip: 1000 sweeps in %lu bytes, %lu as key frames only\n",
+		(unsigned long)bytes, (unsigned long)(1000 * key_bytes));
+}
+
+
+// Deltas as large as they get, and bits above the 12 the ADC has
+static void test_extremes (void)
+{
+	uint16_t i;
+	uint8_t s;
+
+	boot ();
+	for (s = 0; s < 40; s++)
+	{
+		for (i = 0; i < PAN_SZ; i++)
+			bins[i] = (s + i) & 1 ? 0xF000 | 4095 : 0;
+		if (s % 3 == 0)
+			bins[s] = 0x0ABC;
+		CHECK(sweep (PAN_SZ, 14074000, 3000) > 0);
+		CHECK(bins_match (PAN_SZ));
+	}
+}
+
+
+// Key frames pack two bins in three bytes, an odd count ends in a u16
+static void test_odd_counts (void)
+{
+	static const uint16_t counts[] = { 1, 2, 3, 17, 128, 254, 255 };
+	uint8_t c, s;
+
+	for (c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+	{
+		boot ();
+		for (s = 0; s < 20; s++)
+		{
+			walk (counts[c]);
+			CHECK(sweep (counts[c], 10000000, 10000) > 0);
+			CHECK(bins_match (counts[c]));
+			CHECK_EQ(dec.step, 10000 / counts[c]);
+		}
+	}
+}
+
+
+// No bins, no frame
+static void test_empty (void)
+{
+	boot ();
+	CHECK_EQ(sweep (0, 7074000, 48000), PAN_DEC_MORE);
+	CHECK_EQ(pan_stream_stats.frames, 0);
+	CHECK_EQ(pan_stream_stats.skipped, 0);
+}
+
+
+// The host stops reading, the FIFO fills, sweeps are skipped and the first
+// frame after that is a key frame
+static void test_skip (void)
+{
+	uint32_t frames;
+	size_t len, at;
+	int r;
+
+	boot ();
+	for (frames = 0; frames < 4; frames++)
+	{
+		walk (PAN_SZ);
+		CHECK(sweep (PAN_SZ, 7074000, 48000) > 0);
+	}
+
+	while (pan_stream_stats.skipped == 0)
+	{
+		walk (PAN_SZ);
+		pan_stream_sweep (bins, PAN_SZ, 7074000, 48000);
+	}
+	walk (PAN_SZ);
+	pan_stream_sweep (bins, PAN_SZ, 7074000, 48000);
+	CHECK(pan_stream_stats.skipped >= 1);
+
+	// what did get out decodes, the last of it being complete frames
+	usb_task ();
+	len = host_cdc_tx (USB_TELEMETRY, wire, sizeof(wire));
+	for (at = 0; at < len; at += r)
+	{
+		r = pan_decode (&dec, wire + at, len - at);
+		CHECK(r > 0);
+		if (r <= 0)
+			return;
+	}
+
+	walk (PAN_SZ);
+	CHECK(sweep (PAN_SZ, 7074000, 48000) > 0);
+	CHECK(!(dec.flags & PAN_F_DELTA));
+	CHECK(bins_match (PAN_SZ));
+	walk (PAN_SZ);
+	CHECK(sweep (PAN_SZ, 7074000, 48000) > 0);
+	CHECK(dec.flags & PAN_F_DELTA);
+	CHECK(bins_match (PAN_SZ));
+}
+
+
+// Flip every bit of a delta frame in turn, the CRC turns each one away and
+// the decoder waits for the next key frame
+static void test_damage (void)
+{
+	static uint8_t good[2 * PAN_SZ + PAN_HDR_SZ + 2];
+	pan_decoder saved;
+	size_t len, i;
+	uint8_t b;
+	int r;
+
+	boot ();
+	walk (PAN_SZ);
+	CHECK(sweep (PAN_SZ, 7074000, 48000) > 0);
+	walk (PAN_SZ);
+	pan_stream_sweep (bins, PAN_SZ, 7074000, 48000);
+	usb_task ();
+	len = host_cdc_tx (USB_TELEMETRY, good, sizeof(good));
+	CHECK(good[3] & PAN_F_DELTA);
+	saved = dec;
+
+	for (i = 0; i < len; i++)
+	{
+		for (b = 0; b < 8; b++)
+		{
+			dec = saved;
+			memcpy (wire, good, len);
+			wire[i] ^= 1 << b;
+			r = pan_decode (&dec, wire, len);
+			CHECK(r == PAN_DEC_BAD  ||  (r == PAN_DEC_MORE  &&  i >= 24  &&  i < 26));
+		}
+	}
+
+	dec = saved;
+	CHECK_EQ(pan_decode (&dec, good, len), (int)len);
+	CHECK(bins_match (PAN_SZ));
+
+	// a lost frame, the delta after it does not apply
+	walk (PAN_SZ);
+	pan_stream_sweep (bins, PAN_SZ, 7074000, 48000);
+	usb_task ();
+	host_cdc_tx (USB_TELEMETRY, wire, sizeof(wire));
+	walk (PAN_SZ);
+	CHECK_EQ(sweep (PAN_SZ, 7074000, 48000), PAN_DEC_NO_REF);
+	while (sweep (PAN_SZ, 7074000, 48000) == PAN_DEC_NO_REF)
+		walk (PAN_SZ);
+	CHECK(!(dec.flags & PAN_F_DELTA));
+	CHECK(bins_match (PAN_SZ));
+}
+
+
+int main (void)
+{
+	usb_init ();
+
+	test_round_trip ();
+	test_extremes ();
+	test_odd_counts ();
+	test_empty ();
+	test_skip ();
+	test_damage ();
+
+	return check_result ();
+}
@@ -0,0 +1,182 @@
+// settings.c over the e_storage image: the round trip, the conversion of
+// the old eeprom layout and what a damaged or unknown block falls back to.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pbitx.h"
+#include "e_storage.h"
+#include "host.h"
+#include "check.h"
+
+void settings_load (void);
+
+// version 0 addresses, as in settings.c
+#define V0_USB_CAL		8
+#define V0_VFO_A		16
+#define V0_VFO_B		20
+#define V0_CW_SIDETONE	24
+#define V0_CW_SPEED		28
+#define V0_SLOPE_X		32
+#define V0_SLOPE_Y		36
+#define V0_OFFSET_X		40
+#define V0_OFFSET_Y		44
+#define V0_MASTER_CAL	128
+
+static Settings saved;
+
+
+static bool block_valid (void)
+{
+	Settings s;
+
+	e_get_block (SETTINGS_ADDR, &s, sizeof(s));
+	return s.magic == SETTINGS_MAGIC  &&  s.version == SETTINGS_VERSION
+		&&  s.crc == crc16 ((const uint8_t *)&s, offsetof(Settings, crc));
+}
+
+
+// Load into a cleared struct
+static void load (void)
+{
+	memset (&settings, 0x55, sizeof(settings));
+	settings_load ();
+}
+
+
+static void v0_radio (void)
+{
+	uint16_t k;
+
+	for (k = 0; k < E_SIZE; k += 4)
+		e_put (k, 0);
+	e_put (V0_USB_CAL, 11053500);
+	e_put (V0_VFO_A, 7074000);
+	e_put (V0_VFO_B, 14074000);
+	e_put (V0_CW_SIDETONE, 650);
+	e_put (V0_CW_SPEED, 80);
+	e_put (V0_SLOPE_X, 101);
+	e_put (V0_SLOPE_Y, 140);
+	e_put (V0_OFFSET_X, 25);
+	e_put (V0_OFFSET_Y, 33);
+	e_put (V0_MASTER_CAL, -2500);
+}
+
+
+static void test_migration (void)
+{
+	v0_radio ();
+	load ();
+	CHECK_EQ(settings.usb_cal, 11053500);
+	CHECK_EQ(settings.vfo_a, 7074000);
+	CHECK_EQ(settings.vfo_b, 14074000);
+	CHECK_EQ(settings.cw_sidetone, 650);
+	CHECK_EQ(settings.cw_speed, 80);
+	CHECK_EQ(settings.master_cal, -2500);
+	CHECK_EQ(settings.slope_y, 140);
+	CHECK_EQ(settings.offset_x, 25);
+	CHECK(block_valid ());
+
+	// the v0 words are still there for a fallback
+	CHECK_EQ(e_get (V0_VFO_A), 7074000);
+}
+
+
+static void test_round_trip (void)
+{
+	load ();
+	settings.vfo_a = 3573000;
+	settings.vfo_b = 28074000;
+	settings.cw_key_type = 2;
+	settings.vfo_a_mode = VFO_MODE_LSB;
+	settings.slope_x = 98;
+	settings.offset_y = 31;
+	settings.master_cal = 20500;
+	settings_save ();
+	saved = settings;
+
+	load ();
+	CHECK(!memcmp (&settings, &saved, sizeof(settings)));
+	CHECK(block_valid ());
+}
+
+
+// A word of the block changes behind the CRC's back
+static void test_bad_crc (void)
+{
+	e_put (SETTINGS_ADDR + offsetof(Settings, vfo_b), 21074000);
+	load ();
+	CHECK_EQ(settings.vfo_a, 7074000);		// the v0 values
+	CHECK_EQ(settings.master_cal, -2500);
+	CHECK(block_valid ());
+
+	// no usable v0 values either
+	e_put (SETTINGS_ADDR + offsetof(Settings, vfo_b), 21074000);
+	e_put (V0_USB_CAL, 0);
+	load ();
+	CHECK_EQ(settings.vfo_a, 7150000);
+	CHECK_EQ(settings.usb_cal, 11052000);
+	CHECK_EQ(settings.master_cal, 11850);
+	CHECK_EQ(settings.slope_x, 104);
+	CHECK(block_valid ());
+}
+
+
+// A valid block written by a later firmware, its layout is unknown
+static void test_newer_version (void)
+{
+	v0_radio ();
+	load ();
+	settings.vfo_a = 10136000;
+	settings_save ();
+	settings.version = SETTINGS_VERSION + 1;
+	settings.crc = crc16 ((const uint8_t *)&settings, offsetof(Settings, crc));
+	e_put_block (SETTINGS_ADDR, &settings, sizeof(settings));
+
+	load ();
+	CHECK_EQ(settings.version, SETTINGS_VERSION);
+	CHECK_EQ(settings.vfo_a, 7074000);
+	CHECK(block_valid ());
+}
+
+
+// A good CRC over values no radio has, the calibrations go back to defaults
+static void test_ranges (void)
+{
+	load ();
+	settings.master_cal = 2000000;
+	settings.slope_y = 0;
+	settings.vfo_a = 5357000;
+	settings_save ();
+
+	load ();
+	CHECK_EQ(settings.master_cal, 11850);
+	CHECK_EQ(settings.slope_x, 104);
+	CHECK_EQ(settings.slope_y, 137);
+	CHECK_EQ(settings.vfo_a, 5357000);
+	CHECK(block_valid ());
+
+	settings.offset_x = -3;
+	settings.master_cal = -100000;
+	settings_save ();
+	load ();
+	CHECK_EQ(settings.offset_x, 28);
+	CHECK_EQ(settings.master_cal, -100000);
+}
+
+
+int main (void)
+{
+	host_reset ();
+	e_init ();
+
+	test_migration ();
+	test_round_trip ();
+	test_bad_crc ();
+	test_newer_version ();
+	test_ranges ();
+
+	return check_result ();
+}
@@ -0,0 +1,322 @@
+// ubitx_si5351.c against the Si5351 model on the host I2C bus: the write
+// queue, its completion barrier and what happens when the chip NACKs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pico/stdlib.h"
+#include "pbitx.h"
+#include "host.h"
+#include "si5351_model.h"
+#include "check.h"
+
+#ifndef SI5351_RETRIES
+#define SI5351_RETRIES	3		// as in ubitx_si5351.c
+#endif
+
+extern uint32_t si5351bx_vcoa;
+extern uint8_t si5351bx_rdiv;
+void si5351bx_init (void);
+
+Settings settings;
+uint32_t usbCarrier = 11052000;
+
+void settings_save (void) {}
+
+
+static void boot (void)
+{
+	host_reset ();
+	si5351_model_attach ();
+	si5351bx_init ();
+	memset (&si5351_stats, 0, sizeof(si5351_stats));
+	si5351.transactions = 0;
+	si5351.bytes = 0;
+}
+
+
+// The chip holds the msynth registers si5351bx_regs() makes for f on clk
+static bool chip_has (uint8_t clk, uint32_t f)
+{
+	uint8_t vals[8];
+
+	si5351bx_regs (f, vals);
+	return !memcmp (si5351.regs + 42 + clk * 8, vals, 8)  &&  !(si5351.regs[3] & (1 << clk));
+}
+
+
+static void test_queue (void)
+{
+	boot ();
+	si5351bx_setfreq (0, usbCarrier);
+	si5351bx_setfreq (1, 45005000 + usbCarrier);
+	si5351bx_setfreq (2, 52074000);
+	CHECK(si5351bx_sync ());
+	CHECK(chip_has (0, usbCarrier));
+	CHECK(chip_has (1, 45005000 + usbCarrier));
+	CHECK(chip_has (2, 52074000));
+	CHECK_EQ(si5351_stats.aborts, 0);
+	CHECK_EQ(si5351_stats.errors, 0);
+	CHECK_EQ(si5351.transactions, si5351_stats.transactions);
+}
+
+
+// A NACK on a range while a newer, narrower write to the same clock waits
+// in its slot: the retry has to send both
+static void test_abort_union (void)
+{
+	uint32_t f = 52074000;
+
+	boot ();
+	host_i2c_nack = 1;
+	si5351bx_setfreq (2, f);		// all 8 registers, the first range on the bus
+	si5351bx_setfreq (2, f + 50);	// only the low bytes move
+	CHECK(si5351bx_sync ());
+	CHECK(chip_has (2, f + 50));
+	CHECK_EQ(si5351_stats.aborts, 1);
+	CHECK_EQ(si5351_stats.errors, 0);
+}
+
+
+// After SI5351_RETRIES retries the range is given up and reported, the next
+// write of the same values still goes out
+static void test_retry_cap (void)
+{
+	uint32_t f = 52074000;
+
+	boot ();
+	host_i2c_nack = SI5351_RETRIES + 1;
+	si5351bx_setfreq (2, f);
+	CHECK(!si5351bx_sync ());
+	CHECK_EQ(si5351_stats.aborts, SI5351_RETRIES + 1);
+	CHECK_EQ(si5351_stats.errors, 1);
+	CHECK(!chip_has (2, f));
+
+	si5351bx_setfreq (2, f);
+	CHECK(si5351bx_sync ());
+	CHECK(chip_has (2, f));
+}
+
+
+// No chip on the bus, the barrier comes back within its time limit
+static void test_dead_bus (void)
+{
+	uint64_t t;
+	uint16_t i;
+
+	boot ();
+	host_i2c_nack = 100000;
+	t = host_ns;
+	for (i = 0; i < 100; i++)
+		si5351bx_setfreq (2, 52074000 + i * 50);
+	CHECK(!si5351bx_sync ());
+	CHECK(host_ns - t < 25000000ull);
+	CHECK(si5351_stats.errors > 0);
+	printf ("dead bus: %lu aborts %lu errors, sync took %llu us\n", (unsigned long)si5351_stats.aborts,
+		(unsigned long)si5351_stats.errors, (unsigned long long)(host_ns - t) / 1000);
+
+	host_i2c_nack = 0;
+	si5351bx_setfreq (2, 52074000);
+	CHECK(si5351bx_sync ());
+	CHECK(chip_has (2, 52074000));
+}
+
+
+// A bus too slow for the barrier, it times out and the queue finishes later
+static void test_timeout (void)
+{
+	boot ();
+	host_i2c_baud = 1000;
+	si5351bx_setfreq (2, 52074000);
+	CHECK(!si5351bx_sync ());
+	CHECK_EQ(si5351_stats.timeouts, 1);
+
+	host_i2c_baud = 400000;
+	host_run_us (20000);
+	CHECK(si5351bx_sync ());
+	CHECK(chip_has (2, 52074000));
+}
+
+
+// The msynth arithmetic of the original si5351bx_setfreq(), kept here as
+// the reference the tables are held to
+static bool ref_regs (uint32_t vcoa, uint8_t rdiv, uint32_t fout, uint8_t *vals)
+{
+	uint32_t msa, msb, msc, msxp1, msxp2, msxp3p2top;
+
+	if ((fout < 500000) || (fout > 109000000))
+		return false;
+
+	msa = vcoa / fout;
+	msb = vcoa % fout;
+	msc = fout;
+	while (msc & 0xfff00000)
+	{
+		msb = msb >> 1;
+		msc = msc >> 1;
+	}
+	msxp1 = (128 * msa + 128 * msb / msc - 512) | (((uint32_t)rdiv) << 20);
+	msxp2 = 128 * msb - 128 * msb / msc * msc;
+	msxp3p2top = (((msc & 0x0F0000) << 4) | msxp2);
+
+	vals[0] = msc >> 8;
+	vals[1] = msc;
+	vals[2] = msxp1 >> 16;
+	vals[3] = msxp1 >> 8;
+	vals[4] = msxp1;
+	vals[5] = msxp3p2top >> 16;
+	vals[6] = msxp2 >> 8;
+	vals[7] = msxp2;
+
+	return true;
+}
+
+
+static uint32_t rnd (uint32_t lo, uint32_t hi)
+{
+	return lo + (uint32_t)(((uint64_t)rand () << 16 ^ rand ()) % (hi - lo + 1));
+}
+
+
+// Every table entry against the reference for random plans and calibrations,
+// the range running over both ends of the msynth limits
+static void test_plan_tables (void)
+{
+	static Sweep_plan plan;
+	uint8_t vals[8];
+	uint32_t n = 0, i, k;
+
+	srand (12);
+	for (k = 0; k < 2000; k++)
+	{
+		si5351bx_vcoa = 875000000 + rnd (0, 100000) - 50000;
+		si5351bx_rdiv = rnd (0, 7) == 0 ? rnd (1, 7) : 0;
+		si5351bx_plan (&plan, rnd (400000, 109500000), rnd (1, 20000), PLAN_SZ);
+		for (i = 0; i < plan.count; i++, n++)
+		{
+			bool on = ref_regs (si5351bx_vcoa, si5351bx_rdiv, plan.start + i * plan.step, vals);
+
+			CHECK_EQ(plan.on[i], on);
+			if (on  &&  memcmp (plan.regs[i], vals, 8))
+			{
+				CHECK(!"plan entry differs from the reference");
+				printf ("  f %lu vcoa %lu rdiv %u\n", (unsigned long)(plan.start + i * plan.step),
+					(unsigned long)si5351bx_vcoa, si5351bx_rdiv);
+				return;
+			}
+		}
+	}
+	si5351bx_vcoa = SI5351_MODEL_VCO;
+	si5351bx_rdiv = 0;
+	printf ("plan tables: %lu entries match\n", (unsigned long)n);
+}
+
+
+// Played and set bins leave the same bytes in the chip, and the plan is
+// rebuilt when the calibration moves
+static void test_plan_play (void)
+{
+	static Sweep_plan plan;
+	uint32_t start, f, k;
+	uint16_t i;
+
+	boot ();
+	srand (3);
+	for (k = 0; k < 20; k++)
+	{
+		si5351bx_vcoa = 875000000 + rnd (0, 100000) - 50000;
+		start = rnd (45000000, 75000000);
+		si5351bx_plan (&plan, start, 100, PLAN_SZ);
+		for (i = 0; i < 25; i++)
+		{
+			uint16_t bin = rnd (0, PLAN_SZ - 1);
+
+			f = start + bin * 100;
+			si5351bx_play (&plan, 2, bin);
+			si5351bx_setfreq (1, f);
+			CHECK(si5351bx_sync ());
+			CHECK(!memcmp (si5351.regs + 42 + 16, si5351.regs + 42 + 8, 8));
+			CHECK(chip_has (2, f));
+		}
+	}
+
+	si5351bx_vcoa = SI5351_MODEL_VCO;
+	si5351bx_plan (&plan, 52000000, 100, PLAN_SZ);
+	si5351bx_vcoa += 1000;
+	si5351bx_plan (&plan, 52000000, 100, PLAN_SZ);
+	CHECK_EQ(plan.vcoa, si5351bx_vcoa);
+	si5351bx_play (&plan, 2, 0);
+	CHECK(si5351bx_sync ());
+	CHECK(chip_has (2, 52000000));
+	si5351bx_vcoa = SI5351_MODEL_VCO;
+}
+
+
+// A tuning sweep in 50 Hz steps, every step on the chip before the next
+// (a slow knob) and then all of them queued at once (a fast one). Without
+// the shadow every step is 3 transactions, 13 bytes.
+static void test_shadow_sweep (void)
+{
+	uint32_t f, steps = 2000;
+
+	boot ();
+	si5351bx_setfreq (2, 52074000);
+	CHECK(si5351bx_sync ());
+	si5351.transactions = si5351.bytes = 0;
+	memset (&si5351_stats, 0, sizeof(si5351_stats));
+
+	for (f = 52074000; f < 52074000 + steps * 50; f += 50)
+	{
+		si5351bx_setfreq (2, f + 50);
+		CHECK(si5351bx_sync ());
+	}
+	CHECK(chip_has (2, 52074000 + steps * 50));
+	CHECK_EQ(si5351.bytes, si5351_stats.bytes);
+	CHECK_EQ(si5351.transactions, si5351_stats.transactions);
+	CHECK_EQ(si5351_stats.bytes + si5351_stats.bytes_saved, steps * 13);
+	CHECK_EQ(si5351_stats.transactions + si5351_stats.transactions_saved, steps * 3);
+	CHECK(si5351.bytes < steps * 13 * 6 / 10);
+	printf ("slow sweep: %lu steps, %lu bytes %lu transactions on the wire, %lu / %lu without the shadow\n",
+		(unsigned long)steps, (unsigned long)si5351.bytes, (unsigned long)si5351.transactions,
+		(unsigned long)steps * 13, (unsigned long)steps * 3);
+
+	si5351.transactions = si5351.bytes = 0;
+	memset (&si5351_stats, 0, sizeof(si5351_stats));
+	for (f = 52074000 + steps * 50; f > 52074000; f -= 50)
+		si5351bx_setfreq (2, f - 50);
+	CHECK(si5351bx_sync ());
+	CHECK(chip_has (2, 52074000));
+	CHECK_EQ(si5351.bytes, si5351_stats.bytes);
+	CHECK(si5351.transactions < steps);
+	printf ("fast sweep: %lu steps, %lu bytes %lu transactions on the wire\n",
+		(unsigned long)steps, (unsigned long)si5351.bytes, (unsigned long)si5351.transactions);
+
+	// si5351bx_finetune() keeps P3 fixed, only the P2 bytes move
+	si5351.transactions = si5351.bytes = 0;
+	memset (&si5351_stats, 0, sizeof(si5351_stats));
+	for (f = 52074000; f < 52074000 + steps * 50; f += 50)
+	{
+		si5351bx_finetune (2, f + 50);
+		CHECK(si5351bx_sync ());
+	}
+	CHECK(fabs (si5351_model_freq (2) - (52074000 + steps * 50)) < 1.5);
+	CHECK(si5351.bytes <= steps * 5);
+	printf ("fine sweep: %lu steps, %lu bytes %lu transactions on the wire\n",
+		(unsigned long)steps, (unsigned long)si5351.bytes, (unsigned long)si5351.transactions);
+}
+
+
+int main (void)
+{
+	test_queue ();
+	test_abort_union ();
+	test_retry_cap ();
+	test_dead_bus ();
+	test_timeout ();
+	test_plan_tables ();
+	test_plan_play ();
+	test_shadow_sweep ();
+
+	return check_result ();
+}
@@ -0,0 +1,257 @@
+// The settings log of e_storage.c on the flash model: what a stream of
+// settings changes costs in erases and how they spread over the ring, and
+// random power cuts during writes. The source is included so a reboot can
+// put its state back to power up while the flash keeps its contents.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host.h"
+#include "check.h"
+
+#include "e_storage.c"
+
+#define RING_FIRST	(STORE_OFFSET / FLASH_SECTOR_SIZE)
+#define KEYS		(E_SIZE / 4)
+
+static uint32_t ref[KEYS];			// values the flash has to give back
+
+
+// Power up, RAM is gone and the flash stays
+static void reboot (void)
+{
+	memset (image, 0, sizeof(image));
+	memset (dirty, 0, sizeof(dirty));
+	dirty_since = 0;
+	loaded = false;
+	sector = 0;
+	slot = 0;
+	seq = 0;
+	put_page = -1;
+	next_erased = false;
+	snap_page = -1;
+	e_init ();
+}
+
+
+static uint32_t rnd (void)
+{
+	return (uint32_t)rand () << 16 ^ rand ();
+}
+
+
+static void ref_grab (void)
+{
+	uint16_t k;
+
+	for (k = 0; k < KEYS; k++)
+		ref[k] = e_get (k * 4);
+}
+
+
+static bool image_is (const uint32_t *want)
+{
+	uint16_t k;
+
+	for (k = 0; k < KEYS; k++)
+		if (e_get (k * 4) != want[k])
+			return false;
+
+	return true;
+}
+
+
+// First boot takes over the old eeprom page
+static void test_legacy (void)
+{
+	uint16_t k;
+
+	host_reset ();
+	for (k = 0; k < KEYS; k++)
+	{
+		ref[k] = rnd ();
+		memcpy (host_flash + LEGACY_OFFSET + k * 4, &ref[k], 4);
+	}
+	reboot ();
+	CHECK(image_is (ref));
+	reboot ();
+	CHECK(image_is (ref));
+}
+
+
+// A VFO switch writes 4 values, the old driver erased a sector for each
+static void test_wear (void)
+{
+	uint32_t i, lo = ~0u, hi = 0, puts = 0;
+	uint8_t s;
+
+	host_reset ();
+	reboot ();
+	ref_grab ();
+	srand (16);
+
+	for (i = 0; i < 20000; i++)
+	{
+		uint8_t n;
+
+		for (n = 0; n < 4; n++, puts++)
+		{
+			uint8_t k = rand () % 8;
+
+			ref[k] = rnd ();
+			e_put (k * 4, ref[k]);
+		}
+		e_flush ();
+	}
+
+	for (s = 0; s < STORE_SECTORS; s++)
+	{
+		if (host_flash_erases[RING_FIRST + s] < lo)
+			lo = host_flash_erases[RING_FIRST + s];
+		if (host_flash_erases[RING_FIRST + s] > hi)
+			hi = host_flash_erases[RING_FIRST + s];
+	}
+	CHECK(hi - lo <= 1);
+	CHECK(lo > 0);
+	CHECK(hi * STORE_SECTORS * 100 < puts);
+	printf ("wear: %lu e_put, %lu flushes, %lu erases per ring sector (old driver: %lu on one sector)\n",
+		(unsigned long)puts, (unsigned long)i, (unsigned long)hi, (unsigned long)puts);
+
+	reboot ();
+	CHECK(image_is (ref));
+}
+
+
+// Cut the power at a random flash operation while settings are written.
+// After the reboot every key holds its last flushed value or the one the
+// interrupted flush was writing.
+static void test_power_cuts (void)
+{
+	static uint32_t pending[KEYS];
+	static uint32_t trial, cuts, k;
+	static bool ok;
+
+	host_reset ();
+	reboot ();
+	ref_grab ();
+	memset (&e_stats, 0, sizeof(e_stats));
+	srand (1);
+
+	for (trial = 0; trial < 3000; trial++)
+	{
+		memcpy (pending, ref, sizeof(ref));
+		host_flash_cut = 1 + rand () % 16;
+
+		if (setjmp (host_flash_jmp) == 0)
+		{
+			for (;;)
+			{
+				uint8_t n = 1 + rand () % 12;
+
+				while (n--)
+				{
+					k = rand () % KEYS;
+					pending[k] = rnd ();
+					e_put (k * 4, pending[k]);
+				}
+				e_flush ();
+				memcpy (ref, pending, sizeof(ref));
+			}
+		}
+
+		cuts++;
+		host_flash_cut = 0;
+		reboot ();
+		for (ok = true, k = 0; k < KEYS; k++)
+			ok &= e_get (k * 4) == ref[k]  ||  e_get (k * 4) == pending[k];
+		CHECK(ok);
+		if (!ok)
+			break;
+
+		ref_grab ();
+	}
+
+	// and it still works after all that
+	ref[3] = 0x12345678;
+	e_put (12, ref[3]);
+	e_flush ();
+	reboot ();
+	CHECK(image_is (ref));
+	printf ("power cuts: %lu over %lu erases and %lu page programs, settings intact\n", (unsigned long)cuts,
+		(unsigned long)e_stats.erases, (unsigned long)e_stats.pages);
+}
+
+
+static uint32_t flash_ops (void)
+{
+	uint32_t n = host_flash_programs;
+	uint8_t s;
+
+	for (s = 0; s < STORE_SECTORS; s++)
+		n += host_flash_erases[RING_FIRST + s];
+
+	return n;
+}
+
+
+// The main loop calls e_idle() every 100 ms at safe points, each call may
+// do one erase or one page program and no more
+static void test_idle_steps (void)
+{
+	uint32_t i, ops, most = 0, calls = 0;
+
+	host_reset ();
+	reboot ();
+	ref_grab ();
+	memset (&e_stats, 0, sizeof(e_stats));
+	srand (18);
+
+	for (i = 0; i < 50000; i++)
+	{
+		if (rand () % 40 == 0)
+		{
+			uint8_t n = 1 + rand () % 40;
+
+			while (n--)
+			{
+				uint8_t k = rand () % KEYS;
+
+				ref[k] = rnd ();
+				e_put (k * 4, ref[k]);
+			}
+		}
+
+		host_ns += 100000000ull;		// LDELTA_T of the main loop
+		ops = flash_ops ();
+		e_idle ();
+		ops = flash_ops () - ops;
+		CHECK(ops <= 1);
+		if (ops > most)
+			most = ops;
+		calls += ops;
+	}
+
+	// quiet from here, it all gets out
+	for (i = 0; i < 1000; i++)
+	{
+		host_ns += 100000000ull;		// LDELTA_T of the main loop
+		e_idle ();
+	}
+	CHECK(dirty_count () == 0  &&  snap_page < 0);
+	printf ("e_idle: %lu calls with flash work, at most %lu operation per call, %lu erases, interrupts off %lu us at most\n",
+		(unsigned long)calls, (unsigned long)most, (unsigned long)e_stats.erases, (unsigned long)e_stats.irq_off_max_us);
+
+	reboot ();
+	CHECK(image_is (ref));
+}
+
+
+int main (void)
+{
+	test_legacy ();
+	test_wear ();
+	test_power_cuts ();
+	test_idle_steps ();
+
+	return check_result ();
+}
@@ -0,0 +1,210 @@
+// The sliced panorama sweep of pan_sweep.c on the Si5351 model and the
+// free running ADC capture: how long the receiver is off frequency per loop
+// tick, what happens when the dial moves in the middle of a sweep and what
+// the bins look like behind the detector model. Built once per capture
+// setting in CMakeLists.txt, test_detector is the benchmark of averaging
+// depth against sweep time.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pico/stdlib.h"
+#include "pbitx.h"
+#include "pan_adc.h"
+#include "host.h"
+#include "si5351_model.h"
+#include "detector_model.h"
+#include "check.h"
+
+#define TICK_NS		10000000ull		// main loop tick
+
+#ifndef PAN_SLICE
+#define PAN_SLICE		32				// as in pan_sweep.c
+#endif
+#ifndef PAN_RETUNE_LEAD_US
+#define PAN_RETUNE_LEAD_US	(28 * 1000 / SI5351_I2C_KHZ * 9 / 10)	// as in pan_sweep.c
+#endif
+
+void si5351bx_init (void);
+
+Settings settings;
+uint32_t usbCarrier = 11052000;
+uint32_t frequency = 7074000;
+unsigned long firstIF = 45005000;
+
+void settings_save (void) {}
+
+static double rx_lo[3];			// the receive LOs as boot() set them
+
+// The receive LOs as pbitx.c sets them for USB
+void setfrequency (unsigned long f)
+{
+	si5351bx_finetune (2, firstIF + f);
+	si5351bx_setfreq (1, firstIF + usbCarrier);
+}
+
+
+static void boot (void)
+{
+	host_reset ();
+	si5351_model_attach ();
+	si5351bx_init ();
+	pan_adc_init ();
+	frequency = 7074000;
+	si5351bx_setfreq (0, usbCarrier);
+	setfrequency (frequency);
+	si5351bx_sync ();
+	rx_lo[0] = si5351_model_freq (0);
+	rx_lo[1] = si5351_model_freq (1);
+	rx_lo[2] = si5351_model_freq (2);
+}
+
+
+// One slice per 10 ms tick, returns the time it took in ns
+static uint64_t tick (bool *done)
+{
+	uint64_t t;
+
+	host_ns += TICK_NS;
+	t = host_ns;
+	*done = get_pan_data ();
+	si5351bx_sync ();
+	return host_ns - t;
+}
+
+
+// The receiver has its LOs back after every slice
+static bool receiving (void)
+{
+	uint8_t clk;
+
+	for (clk = 0; clk < 3; clk++)
+		if (fabs (si5351_model_freq (clk) - rx_lo[clk]) > 1)
+			return false;
+
+	return true;
+}
+
+
+static void test_slices (void)
+{
+	uint64_t t, worst = 0, total = 0;
+	uint32_t ticks = 0, sweeps = pan_sweeps;
+	bool done = false, rx = true;
+
+	boot ();
+	while (pan_sweeps - sweeps < 4)
+	{
+		t = tick (&done);
+		total += t;
+		if (t > worst)
+			worst = t;
+		rx &= receiving ();
+		ticks++;
+	}
+
+	CHECK(rx);
+	CHECK(done);
+	CHECK_EQ(pan_center, 7074000);
+	// the budget, the last bin, park and restore
+	CHECK(worst < 3100000 + (PAN_SETTLE + PAN_SAMPLES) * PAN_SAMPLE_US * 1000ull);
+	printf ("slices: %lu ticks for 4 sweeps, worst slice %lu us, receiver off frequency %lu%% of the time\n",
+		(unsigned long)ticks, (unsigned long)(worst / 1000), (unsigned long)(total * 100 / (ticks * TICK_NS)));
+}
+
+
+// The dial moves half way through a sweep, that sweep is dropped and the
+// next one is made and published on the new frequency
+static void test_restart (void)
+{
+	uint32_t sweeps, restarts, ticks;
+	bool done;
+
+	boot ();
+	do
+		tick (&done);
+	while (!done);
+
+	tick (&done);
+	tick (&done);
+	CHECK(!done);
+	sweeps = pan_sweeps;
+	restarts = pan_restarts;
+	frequency = 7030000;
+	setfrequency (frequency);
+	si5351bx_sync ();
+	rx_lo[2] = si5351_model_freq (2);
+
+	for (ticks = 0, done = false; !done; ticks++)
+		tick (&done);
+
+	CHECK_EQ(pan_sweeps, sweeps + 1);
+	CHECK_EQ(pan_restarts, restarts + 1);
+	CHECK_EQ(pan_center, 7030000);
+	CHECK(receiving ());
+
+	// a whole sweep of bins after the change, none from before it
+	CHECK(ticks * PAN_SLICE >= PAN_SZ);
+}
+
+
+// Steady level of bin i of a sweep around center
+static double bin_truth (uint32_t center, uint16_t i)
+{
+	return detector_level (center - (PAN_SZ / 2) * (PAN_SPAN / PAN_SZ) + i * (PAN_SPAN / PAN_SZ));
+}
+
+
+// A band with a few signals in it, swept until the averaging with the last
+// sweep has settled. The bins are compared with the detector's steady level.
+static void test_detector (void)
+{
+	static const detector_carrier band[] = {
+		{ 7074000, 2500 }, { 7076500, 900 }, { 7030000, 1800 }, { 7031200, 300 },
+		{ 7100000, 1200 }, { 7150000, 3000 }, { 7000500, 600 },
+	};
+	uint64_t t, busy = 0;
+	uint32_t ticks = 0, sweeps;
+	double e, sum = 0, sq = 0, worst = 0;
+	bool done;
+	uint16_t i;
+
+	boot ();
+	detector_model_attach (firstIF);
+	memcpy (detector.carrier, band, sizeof(band));
+	detector.carriers = sizeof(band) / sizeof(band[0]);
+
+	for (sweeps = 0; sweeps < 8; )
+	{
+		t = tick (&done);
+		busy += t;
+		ticks++;
+		sweeps += done;
+	}
+
+	for (i = 0; i < PAN_SZ; i++)
+	{
+		e = pan_data[i] - bin_truth (pan_center, i);
+		sum += e;
+		sq += e * e;
+		if (fabs (e) > fabs (worst))
+			worst = e;
+	}
+
+	CHECK_EQ(detector.late_retunes, 0);
+	CHECK(sqrt (sq / PAN_SZ) < 2 * detector.noise / sqrt (PAN_SAMPLES) + 4);
+	printf ("detector: settle %u + %u samples, retune lead %u us: %lu us of slice per bin, a sweep every %lu ms, error rms %.1f worst %.0f bias %.1f counts\n",
+		PAN_SETTLE, PAN_SAMPLES, (unsigned)PAN_RETUNE_LEAD_US, (unsigned long)(busy / 1000 / (sweeps * PAN_SZ)),
+		(unsigned long)(ticks * (TICK_NS / 1000000) / sweeps), sqrt (sq / PAN_SZ), worst, sum / PAN_SZ);
+}
+
+
+int main (void)
+{
+	test_slices ();
+	test_restart ();
+	test_detector ();
+
+	return check_result ();
+}
@@ -0,0 +1,231 @@
+// The three USB CDC ports under load: CAT polls, the panorama stream and a
+// flood of console text at once, first with a PC that reads everything and
+// then with one that stops reading the console and the telemetry port.
+// Each port has to carry only its own traffic and CAT has to keep up.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pbitx.h"
+#include "dispatch.h"
+#include "civ.h"
+#include "usb_ports.h"
+#include "pan_stream.h"
+#include "host.h"
+#include "radio_stub.h"
+#include "pan_decode.h"
+#include "check.h"
+
+#define REPLY_SZ	11			// read frequency reply
+
+static const uint8_t read_freq[] = { 0xFE, 0xFE, CIV_RIG_ADDR, CIV_CTRL_ADDR, GET_DISP_FREQ, END_NUM };
+
+static uint8_t buf[64 * 1024];
+static uint16_t bins[PAN_SZ];
+
+typedef struct
+{
+	uint32_t polls, replies, bad;		// CAT
+	uint32_t text, not_text;			// console bytes
+	uint32_t frames, bad_frames;		// telemetry
+	size_t pan_n;						// telemetry bytes not walked yet
+} port_check;
+
+static port_check pc;
+static uint8_t pan_in[64 * 1024];
+static pan_decoder dec;
+
+
+// The CAT port only ever carries whole read frequency replies
+static void check_cat (void)
+{
+	size_t n, i;
+
+	n = host_cdc_tx (USB_CAT, buf, sizeof(buf));
+	for (i = 0; i + REPLY_SZ <= n; i += REPLY_SZ)
+	{
+		if (buf[i] == 0xFE  &&  buf[i + 1] == 0xFE  &&  buf[i + 2] == CIV_CTRL_ADDR  &&  buf[i + 3] == CIV_RIG_ADDR
+			&&  buf[i + 4] == GET_DISP_FREQ  &&  buf[i + 10] == END_NUM)
+			pc.replies++;
+		else
+			pc.bad++;
+	}
+	if (i != n)
+		pc.bad++;
+}
+
+
+static void check_console (void)
+{
+	size_t n, i;
+
+	n = host_cdc_tx (USB_CONSOLE, buf, sizeof(buf));
+	for (i = 0; i < n; i++)
+	{
+		if ((buf[i] >= ' '  &&  buf[i] <= '~')  ||  buf[i] == '\n'  ||  buf[i] == '\r')
+			pc.text++;
+		else
+			pc.not_text++;
+	}
+}
+
+
+// Decode the panorama frames, anything between them is foreign
+static void check_telemetry (void)
+{
+	size_t i = 0;
+	int r;
+
+	pc.pan_n += host_cdc_tx (USB_TELEMETRY, pan_in + pc.pan_n, sizeof(pan_in) - pc.pan_n);
+
+	while (i < pc.pan_n)
+	{
+		r = pan_decode (&dec, pan_in + i, pc.pan_n - i);
+		if (r == PAN_DEC_MORE)
+			break;
+		if (r > 0)
+		{
+			pc.frames++;
+			i += r;
+		}
+		else
+		{
+			pc.bad_frames++;
+			i++;
+		}
+	}
+
+	memmove (pan_in, pan_in + i, pc.pan_n - i);
+	pc.pan_n -= i;
+}
+
+
+// One 5 ms tick of the main loop, a sweep every 10 ticks and a screenful of
+// debug text every tick
+static void tick (uint32_t t, bool pc_reads)
+{
+	char line[64];
+	uint16_t i;
+	int n;
+
+	host_cdc_rx (USB_CAT, read_freq, sizeof(read_freq));
+	pc.polls++;
+
+	for (i = 0; i < 8; i++)
+	{
+		n = snprintf (line, sizeof(line), "Knob = %d tick %lu\n", i, (unsigned long)t);
+		host_stdio_out (line, n);
+	}
+
+	usb_task ();
+	civ_poll ();
+	while (civ_get_frame ())
+		dispatch ();
+	civ_flush ();
+
+	if (t % 10 == 0)
+	{
+		for (i = 0; i < PAN_SZ; i++)
+			bins[i] = (rand () % 64 + i * 8) & 0x0FFF;
+		pan_stream_sweep (bins, PAN_SZ, 7074000, 24000);
+	}
+
+	usb_task ();
+	host_ns += 5000000;
+	host_poll ();
+
+	check_cat ();
+	if (pc_reads)
+	{
+		check_console ();
+		check_telemetry ();
+	}
+}
+
+
+static void test_isolation (void)
+{
+	uint32_t t;
+
+	host_reset ();
+	radio_reset ();
+	host_cdc_connected[USB_CAT] = host_cdc_connected[USB_TELEMETRY] = host_cdc_connected[USB_CONSOLE] = true;
+	civ_init ();
+	pan_stream_start (true);
+	srand (23);
+	memset (&pc, 0, sizeof(pc));
+	memset (&dec, 0, sizeof(dec));
+
+	for (t = 0; t < 2000; t++)
+		tick (t, true);
+
+	CHECK_EQ(pc.replies, pc.polls);
+	CHECK_EQ(pc.bad, 0);
+	CHECK_EQ(pc.not_text, 0);
+	CHECK_EQ(pc.bad_frames, 0);
+	CHECK_EQ(pc.frames, 200);
+	CHECK(pc.text > 2000 * 8 * 15);
+	printf ("PC reading: %lu CAT replies, %lu console bytes, %lu panorama frames, console dropped %lu\n",
+		(unsigned long)pc.replies, (unsigned long)pc.text, (unsigned long)pc.frames,
+		(unsigned long)usb_stats[USB_CONSOLE].tx_dropped);
+
+	// the PC stops reading console and telemetry, their FIFOs fill up
+	memset (&pc, 0, sizeof(pc));
+	memset (usb_stats, 0, sizeof(usb_stats));
+	pan_stream_stats.skipped = 0;
+	for (t = 0; t < 4000; t++)
+		tick (t, false);
+
+	CHECK_EQ(pc.replies, pc.polls);
+	CHECK_EQ(pc.bad, 0);
+	CHECK(usb_stats[USB_CONSOLE].tx_dropped > 0);
+	CHECK(pan_stream_stats.skipped > 0);
+	printf ("PC not reading: %lu CAT replies, console dropped %lu bytes, %lu sweeps skipped\n",
+		(unsigned long)pc.replies, (unsigned long)usb_stats[USB_CONSOLE].tx_dropped,
+		(unsigned long)pan_stream_stats.skipped);
+
+	// and once it reads again the backlog comes out clean
+	memset (&pc, 0, sizeof(pc));
+	for (t = 0; t < 200; t++)
+		tick (t, true);
+	CHECK_EQ(pc.replies, pc.polls);
+	CHECK_EQ(pc.not_text, 0);
+	CHECK_EQ(pc.bad_frames, 0);
+	CHECK(pc.frames > 0);
+}
+
+
+// A port the PC never opened takes nothing from the others
+static void test_closed_ports (void)
+{
+	uint32_t t;
+
+	host_reset ();
+	radio_reset ();
+	host_cdc_connected[USB_CAT] = true;
+	civ_init ();
+	pan_stream_start (true);
+	memset (&pc, 0, sizeof(pc));
+	memset (usb_stats, 0, sizeof(usb_stats));
+
+	for (t = 0; t < 500; t++)
+		tick (t, true);
+
+	CHECK_EQ(pc.replies, pc.polls);
+	CHECK_EQ(pc.bad, 0);
+	CHECK_EQ(pc.text, 0);
+	CHECK_EQ(pc.frames, 0);
+	CHECK(usb_stats[USB_CONSOLE].tx_dropped > 0);
+}
+
+
+int main (void)
+{
+	usb_init ();
+
+	test_isolation ();
+	test_closed_ports ();
+
+	return check_result ();
+}
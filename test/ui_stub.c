@@ -0,0 +1,41 @@
+// The radio state ubitx_ui.c reads from pbitx.c, with a fixed set of values
+// so the rendered screens are repeatable
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/stdlib.h"
+#include "pbitx.h"
+#include "gui_driver.h"
+
+uint32_t frequency = 7074000;
+uint32_t vfo_a_freq = 7074000;
+uint32_t vfo_b_freq = 14074000;
+uint32_t sideTone = 800;
+uint32_t ritTxFrequency;
+int cwSpeed = 100;
+uint8_t active_vfo = VFO_A;
+uint8_t mode = USB;
+bool accel_vfo = false;
+bool inTx = false;
+bool ritOn = false;
+bool split_on = false;
+bool sweep_on = false;
+Settings settings;
+
+static uint16_t pan_buff[PAN_SZ];
+uint16_t *pan_data = pan_buff;
+
+void cw_keyer_init (uint32_t frq) { (void)frq; }
+int enc_read (void) { return 0; }
+bool readTouch (void) { return false; }
+void readTouchCalibration (void) {}
+bool xpt2046_Init (void) { return true; }
+void scaleTouch (struct Point *p) { (void)p; }
+void ritDisable (void) { ritOn = false; }
+void ritEnable (uint32_t f) { ritTxFrequency = f; ritOn = true; }
+void saveVFOs (void) {}
+void set_cw_mon_freq (uint32_t frq) { (void)frq; }
+void set_cw_speed (uint16_t spd) { (void)spd; }
+void setfrequency (unsigned long f) { frequency = f; }
+void setmode (uint8_t m) { mode = m; }
+void settings_save (void) {}
+void switchVFO (int vfoSelect) { active_vfo = vfoSelect; }